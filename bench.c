@@ -0,0 +1,517 @@
+/*************************************************************************
+ * Benchmark
+ *
+ * Measures the throughput of trio and the corresponding libc functions
+ * for representative formats.
+ *
+ * Usage: bench [seconds [filter]]
+ *
+ * Each benchmark runs for at least the given number of CPU seconds
+ * (default 0.2). Only benchmarks whose name contains filter are run.
+ *
+ * The output is one tab-separated line per benchmark and function:
+ *
+ *   name  function  calls  ns/call  bytes/s
+ *
+ * Lines starting with # are comments.
+ */
+
+#if (defined(__linux__) || defined(__CYGWIN__)) && !defined(_GNU_SOURCE)
+/* Declares asprintf */
+# define _GNU_SOURCE
+#endif
+
+#include "triodef.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(TRIO_PLATFORM_UNIX)
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include "trio.h"
+#include "triop.h"
+#undef printf
+#undef fprintf
+#undef sprintf
+#undef snprintf
+#undef sscanf
+#undef dprintf
+#undef asprintf
+
+#if defined(TRIO_PLATFORM_UNIX)
+# define NULL_DEVICE "/dev/null"
+#elif defined(TRIO_PLATFORM_WIN32)
+# define NULL_DEVICE "NUL"
+#endif
+
+#if defined(PREDEF_STANDARD_C99) || (defined(TRIO_PLATFORM_UNIX) && !defined(__STRICT_ANSI__))
+# define USE_LIBC_SNPRINTF
+#endif
+#if TRIO_FEATURE_FD && defined(TRIO_PLATFORM_UNIX) && (PREDEF_STANDARD_POSIX - 0 >= 200809L)
+# define USE_LIBC_DPRINTF
+#endif
+#if defined(_GNU_SOURCE) || defined(__APPLE__) \
+ || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+# define USE_LIBC_ASPRINTF
+#endif
+
+typedef struct {
+  /* Calls a function once and returns the number of bytes produced */
+  int (*call) TRIO_PROTO((void));
+  TRIO_CONST char *name;
+  TRIO_CONST char *function;
+} benchmark_t;
+
+static char buffer[512];
+static FILE *nullFile = NULL;
+#if TRIO_FEATURE_FD && defined(TRIO_PLATFORM_UNIX)
+static int nullFd = -1;
+#endif
+static TRIO_CONST char *string = "The quick brown fox";
+static TRIO_CONST char *scanInput = "1234567 -42 3.14159 2.5e10";
+static int counter = 0;
+
+/*************************************************************************
+ * Formats
+ */
+#define FORMAT_INTEGERS "%d %u %x %ld"
+#define ARGS_INTEGERS counter, 4000000000U, 0xdeadbeef, -1234567890L
+#define FORMAT_DOUBLES "%f %e %g"
+#define ARGS_DOUBLES 3.14159265358979, 6.02214076e23, 0.000123456
+#define FORMAT_STRINGS "%s: %s"
+#define ARGS_STRINGS string, string
+#define FORMAT_PADDING "|%-24s|%08d|%12.3f|"
+#define ARGS_PADDING string, counter, 2.5
+#define FORMAT_POSITIONAL "%3$s %2$d %1$s"
+#define ARGS_POSITIONAL string, counter, string
+
+/*************************************************************************
+ * trio_snprintf
+ */
+static int
+trio_snprintf_integers(TRIO_NOARGS)
+{
+  return trio_snprintf(buffer, sizeof(buffer), FORMAT_INTEGERS, ARGS_INTEGERS);
+}
+
+static int
+trio_snprintf_doubles(TRIO_NOARGS)
+{
+  return trio_snprintf(buffer, sizeof(buffer), FORMAT_DOUBLES, ARGS_DOUBLES);
+}
+
+static int
+trio_snprintf_strings(TRIO_NOARGS)
+{
+  return trio_snprintf(buffer, sizeof(buffer), FORMAT_STRINGS, ARGS_STRINGS);
+}
+
+static int
+trio_snprintf_padding(TRIO_NOARGS)
+{
+  return trio_snprintf(buffer, sizeof(buffer), FORMAT_PADDING, ARGS_PADDING);
+}
+
+static int
+trio_snprintf_positional(TRIO_NOARGS)
+{
+  return trio_snprintf(buffer, sizeof(buffer), FORMAT_POSITIONAL, ARGS_POSITIONAL);
+}
+
+#if TRIO_FEATURE_USER_DEFINED
+static int
+integer_writer
+TRIO_ARGS1((ref),
+	   trio_pointer_t ref)
+{
+  int *data = (int *)trio_get_argument(ref);
+
+  if (data)
+    trio_print_int(ref, *data);
+  return 0;
+}
+
+static int
+trio_snprintf_userdef(TRIO_NOARGS)
+{
+  return trio_snprintf(buffer, sizeof(buffer), "%<bench:integer>", &counter);
+}
+#endif
+
+/*************************************************************************
+ * libc snprintf
+ */
+#if defined(USE_LIBC_SNPRINTF)
+static int
+libc_snprintf_integers(TRIO_NOARGS)
+{
+  return snprintf(buffer, sizeof(buffer), FORMAT_INTEGERS, ARGS_INTEGERS);
+}
+
+static int
+libc_snprintf_doubles(TRIO_NOARGS)
+{
+  return snprintf(buffer, sizeof(buffer), FORMAT_DOUBLES, ARGS_DOUBLES);
+}
+
+static int
+libc_snprintf_strings(TRIO_NOARGS)
+{
+  return snprintf(buffer, sizeof(buffer), FORMAT_STRINGS, ARGS_STRINGS);
+}
+
+static int
+libc_snprintf_padding(TRIO_NOARGS)
+{
+  return snprintf(buffer, sizeof(buffer), FORMAT_PADDING, ARGS_PADDING);
+}
+#endif
+
+#if defined(USE_LIBC_SNPRINTF) && defined(TRIO_PLATFORM_UNIX)
+static int
+libc_snprintf_positional(TRIO_NOARGS)
+{
+  return snprintf(buffer, sizeof(buffer), FORMAT_POSITIONAL, ARGS_POSITIONAL);
+}
+#endif
+
+/*************************************************************************
+ * trio_aprintf
+ */
+#if TRIO_FEATURE_DYNAMICSTRING
+static int
+trio_aprintf_integers(TRIO_NOARGS)
+{
+  char *result = trio_aprintf(FORMAT_INTEGERS, ARGS_INTEGERS);
+  int length = result ? (int)strlen(result) : 0;
+
+  free(result);
+  return length;
+}
+
+static int
+trio_aprintf_doubles(TRIO_NOARGS)
+{
+  char *result = trio_aprintf(FORMAT_DOUBLES, ARGS_DOUBLES);
+  int length = result ? (int)strlen(result) : 0;
+
+  free(result);
+  return length;
+}
+
+static int
+trio_aprintf_strings(TRIO_NOARGS)
+{
+  char *result = trio_aprintf(FORMAT_STRINGS, ARGS_STRINGS);
+  int length = result ? (int)strlen(result) : 0;
+
+  free(result);
+  return length;
+}
+#endif
+
+/*************************************************************************
+ * libc asprintf
+ */
+#if TRIO_FEATURE_DYNAMICSTRING && defined(USE_LIBC_ASPRINTF)
+static int
+libc_asprintf_integers(TRIO_NOARGS)
+{
+  char *result;
+  int length = asprintf(&result, FORMAT_INTEGERS, ARGS_INTEGERS);
+
+  if (length >= 0)
+    free(result);
+  return (length > 0) ? length : 0;
+}
+
+static int
+libc_asprintf_doubles(TRIO_NOARGS)
+{
+  char *result;
+  int length = asprintf(&result, FORMAT_DOUBLES, ARGS_DOUBLES);
+
+  if (length >= 0)
+    free(result);
+  return (length > 0) ? length : 0;
+}
+
+static int
+libc_asprintf_strings(TRIO_NOARGS)
+{
+  char *result;
+  int length = asprintf(&result, FORMAT_STRINGS, ARGS_STRINGS);
+
+  if (length >= 0)
+    free(result);
+  return (length > 0) ? length : 0;
+}
+#endif
+
+/*************************************************************************
+ * trio_fprintf and libc fprintf
+ */
+#if TRIO_FEATURE_FILE && defined(NULL_DEVICE)
+static int
+trio_fprintf_integers(TRIO_NOARGS)
+{
+  return trio_fprintf(nullFile, FORMAT_INTEGERS, ARGS_INTEGERS);
+}
+
+static int
+trio_fprintf_doubles(TRIO_NOARGS)
+{
+  return trio_fprintf(nullFile, FORMAT_DOUBLES, ARGS_DOUBLES);
+}
+
+static int
+trio_fprintf_padding(TRIO_NOARGS)
+{
+  return trio_fprintf(nullFile, FORMAT_PADDING, ARGS_PADDING);
+}
+
+static int
+libc_fprintf_integers(TRIO_NOARGS)
+{
+  return fprintf(nullFile, FORMAT_INTEGERS, ARGS_INTEGERS);
+}
+
+static int
+libc_fprintf_doubles(TRIO_NOARGS)
+{
+  return fprintf(nullFile, FORMAT_DOUBLES, ARGS_DOUBLES);
+}
+
+static int
+libc_fprintf_padding(TRIO_NOARGS)
+{
+  return fprintf(nullFile, FORMAT_PADDING, ARGS_PADDING);
+}
+#endif
+
+/*************************************************************************
+ * trio_dprintf and libc dprintf
+ */
+#if TRIO_FEATURE_FD && defined(TRIO_PLATFORM_UNIX)
+static int
+trio_dprintf_integers(TRIO_NOARGS)
+{
+  return trio_dprintf(nullFd, FORMAT_INTEGERS, ARGS_INTEGERS);
+}
+
+static int
+trio_dprintf_padding(TRIO_NOARGS)
+{
+  return trio_dprintf(nullFd, FORMAT_PADDING, ARGS_PADDING);
+}
+#endif
+
+#if defined(USE_LIBC_DPRINTF)
+static int
+libc_dprintf_integers(TRIO_NOARGS)
+{
+  return dprintf(nullFd, FORMAT_INTEGERS, ARGS_INTEGERS);
+}
+
+static int
+libc_dprintf_padding(TRIO_NOARGS)
+{
+  return dprintf(nullFd, FORMAT_PADDING, ARGS_PADDING);
+}
+#endif
+
+/*************************************************************************
+ * trio_sscanf and libc sscanf
+ */
+#if TRIO_FEATURE_SCANF
+static int
+trio_sscanf_numbers(TRIO_NOARGS)
+{
+  int first;
+  int second;
+  double third;
+  double fourth;
+
+  (void)trio_sscanf(scanInput, "%d %d %lf %lf", &first, &second, &third, &fourth);
+  return (int)strlen(scanInput);
+}
+
+static int
+libc_sscanf_numbers(TRIO_NOARGS)
+{
+  int first;
+  int second;
+  double third;
+  double fourth;
+
+  (void)sscanf(scanInput, "%d %d %lf %lf", &first, &second, &third, &fourth);
+  return (int)strlen(scanInput);
+}
+#endif
+
+/*************************************************************************
+ *
+ */
+static benchmark_t benchmarks[] = {
+  { trio_snprintf_integers, "integers", "trio_snprintf" },
+#if defined(USE_LIBC_SNPRINTF)
+  { libc_snprintf_integers, "integers", "snprintf" },
+#endif
+  { trio_snprintf_doubles, "doubles", "trio_snprintf" },
+#if defined(USE_LIBC_SNPRINTF)
+  { libc_snprintf_doubles, "doubles", "snprintf" },
+#endif
+  { trio_snprintf_strings, "strings", "trio_snprintf" },
+#if defined(USE_LIBC_SNPRINTF)
+  { libc_snprintf_strings, "strings", "snprintf" },
+#endif
+  { trio_snprintf_padding, "padding", "trio_snprintf" },
+#if defined(USE_LIBC_SNPRINTF)
+  { libc_snprintf_padding, "padding", "snprintf" },
+#endif
+  { trio_snprintf_positional, "positional", "trio_snprintf" },
+#if defined(USE_LIBC_SNPRINTF) && defined(TRIO_PLATFORM_UNIX)
+  { libc_snprintf_positional, "positional", "snprintf" },
+#endif
+#if TRIO_FEATURE_USER_DEFINED
+  { trio_snprintf_userdef, "userdef", "trio_snprintf" },
+#endif
+#if TRIO_FEATURE_DYNAMICSTRING
+  { trio_aprintf_integers, "integers", "trio_aprintf" },
+# if defined(USE_LIBC_ASPRINTF)
+  { libc_asprintf_integers, "integers", "asprintf" },
+# endif
+  { trio_aprintf_doubles, "doubles", "trio_aprintf" },
+# if defined(USE_LIBC_ASPRINTF)
+  { libc_asprintf_doubles, "doubles", "asprintf" },
+# endif
+  { trio_aprintf_strings, "strings", "trio_aprintf" },
+# if defined(USE_LIBC_ASPRINTF)
+  { libc_asprintf_strings, "strings", "asprintf" },
+# endif
+#endif
+#if TRIO_FEATURE_FILE && defined(NULL_DEVICE)
+  { trio_fprintf_integers, "integers", "trio_fprintf" },
+  { libc_fprintf_integers, "integers", "fprintf" },
+  { trio_fprintf_doubles, "doubles", "trio_fprintf" },
+  { libc_fprintf_doubles, "doubles", "fprintf" },
+  { trio_fprintf_padding, "padding", "trio_fprintf" },
+  { libc_fprintf_padding, "padding", "fprintf" },
+#endif
+#if TRIO_FEATURE_FD && defined(TRIO_PLATFORM_UNIX)
+  { trio_dprintf_integers, "integers", "trio_dprintf" },
+# if defined(USE_LIBC_DPRINTF)
+  { libc_dprintf_integers, "integers", "dprintf" },
+# endif
+  { trio_dprintf_padding, "padding", "trio_dprintf" },
+# if defined(USE_LIBC_DPRINTF)
+  { libc_dprintf_padding, "padding", "dprintf" },
+# endif
+#endif
+#if TRIO_FEATURE_SCANF
+  { trio_sscanf_numbers, "scan-numbers", "trio_sscanf" },
+  { libc_sscanf_numbers, "scan-numbers", "sscanf" },
+#endif
+  { NULL, NULL, NULL }
+};
+
+/*************************************************************************
+ *
+ */
+static void
+Run
+TRIO_ARGS2((benchmark, seconds),
+	   benchmark_t *benchmark,
+	   double seconds)
+{
+  clock_t start;
+  double elapsed;
+  double bytes = 0.0;
+  long calls = 0;
+  long batch = 1;
+  long i;
+
+  /* Warm up */
+  (void)benchmark->call();
+
+  start = clock();
+  do
+    {
+      for (i = 0; i < batch; i++)
+	{
+	  counter++;
+	  bytes += benchmark->call();
+	}
+      calls += batch;
+      batch *= 2;
+      elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    }
+  while (elapsed < seconds);
+
+  printf("%s\t%s\t%ld\t%.1f\t%.0f\n",
+	 benchmark->name,
+	 benchmark->function,
+	 calls,
+	 elapsed * 1.0E9 / calls,
+	 (elapsed > 0.0) ? bytes / elapsed : 0.0);
+}
+
+/*************************************************************************
+ *
+ */
+int
+main
+TRIO_ARGS2((argc, argv),
+	   int argc,
+	   char **argv)
+{
+  benchmark_t *benchmark;
+#if TRIO_FEATURE_USER_DEFINED
+  trio_pointer_t handle;
+#endif
+  double seconds = 0.2;
+  TRIO_CONST char *filter = NULL;
+
+  if (argc > 1)
+    seconds = atof(argv[1]);
+  if (argc > 2)
+    filter = argv[2];
+
+#if defined(NULL_DEVICE)
+  nullFile = fopen(NULL_DEVICE, "w");
+#endif
+#if TRIO_FEATURE_FD && defined(TRIO_PLATFORM_UNIX)
+  nullFd = open(NULL_DEVICE, O_WRONLY);
+#endif
+#if TRIO_FEATURE_USER_DEFINED
+  handle = trio_register(integer_writer, "bench");
+#endif
+
+  printf("# name\tfunction\tcalls\tns/call\tbytes/s\n");
+  for (benchmark = benchmarks; benchmark->call; benchmark++)
+    {
+      if (filter && (strstr(benchmark->name, filter) == NULL))
+	continue;
+      if ((nullFile == NULL) && (strstr(benchmark->function, "fprintf") != NULL))
+	continue;
+#if TRIO_FEATURE_FD && defined(TRIO_PLATFORM_UNIX)
+      if ((nullFd < 0) && (strstr(benchmark->function, "dprintf") != NULL))
+	continue;
+#endif
+      Run(benchmark, seconds);
+    }
+
+#if TRIO_FEATURE_USER_DEFINED
+  trio_unregister(handle);
+#endif
+  if (nullFile)
+    fclose(nullFile);
+#if TRIO_FEATURE_FD && defined(TRIO_PLATFORM_UNIX)
+  if (nullFd >= 0)
+    close(nullFd);
+#endif
+  return 0;
+}
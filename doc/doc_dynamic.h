@@ -28,4 +28,19 @@ cc ... -ltrio -lm
 
 @b DESCRIPTION
 
+A @c trio_string_t is allocated on the heap together with its content.
+
+A @c trio_buffer_t can be placed on the stack or inside another object.
+Short strings are kept in its inline storage, or in caller-provided
+storage such as an arena, and the heap is only used when the content
+outgrows it. trio_bprintf() appends formatted output to a buffer string.
+
+@verbatim
+trio_buffer_t buffer;
+trio_buffer_init(&buffer, NULL);
+trio_bprintf(&buffer, "%s=%d", name, value);
+puts(trio_buffer_get(&buffer));
+trio_buffer_destroy(&buffer);
+@endverbatim
+
 */
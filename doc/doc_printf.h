@@ -42,6 +42,10 @@ output to the standard output stream (stdout).
 @ref trio_fprintf, @ref trio_vfprintf, and @ref trio_fprintfv writes the
 output to a given output stream.
 
+Where the platform supports it, the output stream is locked for the
+duration of each call to the functions above, so that the output of one
+call is not interleaved with the output of other threads.
+
 @ref trio_dprintf, @ref trio_vdprintf, and @ref trio_dprintfv writes the
 output to a file descriptor (this includes, for example, sockets).
 
@@ -60,6 +64,20 @@ sufficient space, is returned.
 @ref trio_asprintf, @ref trio_vasprintf, and @ref trio_asprintfv allocates
 and returns an allocated string in @p buffer containing the formatted text.
 
+@ref trio_format_compile parses a format string once and returns a compiled
+format that can be passed to @ref trio_printf_compiled,
+@ref trio_fprintf_compiled, @ref trio_snprintf_compiled, and their
+va_list variants. These only fetch the arguments, so formatting the same
+format string repeatedly avoids parsing it each time. A compiled format is
+not modified by use and can be shared between threads. It must be released
+with @ref trio_format_destroy.
+
+@ref trio_format_cache_enable makes the printf functions remember parsed
+format strings by their address, so repeated calls with the same string
+literal skip the parsing. The cache is bounded, and is read without
+locks. @ref trio_format_cache_statistics reports the number of hits and
+misses.
+
 @b FORMATTING
 
 The @p format string can contain normal text and conversion indicators.
@@ -297,6 +315,19 @@ Local modifiers overrides sticky modifiers for the given specifier only.
   |0x00002a|0x2a|0x00002a|
 @endverbatim
 
+@em Shortest ( @c y ) [TRIO]
+
+Floating-point numbers are printed with the fewest significant digits that
+read back as the same number, so the precision is ignored. For @c e and
+@c f the notation is kept, and for @c g the scientific notation is only used
+if the exponent is less than -4 or greater than 16 (8 for float.) Together with the short
+modifier ( @c h ) the number is treated as a float. The modifier has no
+effect on long doubles.
+@verbatim
+  trio_printf("%yg %yg %yg\n", 0.1, 0.1 + 0.2, 1e100);
+  0.1 0.30000000000000004 1e+100
+@endverbatim
+
 @b Specifiers
 
 @em Percent ( @c % )
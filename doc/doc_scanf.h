@@ -32,6 +32,32 @@ This documentation is incomplete.
 The documentation of the scanf family in [C99] and [UNIX98] also applies
 to the trio counterparts.
 
+@ref trio_dscanf, @ref trio_vdscanf, and @ref trio_dscanfv reads the
+input from a file descriptor one character at a time.
+
+@ref trio_dbscanf, @ref trio_vdbscanf, and @ref trio_dbscanfv reads the
+input from a file descriptor through a buffer created with
+@ref trio_dbuffer_create. Characters that have been read from the file
+descriptor, but not consumed, are kept in the buffer for the next call.
+
+@ref trio_snscanf and @ref trio_vsnscanf reads at most a given number of
+characters from a string, which does not need to be zero terminated. This
+allows records inside larger buffers to be scanned in place.
+
+@ref trio_scanner_open maps a file into memory, or reads it in one go if
+mapping is not available, and @ref trio_scanner_create wraps a memory
+region. Each call to @ref trio_scanner_scan continues where the previous
+one stopped, with the string fast paths of @ref trio_sscanf, and
+@ref trio_scanner_offset and @ref trio_scanner_line tell where that is.
+@verbatim
+  trio_scanner_t *scanner = trio_scanner_open("dump.txt");
+  while (trio_scanner_scan(scanner, "%d,%[^\n]\n", &id, name) == 2)
+    ...
+  trio_printf("Stopped at line %lu\n",
+              (unsigned long)trio_scanner_line(scanner));
+  trio_scanner_destroy(scanner);
+@endverbatim
+
 @b SCANNING
 
 The scanning is controlled by the format string.
@@ -47,6 +73,20 @@ zero or more conversion modifiers, and exactly one conversion specifier.
 
 See @ref trio_printf.
 
+@em View ( @c v ) [TRIO]
+
+Only for the @c s and @c [] specifiers when scanning a string with
+@ref trio_sscanf and friends. Instead of copying the field into a
+character buffer, its location in the scanned string is stored in a
+@c trio_view_t, which holds a pointer to the first character and the
+length. The field is not terminated, and the view is only valid as long
+as the scanned string is. Other sources fail with @c TRIO_EINVAL.
+@verbatim
+  trio_view_t key, value;
+  trio_sscanf(line, "%v[^=]=%vs", &key, &value);
+  trio_printf("%.*s\n", (int)key.length, key.pointer);
+@endverbatim
+
 @b Specifiers
 
 @em Percent ( @c % )
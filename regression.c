@@ -208,6 +208,16 @@ VerifyReturnValues(TRIO_NOARGS)
       Report(__FILE__, __LINE__, expected, result);
     }
 
+  /* Literal text is truncated like any other output */
+  rc = trio_snprintf(buffer, 4, "0123456789%n", &count);
+  trio_sprintf(result, "%d %d %s", rc, count, buffer);
+  expected = string2;
+  if (!trio_equal_case(result, expected))
+    {
+      nerrors++;
+      Report(__FILE__, __LINE__, expected, result);
+    }
+
   /* The output buffer contains the empty string */
   rc = trio_snprintf(buffer, 1, "%s%n", "0123456789", &count);
   trio_sprintf(result, "%d %d %s", rc, count, buffer);
@@ -229,6 +239,92 @@ VerifyReturnValues(TRIO_NOARGS)
       Report(__FILE__, __LINE__, expected, result);
     }
 
+#if TRIO_FEATURE_FD && defined(TRIO_PLATFORM_UNIX)
+  /* Output to a file descriptor that exceeds the internal buffer */
+  {
+    int fds[2];
+    int length;
+
+    if (pipe(fds) == 0)
+      {
+	rc = trio_dprintf(fds[1], "%s%01999d", "x", 42);
+	close(fds[1]);
+	count = 0;
+	while ((length = read(fds[0], &buffer[count],
+			      sizeof(buffer) - count)) > 0)
+	  count += length;
+	close(fds[0]);
+	if ((rc != 2000) || (count != 2000) ||
+	    (buffer[0] != 'x') || (buffer[1] != '0') ||
+	    (buffer[1998] != '4') || (buffer[1999] != '2'))
+	  {
+	    nerrors++;
+	    printf("Validation failed in %s:%d\n", __FILE__, __LINE__);
+	    printf("  Expected 2000 characters\n");
+	    printf("  Got      %d (%d read)\n", rc, count);
+	  }
+      }
+  }
+#endif
+
+#if TRIO_FEATURE_COMPILE
+  /* Reuse of a compiled format */
+  {
+    trio_format_t *compiled;
+
+    compiled = trio_format_compile("%2$s=%1$d");
+    if (compiled == NULL)
+      {
+	nerrors++;
+	printf("Validation failed in %s:%d\n", __FILE__, __LINE__);
+	printf("  Expected compiled format\n");
+      }
+    else
+      {
+	trio_snprintf_compiled(buffer, sizeof(buffer), compiled, 1, "one");
+	nerrors += Verify(__FILE__, __LINE__, "one=1", "%s", buffer);
+	trio_snprintf_compiled(buffer, 4, compiled, 22, "two");
+	nerrors += Verify(__FILE__, __LINE__, "two", "%s", buffer);
+	trio_format_destroy(compiled);
+      }
+    if (trio_format_compile("%2$d") != NULL)
+      {
+	nerrors++;
+	printf("Validation failed in %s:%d\n", __FILE__, __LINE__);
+	printf("  Expected invalid format to be rejected\n");
+      }
+  }
+#endif
+
+#if TRIO_FEATURE_FORMAT_CACHE
+  /* Reuse of cached format strings */
+  if (trio_format_cache_enable(1))
+    {
+      char format[8];
+      unsigned long hits;
+      unsigned long misses;
+
+      trio_copy(format, "%d:%s");
+      trio_snprintf(buffer, sizeof(buffer), format, 1, "a");
+      trio_snprintf(buffer, sizeof(buffer), format, 2, "b");
+      nerrors += Compare(__FILE__, __LINE__, "2:b", buffer);
+      /* Same address with different contents */
+      trio_copy(format, "%s-%d");
+      trio_snprintf(buffer, sizeof(buffer), format, "c", 3);
+      nerrors += Compare(__FILE__, __LINE__, "c-3", buffer);
+      trio_format_cache_statistics(&hits, &misses);
+      if ((hits != 1) || (misses != 2))
+	{
+	  nerrors++;
+	  printf("Validation failed in %s:%d\n", __FILE__, __LINE__);
+	  printf("  Expected 1 hit and 2 misses\n");
+	  printf("  Got      %lu hits and %lu misses\n", hits, misses);
+	}
+      trio_format_cache_enable(0);
+      trio_format_cache_clear();
+    }
+#endif
+
   return nerrors;
 }
 
@@ -237,6 +333,40 @@ VerifyReturnValues(TRIO_NOARGS)
  */
 #define TEST_STRING "0123456789"
 
+/* Counts the live allocations in the context */
+static trio_pointer_t
+CountingAllocate
+TRIO_ARGS2((context, size),
+	   trio_pointer_t context,
+	   size_t size)
+{
+  ++*(int *)context;
+  return malloc(size);
+}
+
+static trio_pointer_t
+CountingReallocate
+TRIO_ARGS3((context, pointer, size),
+	   trio_pointer_t context,
+	   trio_pointer_t pointer,
+	   size_t size)
+{
+  if (pointer == NULL)
+    ++*(int *)context;
+  return realloc(pointer, size);
+}
+
+static void
+CountingDeallocate
+TRIO_ARGS2((context, pointer),
+	   trio_pointer_t context,
+	   trio_pointer_t pointer)
+{
+  if (pointer)
+    --*(int *)context;
+  free(pointer);
+}
+
 static int
 VerifyAllocate(TRIO_NOARGS)
 {
@@ -268,6 +398,99 @@ VerifyAllocate(TRIO_NOARGS)
     }
   if (string)
     free(string);
+
+  /* Allocate a string that does not fit in the initial buffer */
+  rc = trio_asprintf(&string, "%1000s|%s", "", TEST_STRING);
+  if ((rc != 1001 + test_size) || (string == NULL)
+      || (trio_length(string) != (size_t)rc)
+      || !trio_equal_case(&string[1001], TEST_STRING))
+    {
+      nerrors++;
+      printf("Validation failed in %s:%d\n", __FILE__, __LINE__);
+      printf("  Got rc = %d\n", rc);
+    }
+  if (string)
+    free(string);
+
+  /* Allocate with a caller-supplied allocator */
+  {
+    trio_allocator_t allocator;
+# if TRIO_FEATURE_COMPILE
+    trio_format_t *compiled;
+# endif
+    int live = 0;
+
+    allocator.allocate = CountingAllocate;
+    allocator.reallocate = CountingReallocate;
+    allocator.deallocate = CountingDeallocate;
+    allocator.context = &live;
+
+    rc = trio_asprintf_a(&allocator, &string, "%s", TEST_STRING);
+    nerrors += Verify(__FILE__, __LINE__, "1", "%d",
+		      (rc == test_size) && (live == 1));
+    CountingDeallocate(&live, string);
+
+    trio_set_allocator(&allocator);
+    /* The string functions use the installed allocator too */
+    {
+      trio_buffer_t buffer;
+      char *copy;
+
+      copy = trio_duplicate(TEST_STRING);
+      trio_buffer_init(&buffer, NULL);
+      (void)trio_buffer_reserve(&buffer, 1000);
+      nerrors += Verify(__FILE__, __LINE__, "2", "%d", live);
+      trio_buffer_destroy(&buffer);
+      trio_destroy(copy);
+      nerrors += Verify(__FILE__, __LINE__, "0", "%d", live);
+    }
+    rc = trio_asprintf(&string, "%1000s", "");
+# if TRIO_FEATURE_COMPILE
+    compiled = trio_format_compile("%d");
+    nerrors += Verify(__FILE__, __LINE__, "3", "%d", live);
+# endif
+    trio_set_allocator(NULL);
+# if TRIO_FEATURE_COMPILE
+    trio_format_destroy(compiled);
+# endif
+    nerrors += Verify(__FILE__, __LINE__, "1", "%d", (rc == 1000) && (live == 1));
+    CountingDeallocate(&live, string);
+    nerrors += Verify(__FILE__, __LINE__, "0", "%d", live);
+
+# if TRIO_FEATURE_FORMAT_CACHE
+    /* Cached formats do not belong to the allocator installed at the time */
+    if (trio_format_cache_enable(1))
+      {
+	char output[8];
+
+	trio_set_allocator(&allocator);
+	rc = trio_snprintf(output, sizeof(output), "%d|%d", 1, 2);
+	trio_set_allocator(NULL);
+	nerrors += Verify(__FILE__, __LINE__, "3 0", "%d %d", rc, live);
+	trio_format_cache_enable(0);
+	trio_format_cache_clear();
+	nerrors += Verify(__FILE__, __LINE__, "0", "%d", live);
+      }
+# endif
+  }
+
+  /* Append to a buffer string */
+  {
+    trio_buffer_t buffer;
+
+    trio_buffer_init(&buffer, NULL);
+    rc = trio_bprintf(&buffer, "%s", TEST_STRING);
+    rc += trio_bprintf(&buffer, "|%d", 42);
+    nerrors += Verify(__FILE__, __LINE__, TEST_STRING "|42 13 inline", "%s %d %s",
+		      trio_buffer_get(&buffer), rc,
+		      (buffer.content == buffer.inline_storage) ? "inline" : "heap");
+    rc = trio_bprintf(&buffer, "%100s", "");
+    string = trio_buffer_extract(&buffer);
+    nerrors += Verify(__FILE__, __LINE__, "113 100 0", "%d %d %d",
+		      (int)trio_length(string), rc, (int)trio_buffer_length(&buffer));
+    free(string);
+    trio_buffer_destroy(&buffer);
+  }
 #endif
 
   return nerrors;
@@ -287,6 +510,12 @@ VerifyFormattingStrings(TRIO_NOARGS)
   /* String */
   nerrors += Verify(__FILE__, __LINE__, "Hello world",
 		   "%s", "Hello world");
+  /* String with escapes */
+  nerrors += Verify(__FILE__, __LINE__, "Hello\\tworld\\n",
+		   "%#s", "Hello\tworld\n");
+  /* Literal text around a percent sign */
+  nerrors += Verify(__FILE__, __LINE__, "100% Hello world",
+		   "100%% %s world", "Hello");
 
   return nerrors;
 }
@@ -309,11 +538,20 @@ VerifyFormattingIntegers(TRIO_NOARGS)
 		   "Number %ld", 42L);
   nerrors += Verify(__FILE__, __LINE__, "Number -42",
 		   "Number %ld", -42L);
+  nerrors += Verify(__FILE__, __LINE__, "0 7 10 99 100 1234567 -2147483647",
+		   "%d %d %d %d %d %d %d", 0, 7, 10, 99, 100, 1234567, -2147483647);
   /* Integer width */
   nerrors += Verify(__FILE__, __LINE__, "  1234",
 		    "%6d", 1234);
   nerrors += Verify(__FILE__, __LINE__, "  1234",
 		    "%*d", 6, 1234);
+  /* Integer width wider than the padding block */
+  nerrors += Verify(__FILE__, __LINE__,
+		    "-00000000000000000000000000000000000000000000000000000000000000000000000000000001",
+		    "%.80d", -1);
+  nerrors += Verify(__FILE__, __LINE__,
+		    "                                                                                1|",
+		    "%81d|", 1);
   /* Integer width overrun */
   nerrors += Verify(__FILE__, __LINE__, "123456",
 		    "%4d", 123456);
@@ -644,6 +882,15 @@ VerifyFormattingFloats(TRIO_NOARGS)
 		    "%f", trio_nan());
   nerrors += Verify(__FILE__, __LINE__, "NAN",
 		    "%F", trio_nan());
+  /* Correctly rounded digits */
+  nerrors += Verify(__FILE__, __LINE__, "0.10000000000000001",
+		    "%.17g", 0.1);
+  nerrors += Verify(__FILE__, __LINE__, "2.67 0.2 2 4",
+		    "%.2f %.1f %.0f %.0f", 2.675, 0.25, 2.5, 3.5);
+  nerrors += Verify(__FILE__, __LINE__, "10000000000000000000000.000000",
+		    "%f", 1e22);
+  nerrors += Verify(__FILE__, __LINE__, "4.94065645841246544e-324",
+		    "%.17e", 4.9406564584124654e-324);
 
 # if TRIO_FEATURE_HEXFLOAT
   nerrors += Verify(__FILE__, __LINE__, "0x2.ap+4",
@@ -688,6 +935,16 @@ static int number_writer(void *ref)
   return 0;
 }
 
+static void *removing_handle;
+
+static int removing_writer(void *ref)
+{
+  /* Unregister while the formatting still refers to the entry */
+  trio_unregister(removing_handle);
+  trio_print_pointer(ref, NULL);
+  return 0;
+}
+
 #endif
 
 static int
@@ -696,7 +953,12 @@ VerifyFormattingUserDefined(TRIO_NOARGS)
   int nerrors = 0;
 #if TRIO_EXTENSION
   void *number_handle;
+  void *extra_handles[100];
+  trio_allocator_t allocator;
+  int live = 0;
+  char name[16];
   int integer = 123;
+  int i;
 
   number_handle = trio_register(number_writer, "number");
 
@@ -714,6 +976,42 @@ VerifyFormattingUserDefined(TRIO_NOARGS)
   nerrors += Verify(__FILE__, __LINE__, "$integer|123>",
 		    "$integer|%d>", 123);
 
+  /* Namespaces are unique */
+  nerrors += Verify(__FILE__, __LINE__, "1",
+		    "%d", trio_register(number_writer, "number") == NULL);
+
+  /* Many namespaces sharing the hash buckets */
+  for (i = 0; i < (int)(sizeof(extra_handles) / sizeof(extra_handles[0])); i++)
+    {
+      trio_snprintf(name, sizeof(name), "extra%d", i);
+      extra_handles[i] = trio_register(number_writer, name);
+    }
+  nerrors += Verify(__FILE__, __LINE__, "123 123",
+		    "%<extra99:integer> %<number:integer>", &integer, &integer);
+  for (i = 0; i < (int)(sizeof(extra_handles) / sizeof(extra_handles[0])); i += 2)
+    trio_unregister(extra_handles[i]);
+  nerrors += Verify(__FILE__, __LINE__, "123 123",
+		    "%<extra1:integer> %<number:integer>", &integer, &integer);
+  for (i = 1; i < (int)(sizeof(extra_handles) / sizeof(extra_handles[0])); i += 2)
+    trio_unregister(extra_handles[i]);
+
+  /* Unregister from within a lookup by name */
+  removing_handle = trio_register(removing_writer, "removing");
+  nerrors += Verify(__FILE__, __LINE__, "(nil)|",
+		    "%<removing:>|%<removing:>");
+
+  /* The entry is released when the lookup ends */
+  allocator.allocate = CountingAllocate;
+  allocator.reallocate = CountingReallocate;
+  allocator.deallocate = CountingDeallocate;
+  allocator.context = &live;
+  trio_set_allocator(&allocator);
+  removing_handle = trio_register(removing_writer, "removing");
+  trio_set_allocator(NULL);
+  nerrors += Verify(__FILE__, __LINE__, "1", "%d", live);
+  nerrors += Verify(__FILE__, __LINE__, "(nil)", "%<removing:>");
+  nerrors += Verify(__FILE__, __LINE__, "0", "%d", live);
+
   trio_unregister(number_handle);
 #endif
 
@@ -907,6 +1205,8 @@ VerifyFormatting(TRIO_NOARGS)
 		    "NonPrintable %#s", "\01 \07 \\");
   nerrors += Verify(__FILE__, __LINE__, "\\a \\b \\t \\n \\v \\f \\r",
 		    "%#s", "\007 \010 \011 \012 \013 \014 \015");
+  nerrors += Verify(__FILE__, __LINE__, "abcdefghijklmnop\\x7f\\x1fqrstuvwxyz0123456\\\\789|\\xff",
+		    "%#s|%#c", "abcdefghijklmnop\177\037qrstuvwxyz0123456\\789", 0xFF);
   /* Quote flag */
   nerrors += Verify(__FILE__, __LINE__, "Another \"quoted\" string",
 		   "Another %'s string", "quoted");
@@ -946,6 +1246,19 @@ VerifyFormatting(TRIO_NOARGS)
 		    "%.30RLf", 1.4L);
 #  endif
 # endif
+# if TRIO_FEATURE_SHORTEST
+  /* Shortest modifier */
+  nerrors += Verify(__FILE__, __LINE__, "0.1 0.3 1e+17 1e-05",
+		    "%yg %yg %yg %yg", 0.1, 0.3, 1e17, 1e-5);
+  nerrors += Verify(__FILE__, __LINE__, "0.30000000000000004",
+		    "%yg", 0.1 + 0.2);
+  nerrors += Verify(__FILE__, __LINE__, "1.7976931348623157e+308",
+		    "%yg", DBL_MAX);
+  nerrors += Verify(__FILE__, __LINE__, "5e-324 1.25E+02 1e+22",
+		    "%ye %yE %ye", 4.9406564584124654e-324, 125.0, 1e22);
+  nerrors += Verify(__FILE__, __LINE__, "0.001|   -12.5|+100.|0.1",
+		    "%yf|%8yf|%+#yf|%yhf", 0.001, -12.5, 100.0, 0.1);
+# endif
 #endif
 
 #if defined(TRIO_BREESE)
@@ -1140,6 +1453,10 @@ static int
 VerifyScanningIntegers(TRIO_NOARGS)
 {
   int nerrors = 0;
+#if TRIO_FEATURE_INTMAX_T && defined(TRIO_COMPILER_SUPPORTS_LL)
+  long long number;
+  unsigned long long unumber;
+#endif
 
   nerrors += VerifyScanningOneInteger(__FILE__, __LINE__, "42",
 				      "%i", 42);
@@ -1162,6 +1479,38 @@ VerifyScanningIntegers(TRIO_NOARGS)
   nerrors += VerifyScanningOneInteger(__FILE__, __LINE__, "052",
 				      "%#o", 42);
 
+#if TRIO_FEATURE_INTMAX_T && defined(TRIO_COMPILER_SUPPORTS_LL)
+  /* Out-of-range numbers are clamped and set ERANGE */
+  errno = 0;
+  trio_sscanf("9223372036854775807", "%lld", &number);
+  nerrors += Verify(__FILE__, __LINE__, "9223372036854775807 0",
+		    "%lld %d", number, errno);
+  errno = 0;
+  trio_sscanf("9223372036854775808", "%lld", &number);
+  nerrors += Verify(__FILE__, __LINE__, "9223372036854775807 1",
+		    "%lld %d", number, errno == ERANGE);
+  errno = 0;
+  trio_sscanf("-9223372036854775808", "%lld", &number);
+  nerrors += Verify(__FILE__, __LINE__, "-9223372036854775808 0",
+		    "%lld %d", number, errno);
+  errno = 0;
+  trio_sscanf("-9223372036854775809", "%lld", &number);
+  nerrors += Verify(__FILE__, __LINE__, "-9223372036854775808 1",
+		    "%lld %d", number, errno == ERANGE);
+  errno = 0;
+  trio_sscanf("18446744073709551616", "%llu", &unumber);
+  nerrors += Verify(__FILE__, __LINE__, "18446744073709551615 1",
+		    "%llu %d", unumber, errno == ERANGE);
+  errno = 0;
+  trio_sscanf("123456789abcdef01", "%llx", &unumber);
+  nerrors += Verify(__FILE__, __LINE__, "ffffffffffffffff 1",
+		    "%llx %d", unumber, errno == ERANGE);
+  errno = 0;
+  trio_sscanf("fedcba9876543210", "%llx", &unumber);
+  nerrors += Verify(__FILE__, __LINE__, "fedcba9876543210 0",
+		    "%llx %d", unumber, errno);
+#endif
+
   return nerrors;
 }
 #endif
@@ -1290,6 +1639,13 @@ VerifyScanningStrings(TRIO_NOARGS)
   char string2[] = "hello";
   char string3[] = "hello world";
   char string4[] = "abcba";
+  char string5[] = "\xe9t\xe9";
+#if TRIO_FEATURE_VIEW
+  char string6[] = "  name=value rest";
+  trio_view_t key;
+  trio_view_t value;
+  int rc;
+#endif
 
   nerrors += VerifyScanningOneString(__FILE__, __LINE__, "",
 				     "hello", string2);
@@ -1316,9 +1672,89 @@ VerifyScanningStrings(TRIO_NOARGS)
 #if TRIO_EXTENSION
   nerrors += VerifyScanningOneString(__FILE__, __LINE__, "abcba",
 				     "%[[:alpha:]]", string4);
+  nerrors += Verify(__FILE__, __LINE__, "0",
+		    "%d", trio_scan_warmup());
+  nerrors += VerifyScanningOneString(__FILE__, __LINE__, "ab",
+				     "%[[=a=]b]", string4);
 #endif
   nerrors += VerifyScanningOneString(__FILE__, __LINE__, "ba",
 				     "%*[ab]c%[^\n]", string4);
+  nerrors += VerifyScanningOneString(__FILE__, __LINE__, "hello",
+				     "%[^ ]", string3);
+  nerrors += VerifyScanningOneString(__FILE__, __LINE__, "hel",
+				     "%3[^ ]", string3);
+  nerrors += VerifyScanningOneString(__FILE__, __LINE__, "world",
+				     "%*[^ ] %[^\n]", string3);
+  nerrors += VerifyScanningOneString(__FILE__, __LINE__, "\xe9",
+				     "%[\xe9]", string5);
+
+#if TRIO_FEATURE_VIEW
+  rc = trio_sscanf(string6, " %v[^=]=%vs", &key, &value);
+  nerrors += Verify(__FILE__, __LINE__, "2 [name] [value] 1",
+		    "%d [%.*s] [%.*s] %d", rc,
+		    (int)key.length, key.pointer,
+		    (int)value.length, value.pointer,
+		    key.pointer == &string6[2]);
+  rc = trio_sscanf(string6, "%*v[^=]=%3vs", &value);
+  nerrors += Verify(__FILE__, __LINE__, "1 [val]",
+		    "%d [%.*s]", rc, (int)value.length, value.pointer);
+  rc = trio_sscanf(string6, "%v[0-9]", &key);
+  nerrors += Verify(__FILE__, __LINE__, "0", "%d", rc);
+  nerrors += Verify(__FILE__, __LINE__, "1",
+		    "%d", trio_sscanf(string6, "%vd", &key) < 0);
+#endif
+
+  return nerrors;
+}
+#endif
+
+/*************************************************************************
+ *
+ */
+#if TRIO_FEATURE_SCANF
+static int
+VerifyScanningBounded(TRIO_NOARGS)
+{
+  int nerrors = 0;
+  int rc;
+  int number;
+  char first[32];
+  char second[32];
+#if TRIO_FEATURE_FLOAT
+  double dnumber;
+#endif
+#if TRIO_FEATURE_VIEW
+  trio_view_t key;
+  trio_view_t value;
+#endif
+
+  rc = trio_snscanf("123456", 3, "%d", &number);
+  nerrors += Verify(__FILE__, __LINE__, "1 123", "%d %d", rc, number);
+  rc = trio_snscanf("abcdef", 4, "%s", first);
+  nerrors += Verify(__FILE__, __LINE__, "1 abcd", "%d %s", rc, first);
+  rc = trio_snscanf("ab,cd", 4, "%[^,],%s", first, second);
+  nerrors += Verify(__FILE__, __LINE__, "2 ab c", "%d %s %s", rc, first, second);
+  rc = trio_snscanf("12 34", 2, "%d %d", &number, &number);
+  nerrors += Verify(__FILE__, __LINE__, "1 12", "%d %d", rc, number);
+  rc = trio_snscanf("12", 0, "%d", &number);
+  nerrors += Verify(__FILE__, __LINE__, "-1", "%d", rc);
+  rc = trio_snscanf("12                    34", 20, "%d %d", &number, &number);
+  nerrors += Verify(__FILE__, __LINE__, "1 12", "%d %d", rc, number);
+  rc = trio_snscanf("12                    34", 23, "%d %d", &number, &number);
+  nerrors += Verify(__FILE__, __LINE__, "2 3", "%d %d", rc, number);
+  rc = trio_snscanf("  12", 32, "%d", &number);
+  nerrors += Verify(__FILE__, __LINE__, "1 12", "%d %d", rc, number);
+#if TRIO_FEATURE_FLOAT
+  rc = trio_snscanf("1.2345", 3, "%lf", &dnumber);
+  nerrors += Verify(__FILE__, __LINE__, "1 1.2", "%d %g", rc, dnumber);
+#endif
+#if TRIO_FEATURE_VIEW
+  rc = trio_snscanf("key=value", 6, "%v[^=]=%vs", &key, &value);
+  nerrors += Verify(__FILE__, __LINE__, "2 [key] [va]",
+		    "%d [%.*s] [%.*s]", rc,
+		    (int)key.length, key.pointer,
+		    (int)value.length, value.pointer);
+#endif
 
   return nerrors;
 }
@@ -1350,10 +1786,26 @@ VerifyScanningRegression(TRIO_NOARGS)
   rc = trio_sscanf("1.5", "%lf%n", &dnumber, &offset);
   nerrors += Verify(__FILE__, __LINE__, "1 3 1.500000",
 		    "%d %d %f", rc, offset, dnumber);
+  rc = trio_sscanf("33d8", "%lf%n", &dnumber, &offset);
+  nerrors += Verify(__FILE__, __LINE__, "1 2 33",
+		    "%d %d %g", rc, offset, dnumber);
+  rc = trio_sscanf("7d+3x", "%lf%c", &dnumber, &ch);
+  nerrors += Verify(__FILE__, __LINE__, "2 7 d",
+		    "%d %g %c", rc, dnumber, ch);
+  rc = trio_sscanf("1.5D2", "%lf", &dnumber);
+  nerrors += Verify(__FILE__, __LINE__, "1 1.5",
+		    "%d %g", rc, dnumber);
+  rc = trio_sscanf("65d5", "%4lf", &dnumber);
+  nerrors += Verify(__FILE__, __LINE__, "1 65",
+		    "%d %g", rc, dnumber);
 #endif
   rc = trio_sscanf("q 123", "%c%ld", &ch, &lnumber);
   nerrors += Verify(__FILE__, __LINE__, "q 123",
 		    "%c %ld", ch, lnumber);
+  rc = trio_sscanf("  \t\n 12\v\f\r                      34", "%d%ld",
+		   &number, &lnumber);
+  nerrors += Verify(__FILE__, __LINE__, "2 12 34",
+		    "%d %d %ld", rc, number, lnumber);
   rc = trio_sscanf("abc", "%*s%n", &number);
   nerrors += Verify(__FILE__, __LINE__, "0 3",
 		    "%d %d", rc, number);
@@ -1378,6 +1830,18 @@ VerifyScanningRegression(TRIO_NOARGS)
 # endif
 #endif
 #if TRIO_FEATURE_FLOAT
+  rc = trio_sscanf("2.2250738585072011e-308", "%lf", &dnumber);
+  nerrors += Verify(__FILE__, __LINE__, "1 1",
+		    "%d %d", rc, (dnumber == 2.2250738585072011e-308));
+  rc = trio_sscanf("1.5 2", "%*f %d", &number);
+  nerrors += Verify(__FILE__, __LINE__, "1 2",
+		    "%d %d", rc, number);
+  rc = trio_sscanf("1.5e+x", "%lf%c", &dnumber, &ch);
+  nerrors += Verify(__FILE__, __LINE__, "2 1.5 x",
+		    "%d %g %c", rc, dnumber, ch);
+  rc = trio_sscanf("12.5", "%2lf%c", &dnumber, &ch);
+  nerrors += Verify(__FILE__, __LINE__, "2 12 5",
+		    "%d %g %c", rc, dnumber, ch);
   rc = trio_sscanf("1.e-6", "%lg", &dnumber);
   nerrors += Verify(__FILE__, __LINE__, "1e-06",
 		    "%g", dnumber);
@@ -1403,6 +1867,20 @@ VerifyScanningRegression(TRIO_NOARGS)
   nerrors += Verify(__FILE__, __LINE__, buffer,
 		    "%d %u", rc, number);
 
+  /* Digit runs of scanned strings, with width and trailing character */
+  rc = trio_sscanf("123456789x", "%d%c", &number, &ch);
+  nerrors += Verify(__FILE__, __LINE__, "2 123456789 x",
+		    "%d %d %c", rc, number, ch);
+  rc = trio_sscanf("1234567890123", "%9d%ld", &number, &lnumber);
+  nerrors += Verify(__FILE__, __LINE__, "2 123456789 123",
+		    "%d %d %ld", rc, number, lnumber);
+  rc = trio_sscanf("0000000000000000000042", "%d", &number);
+  nerrors += Verify(__FILE__, __LINE__, "1 42",
+		    "%d %d", rc, number);
+  rc = trio_sscanf("0x7fffBEEF!", "%#x%c", &number, &ch);
+  nerrors += Verify(__FILE__, __LINE__, "2 7fffbeef !",
+		    "%d %x %c", rc, number, ch);
+
   /* A scangroup match failure should not bind its argument,
    * i.e., it shouldn't match the empty string. */
   sprintf(buffer, "SPQR");
@@ -1438,6 +1916,104 @@ VerifyScanningRegression(TRIO_NOARGS)
 		    "%c", ch);
   fclose(stream);
 
+#if TRIO_FEATURE_FD && defined(TRIO_PLATFORM_UNIX)
+  /* Unread characters are kept for the next scan of a buffered descriptor */
+  {
+    int fds[2];
+    char storage[4];
+    int second;
+    trio_dbuffer_t *dbuffer;
+
+    if (pipe(fds) == 0)
+      {
+	trio_dprintf(fds[1], "123 45 6789");
+	close(fds[1]);
+	dbuffer = trio_dbuffer_create(fds[0], storage, sizeof(storage));
+	rc = trio_dbscanf(dbuffer, "%d", &number);
+	nerrors += Verify(__FILE__, __LINE__, "1 123",
+			  "%d %d", rc, number);
+	rc = trio_dbscanf(dbuffer, "%d %d", &number, &second);
+	nerrors += Verify(__FILE__, __LINE__, "2 45 6789",
+			  "%d %d %d", rc, number, second);
+	trio_dbuffer_destroy(dbuffer);
+	close(fds[0]);
+      }
+  }
+#endif
+
+#if TRIO_FEATURE_SCANNER
+  /* Each scan of a scanner continues where the previous one stopped */
+  {
+    static TRIO_CONST char records[] = "12 ab\n34 cd\n56";
+    trio_scanner_t *scanner;
+    char word[8];
+    int second;
+
+    scanner = trio_scanner_create(records, sizeof(records) - 1);
+    rc = trio_scanner_scan(scanner, "%d %s", &number, word);
+    nerrors += Verify(__FILE__, __LINE__, "2 12 ab 5 1",
+		      "%d %d %s %lu %lu", rc, number, word,
+		      (unsigned long)trio_scanner_offset(scanner),
+		      (unsigned long)trio_scanner_line(scanner));
+    rc = trio_scanner_scan(scanner, "%d %s", &number, word);
+    nerrors += Verify(__FILE__, __LINE__, "2 34 cd 11 2",
+		      "%d %d %s %lu %lu", rc, number, word,
+		      (unsigned long)trio_scanner_offset(scanner),
+		      (unsigned long)trio_scanner_line(scanner));
+    rc = trio_scanner_scan(scanner, "%d", &number);
+    nerrors += Verify(__FILE__, __LINE__, "1 56 14 3",
+		      "%d %d %lu %lu", rc, number,
+		      (unsigned long)trio_scanner_offset(scanner),
+		      (unsigned long)trio_scanner_line(scanner));
+    rc = trio_scanner_scan(scanner, "%d", &number);
+    nerrors += Verify(__FILE__, __LINE__, "-1", "%d", rc);
+    trio_scanner_destroy(scanner);
+
+    stream = fopen("regression.tmp", "wb");
+    if (stream)
+      {
+	trio_fprintf(stream, "7 8\n9");
+	fclose(stream);
+	scanner = trio_scanner_open("regression.tmp");
+	rc = trio_scanner_scan(scanner, "%d %d", &number, &second);
+	nerrors += Verify(__FILE__, __LINE__, "2 7 8",
+			  "%d %d %d", rc, number, second);
+	rc = trio_scanner_scan(scanner, "%d", &number);
+	nerrors += Verify(__FILE__, __LINE__, "1 9 2",
+			  "%d %d %lu", rc, number,
+			  (unsigned long)trio_scanner_line(scanner));
+	trio_scanner_destroy(scanner);
+	remove("regression.tmp");
+      }
+    nerrors += Verify(__FILE__, __LINE__, "1",
+		      "%d", trio_scanner_open("regression.tmp") == NULL);
+
+# if TRIO_FEATURE_FD && defined(TRIO_PLATFORM_UNIX)
+    /* Pipes cannot be mapped and have no size, so they are read */
+    {
+      int fds[2];
+      char path[32];
+
+      if (pipe(fds) == 0)
+	{
+	  trio_dprintf(fds[1], "%d %d", 10, 20);
+	  close(fds[1]);
+	  trio_snprintf(path, sizeof(path), "/dev/fd/%d", fds[0]);
+	  scanner = trio_scanner_open(path);
+	  if (scanner)
+	    {
+	      rc = trio_scanner_scan(scanner, "%d %d", &number, &second);
+	      nerrors += Verify(__FILE__, __LINE__, "2 10 20",
+				"%d %d %d", rc, number, second);
+	      trio_scanner_destroy(scanner);
+	    }
+	  close(fds[0]);
+	}
+    }
+# endif
+  }
+#endif
+
   return nerrors;
 }
 #endif
@@ -1453,6 +2029,7 @@ VerifyScanning(TRIO_NOARGS)
   nerrors += VerifyScanningIntegers();
   nerrors += VerifyScanningFloats();
   nerrors += VerifyScanningStrings();
+  nerrors += VerifyScanningBounded();
   nerrors += VerifyScanningRegression();
 #endif
   return nerrors;
@@ -1577,6 +2154,29 @@ VerifyStrings(TRIO_NOARGS)
     nerrors++;
     Report0(__FILE__, __LINE__);
   }
+
+  /* Correct rounding, including ties, subnormals and overflow */
+  if ((trio_to_double("0.1", NULL) != 0.1) ||
+      (trio_to_double("9007199254740993", NULL) != 9007199254740992.0) ||
+      (trio_to_double("2.2250738585072011e-308", NULL)
+       != 2.2250738585072011e-308) ||
+      (trio_to_double("4.9406564584124654e-324", NULL)
+       != 4.9406564584124654e-324) ||
+      (trio_to_double("-1e400", NULL) > -1e308)) {
+    nerrors++;
+    Report0(__FILE__, __LINE__);
+  }
+  if ((trio_to_float("1.000000059604644775390625", NULL) != 1.0F) ||
+      (trio_to_float("1.000000059604644775390626", NULL)
+       != 1.00000011920928955078125F)) {
+    nerrors++;
+    Report0(__FILE__, __LINE__);
+  }
+  trio_copy(buffer, "1.5e+x");
+  if ((trio_to_double(buffer, &end) != 1.5) || (end != &buffer[3])) {
+    nerrors++;
+    Report0(__FILE__, __LINE__);
+  }
 #endif
 
   /* Long conversion */
@@ -1665,6 +2265,58 @@ VerifyNaN(TRIO_NOARGS)
   return nerrors;
 }
 
+/*************************************************************************
+ *
+ */
+static int
+VerifyLocales(TRIO_NOARGS)
+{
+  int nerrors = 0;
+#if TRIO_FEATURE_LOCALE && TRIO_EXTENSION
+  char buffer[256];
+  int number;
+  trio_locale_t *locale;
+  TRIO_CONST trio_locale_t *previous;
+
+  locale = trio_locale_create(",", ".", "\3");
+  if (locale == NULL)
+    {
+      nerrors++;
+      Report0(__FILE__, __LINE__);
+      return nerrors;
+    }
+
+  /* Explicit locale */
+  trio_snprintf_l(buffer, sizeof(buffer), locale, "%'d", 1234567);
+  nerrors += Verify(__FILE__, __LINE__, "1.234.567",
+		    "%s", buffer);
+# if TRIO_FEATURE_FLOAT
+  trio_snprintf_l(buffer, sizeof(buffer), locale, "%.2f", 3.5);
+  nerrors += Verify(__FILE__, __LINE__, "3,50",
+		    "%s", buffer);
+# endif
+  /* The default locale is not affected */
+  nerrors += Verify(__FILE__, __LINE__, "1,234,567",
+		    "%'d", 1234567);
+
+  /* Locale attached to the thread */
+  previous = trio_locale_use(locale);
+  trio_snprintf(buffer, sizeof(buffer), "%'d", 1234567);
+  trio_locale_use(previous);
+  nerrors += Verify(__FILE__, __LINE__, "1.234.567 1,234,567",
+		    "%s %'d", buffer, 1234567);
+
+  number = 0;
+  trio_sscanf_l("42", locale, "%d", &number);
+  nerrors += Verify(__FILE__, __LINE__, "42",
+		    "%d", number);
+
+  trio_locale_destroy(locale);
+#endif
+
+  return nerrors;
+}
+
 /*************************************************************************
  *
  */
@@ -1699,6 +2351,9 @@ main(TRIO_NOARGS)
   printf("Verifying scanning\n");
   nerrors += VerifyScanning();
 
+  printf("Verifying locales\n");
+  nerrors += VerifyLocales();
+
   printf("Verifying return values\n");
   nerrors += VerifyErrors();
   nerrors += VerifyReturnValues();
@@ -65,12 +65,10 @@
 # define TRIO_FUNC_LENGTH
 # define TRIO_FUNC_LENGTH_MAX
 # define TRIO_FUNC_TO_LONG
-# if TRIO_FEATURE_LOCALE
+# define TRIO_FUNC_STRING_SET_ALLOCATOR
+# if TRIO_FEATURE_LOCALE || TRIO_FEATURE_USER_DEFINED
 #  define TRIO_FUNC_COPY_MAX
 # endif
-# if TRIO_FEATURE_DYNAMICSTRING
-#  define TRIO_FUNC_XSTRING_DUPLICATE
-# endif
 # if TRIO_EXTENSION && TRIO_FEATURE_SCANF
 #  define TRIO_FUNC_EQUAL_LOCALE
 # endif
@@ -80,25 +78,16 @@
 # if TRIO_FEATURE_FLOAT && TRIO_FEATURE_SCANF
 #  define TRIO_FUNC_TO_DOUBLE
 # endif
-# if TRIO_FEATURE_DYNAMICSTRING
-#  define TRIO_FUNC_STRING_EXTRACT
-# endif
-# if TRIO_FEATURE_DYNAMICSTRING
-#  define TRIO_FUNC_STRING_TERMINATE
-# endif
-# if TRIO_FEATURE_USER_DEFINED
-#  define TRIO_FUNC_DUPLICATE
-# endif
-# if TRIO_FEATURE_DYNAMICSTRING
-#  define TRIO_FUNC_STRING_DESTROY
-# endif
-# if TRIO_FEATURE_USER_DEFINED
-#  define TRIO_FUNC_DESTROY
-# endif
 # if TRIO_FEATURE_USER_DEFINED || (TRIO_FEATURE_FLOAT && TRIO_FEATURE_SCANF)
 #  define TRIO_FUNC_EQUAL
 # endif
-# if TRIO_FEATURE_USER_DEFINED || TRIO_FEATURE_SCANF
+# if TRIO_FEATURE_DYNAMICSTRING
+#  define TRIO_FUNC_BUFFER_INIT_STORAGE
+#  define TRIO_FUNC_BUFFER_RESERVE
+#  define TRIO_FUNC_BUFFER_EXTRACT
+#  define TRIO_FUNC_BUFFER_DESTROY
+# endif
+# if TRIO_FEATURE_USER_DEFINED || TRIO_FEATURE_SCANF || TRIO_FEATURE_FORMAT_CACHE
 #  define TRIO_FUNC_EQUAL_CASE
 # endif
 # if (TRIO_EXTENSION && TRIO_FEATURE_SCANF)
@@ -107,9 +96,6 @@
 # if TRIO_FEATURE_SCANF
 #  define TRIO_FUNC_TO_UPPER
 # endif
-# if TRIO_FEATURE_DYNAMICSTRING
-#  define TRIO_FUNC_XSTRING_APPEND_CHAR
-# endif
 #endif
 #include "triostr.h"
 
@@ -236,7 +222,65 @@ typedef unsigned long trio_flags_t;
 # if !defined(TRIO_FEATURE_LOCALE)
 #  define USE_LOCALE
 # endif
+# if defined(HAVE_WRITEV) && defined(HAVE_SYS_UIO_H)
+#  include <sys/uio.h>
+#  define USE_WRITEV
+# endif
+# if defined(HAVE_MMAP) && defined(HAVE_MUNMAP) && defined(HAVE_SYS_MMAN_H)
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  define USE_MMAP
+# endif
 #endif /* TRIO_PLATFORM_UNIX */
+#if defined(HAVE_FLOCKFILE) && defined(HAVE_FUNLOCKFILE) && !defined(__STRICT_ANSI__)
+/* Lock the stream once per call and use the unlocked stdio functions */
+# define USE_FLOCKFILE
+# if defined(HAVE_PUTC_UNLOCKED) || defined(putc_unlocked)
+#  define USE_PUTC_UNLOCKED
+# endif
+# if defined(HAVE_FWRITE_UNLOCKED) || defined(fwrite_unlocked)
+#  define USE_FWRITE_UNLOCKED
+# endif
+#endif
+/* Shared tables are published without locks */
+#if defined(__ATOMIC_ACQUIRE)
+# define USE_ATOMICS
+# define TRIO_ATOMIC_LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+# define TRIO_ATOMIC_INCREMENT(x) ((void)__atomic_fetch_add(&(x), 1, __ATOMIC_RELAXED))
+# define TRIO_ATOMIC_SWAP_NULL(x, y) __sync_bool_compare_and_swap(&(x), NULL, (y))
+# define TRIO_ATOMIC_STORE(x, y) __atomic_store_n(&(x), (y), __ATOMIC_RELEASE)
+# define TRIO_ATOMIC_ADD(x, y) __atomic_add_fetch(&(x), (y), __ATOMIC_SEQ_CST)
+#elif defined(TRIO_COMPILER_GCC)
+# define USE_ATOMICS
+# define TRIO_ATOMIC_LOAD(x) __sync_fetch_and_add(&(x), 0)
+# define TRIO_ATOMIC_INCREMENT(x) ((void)__sync_fetch_and_add(&(x), 1))
+# define TRIO_ATOMIC_SWAP_NULL(x, y) __sync_bool_compare_and_swap(&(x), NULL, (y))
+# define TRIO_ATOMIC_STORE(x, y) (__sync_synchronize(), (void)((x) = (y)))
+# define TRIO_ATOMIC_ADD(x, y) __sync_add_and_fetch(&(x), (y))
+#else
+/* Not thread-safe */
+# define TRIO_ATOMIC_LOAD(x) (x)
+# define TRIO_ATOMIC_INCREMENT(x) ((void)(x)++)
+# define TRIO_ATOMIC_SWAP_NULL(x, y) (((x) == NULL) ? ((x) = (y), TRUE) : FALSE)
+# define TRIO_ATOMIC_STORE(x, y) ((void)((x) = (y)))
+# define TRIO_ATOMIC_ADD(x, y) ((x) += (y))
+#endif
+#if TRIO_FEATURE_FORMAT_CACHE && TRIO_FEATURE_COMPILE && defined(USE_ATOMICS)
+/* The format cache is read without locks */
+# define USE_FORMAT_CACHE
+#endif
+#if TRIO_FEATURE_LOCALE
+/* Locale attached to the calling thread by trio_locale_use */
+# if defined(TRIO_COMPILER_GCC)
+#  define TRIO_THREAD_LOCAL __thread
+# elif defined(TRIO_COMPILER_VISUALC)
+#  define TRIO_THREAD_LOCAL __declspec(thread)
+# else
+/* Shared by all threads */
+#  define TRIO_THREAD_LOCAL
+# endif
+#endif
 #if defined(TRIO_PLATFORM_VMS)
 # include <unistd.h>
 #endif
@@ -368,6 +412,10 @@ typedef trio_longlong_t trio_int64_t;
 # endif
 #endif
 
+/* Largest values of the maximal integer types */
+#define TRIO_UINTMAX_MAX ((trio_uintmax_t)-1)
+#define TRIO_INTMAX_MAX (TRIO_UINTMAX_MAX >> 1)
+
 #if defined(HAVE_FLOORL)
 # define trio_floor(x) floorl((x))
 #else
@@ -488,9 +536,11 @@ enum {
   FLAGS_IGNORE_PARAMETER    = 2 * FLAGS_IGNORE,
   FLAGS_VARSIZE_PARAMETER   = 2 * FLAGS_IGNORE_PARAMETER,
   FLAGS_FIXED_SIZE          = 2 * FLAGS_VARSIZE_PARAMETER,
-  FLAGS_LAST                = FLAGS_FIXED_SIZE,
+  FLAGS_SHORTEST            = 2 * FLAGS_FIXED_SIZE,
+  FLAGS_LAST                = FLAGS_SHORTEST,
   /* Reused flags */
   FLAGS_EXCLUDE             = FLAGS_SHORT,
+  FLAGS_VIEW                = FLAGS_FLOAT_G,
   FLAGS_USER_DEFINED        = FLAGS_IGNORE,
   FLAGS_USER_DEFINED_PARAMETER = FLAGS_IGNORE_PARAMETER,
   FLAGS_ROUNDING            = FLAGS_INTMAX_T,
@@ -516,17 +566,53 @@ enum {
   MAX_PARAMETERS = 64,
   /* Maximal number of characters in class */
   MAX_CHARACTER_CLASS = UCHAR_MAX + 1,
+  /* Maximal number of excluded characters searched for with strcspn */
+  MAX_SCANLIST_REJECT = 4,
+  /* Length of whitespace runs skipped before strspn is used */
+  MAX_WHITESPACE_RUN = 16,
+  /* Initial buffer size for scanner input of unknown size */
+  MAX_SCANNER_CHUNK = 4096,
 
 #if TRIO_FEATURE_USER_DEFINED
   /* Maximal string lengths for user-defined specifiers */
   MAX_USER_NAME = 64,
   MAX_USER_DATA = 256,
+  /* Number of hash buckets for user-defined specifiers (power of two) */
+  MAX_USER_BUCKETS = 64,
+#endif
+
+#if TRIO_FEATURE_FD
+  /* Size of the output buffer for file descriptors */
+  MAX_FILE_DESCRIPTOR_BUFFER = 512,
 #endif
 
   /* Maximal length of locale separator strings */
   MAX_LOCALE_SEPARATOR_LENGTH = MB_LEN_MAX,
   /* Maximal number of integers in grouping */
-  MAX_LOCALE_GROUPS = 64
+  MAX_LOCALE_GROUPS = 64,
+
+#if TRIO_FEATURE_FLOAT
+  /* Number of 16-bit limbs needed for the scaled numbers */
+  MAX_BIGNUM_LIMBS = (DBL_MAX_EXP - DBL_MIN_EXP + DBL_MANT_DIG) / 16 + 8,
+  /* Maximal length of a double written with exact decimal digits */
+  MAX_DECIMAL_BUFFER = (DBL_MAX_10_EXP - DBL_MIN_10_EXP) + 2 * DBL_DIG
+    + MAX_LOCALE_SEPARATOR_LENGTH + 16,
+#endif
+
+#if TRIO_FEATURE_DYNAMICSTRING
+  /* Size of the on-stack buffer used before allocating dynamic strings */
+  MAX_DYNAMIC_SCRATCH = 256,
+#endif
+
+#if TRIO_FEATURE_FORMAT_CACHE
+  /* Number of entries in the format cache (must be a power of two) */
+  MAX_FORMAT_CACHE = 256,
+  /* Number of entries probed for each format */
+  MAX_FORMAT_CACHE_PROBE = 4,
+#endif
+
+  /* Maximal number of characters staged before bulk output */
+  MAX_STAGING = 64
 };
 
 #define NO_GROUPING ((int)CHAR_MAX)
@@ -721,6 +807,11 @@ enum {
  * !  Sticky
  * @  Parameter (for both print and scan)
  *
+ * v  View (scan only)
+ *    String and scanlist:
+ *      Store the location of the field in a trio_view_t instead of
+ *      copying it. Only for string sources.
+ *
  * I  n-bit Integer
  *    Numbers:
  *      The following options exists
@@ -753,6 +844,8 @@ enum {
 #define QUALIFIER_STICKY '!'
 #define QUALIFIER_VARSIZE '&' /* This should remain undocumented */
 #define QUALIFIER_ROUNDING_UPPER 'R'
+#define QUALIFIER_SHORTEST 'y'
+#define QUALIFIER_VIEW 'v'
 #if TRIO_EXTENSION
 # define QUALIFIER_PARAM '@' /* Experimental */
 # define QUALIFIER_COLON ':' /* For scanlists */
@@ -825,12 +918,91 @@ typedef struct {
   trio_pointer_t closure;
 } trio_custom_t;
 
+#if TRIO_FEATURE_FLOAT
+/* Unsigned integer of arbitrary size with 16-bit limbs, least significant first */
+typedef struct {
+  int length;
+  unsigned int limb[MAX_BIGNUM_LIMBS];
+} trio_bignum_t;
+#endif
+
+#if TRIO_FEATURE_SCANF
+/* Compiled scanlist with one bit for each accepted character */
+typedef struct {
+  unsigned char member[(MAX_CHARACTER_CLASS + CHAR_BIT - 1) / CHAR_BIT];
+} trio_scanlist_t;
+
+# define TRIO_SCANLIST_ADD(list, ch) \
+  ((list)->member[(unsigned char)(ch) / CHAR_BIT] |= \
+   (unsigned char)(1U << ((unsigned char)(ch) % CHAR_BIT)))
+# define TRIO_SCANLIST_HAS(list, ch) \
+  (((list)->member[(unsigned char)(ch) / CHAR_BIT] >> \
+    ((unsigned char)(ch) % CHAR_BIT)) & 1)
+#endif
+
+#if TRIO_FEATURE_COMPILE
+/* Compiled format */
+struct _trio_format_t {
+  /* Private copy of the format string */
+  char *format;
+  /* Address of the original format string (used as cache key) */
+  TRIO_CONST char *key;
+  /* The allocator that the format was allocated with */
+  TRIO_CONST trio_allocator_t *allocator;
+  /* Parsed parameters, including the sentinel */
+  trio_parameter_t *parameters;
+  int count;
+  /* The order in which the arguments are read */
+  int indices[MAX_PARAMETERS];
+  int maxParameter;
+};
+#endif
+
+#if TRIO_FEATURE_FD
+/* Buffered input from a file descriptor */
+struct _trio_dbuffer_t {
+  TRIO_CONST trio_allocator_t *allocator;
+  int fd;
+  unsigned char *data;
+  size_t size;
+  size_t position;
+  size_t length;
+};
+#endif
+
+#if TRIO_FEATURE_SCANNER
+/* Input read from a file or memory region by consecutive scans */
+struct _trio_scanner_t {
+  TRIO_CONST trio_allocator_t *allocator;
+  TRIO_CONST char *data;
+  size_t size;
+  size_t position;
+  /* Number of newlines before lineOffset */
+  size_t lines;
+  size_t lineOffset;
+  /* How data must be released */
+  int storage;
+};
+
+enum {
+  SCANNER_STORAGE_CALLER,
+  SCANNER_STORAGE_ALLOCATED,
+  SCANNER_STORAGE_MAPPED
+};
+#endif
+
 /* General trio "class" */
 typedef struct _trio_class_t {
   /*
    * The function to write characters to a stream.
    */
   void (*OutStream) TRIO_PROTO((struct _trio_class_t *, int));
+  /*
+   * The function to write a block of characters to a stream. This is
+   * optional; if it is NULL the characters are written one by one
+   * with OutStream.
+   */
+  void (*OutStreamBlock) TRIO_PROTO((struct _trio_class_t *, TRIO_CONST char *, int));
   /*
    * The function to read characters from a stream.
    */
@@ -871,8 +1043,24 @@ typedef struct _trio_class_t {
    * The last output error that was detected.
    */
   int error;
+  /*
+   * The decimal point and thousand separator conventions.
+   */
+  TRIO_CONST trio_locale_t *locale;
 } trio_class_t;
 
+/* Numeric conventions (for trio_locale_t) */
+struct _trio_locale_t {
+  /* The decimal point, or NIL if it has more than one character */
+  char decimalPoint;
+  int decimalPointLength;
+  char decimalPointString[MAX_LOCALE_SEPARATOR_LENGTH + 1];
+  int thousandSeparatorLength;
+  char thousandSeparator[MAX_LOCALE_SEPARATOR_LENGTH + 1];
+  char grouping[MAX_LOCALE_GROUPS];
+  TRIO_CONST trio_allocator_t *allocator;
+};
+
 /* References (for user-defined callbacks) */
 typedef struct _trio_reference_t {
   trio_class_t *data;
@@ -883,11 +1071,23 @@ typedef struct _trio_reference_t {
 /* Registered entries (for user-defined callbacks) */
 typedef struct _trio_userdef_t {
   struct _trio_userdef_t *next;
+  struct _trio_userdef_t *retired;
   trio_callback_t callback;
   char *name;
+  size_t hash;
+  TRIO_CONST trio_allocator_t *allocator;
 } trio_userdef_t;
 #endif
 
+#if TRIO_FEATURE_FD
+/* Buffered output to a file descriptor */
+typedef struct _trio_fdout_t {
+  int fd;
+  int length;
+  char buffer[MAX_FILE_DESCRIPTOR_BUFFER];
+} trio_fdout_t;
+#endif
+
 /*************************************************************************
  *
  * Internal Variables
@@ -912,35 +1112,65 @@ static struct lconv *internalLocaleValues = NULL;
 #endif
 
 /*
+ * The default locale, used unless another one is passed explicitly or
+ * attached to the thread. It is filled in from the C locale on first
+ * use.
+ *
  * UNIX98 says "in a locale where the radix character is not defined,
  * the radix character defaults to a period (.)"
  */
-#if TRIO_FEATURE_FLOAT || TRIO_FEATURE_LOCALE || defined(USE_LOCALE)
-static int internalDecimalPointLength = 1;
-static char internalDecimalPoint = '.';
-static char internalDecimalPointString[MAX_LOCALE_SEPARATOR_LENGTH + 1] = ".";
-#endif
-#if TRIO_FEATURE_QUOTE || TRIO_FEATURE_LOCALE || TRIO_EXTENSION
-static int internalThousandSeparatorLength = 1;
-static char internalThousandSeparator[MAX_LOCALE_SEPARATOR_LENGTH + 1] = ",";
-static char internalGrouping[MAX_LOCALE_GROUPS] = { (char)NO_GROUPING };
+static trio_locale_t internalLocale = {
+  '.', 1, ".", 1, ",", { (char)NO_GROUPING }, NULL
+};
+#if TRIO_FEATURE_LOCALE
+static TRIO_THREAD_LOCAL TRIO_CONST trio_locale_t *internalThreadLocale = NULL;
 #endif
 
 static TRIO_CONST char internalDigitsLower[] = "0123456789abcdefghijklmnopqrstuvwxyz";
 static TRIO_CONST char internalDigitsUpper[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+/* Decimal digits of 0 to 99 */
+static TRIO_CONST char internalDigitPairs[] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
 #if TRIO_FEATURE_SCANF
-static BOOLEAN_T internalDigitsUnconverted = TRUE;
-static int internalDigitArray[128];
+/* Value of ASCII digits and letters in bases up to 36, or -1 */
+static TRIO_CONST signed char internalDigitArray[128] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+  -1, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+  25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, -1, -1, -1, -1, -1,
+  -1, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+  25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, -1, -1, -1, -1, -1
+};
 # if TRIO_EXTENSION
-static BOOLEAN_T internalCollationUnconverted = TRUE;
-static char internalCollationArray[MAX_CHARACTER_CLASS][MAX_CHARACTER_CLASS];
+/* Rows of equivalent characters, built on first use by TrioGetCollation */
+static char *internalCollationArray = NULL;
 # endif
 #endif
 
+#if defined(USE_FORMAT_CACHE)
+static trio_format_t *internalFormatCache[MAX_FORMAT_CACHE];
+static int internalFormatCacheEnabled = FALSE;
+static unsigned long internalFormatCacheHits = 0;
+static unsigned long internalFormatCacheMisses = 0;
+#endif
+
+/* Installed heap allocator, or NULL for TRIO_MALLOC and friends */
+static TRIO_CONST trio_allocator_t *internalAllocator = NULL;
+
 #if TRIO_FEATURE_USER_DEFINED
 static TRIO_VOLATILE trio_callback_t internalEnterCriticalRegion = NULL;
 static TRIO_VOLATILE trio_callback_t internalLeaveCriticalRegion = NULL;
-static trio_userdef_t *internalUserDef = NULL;
+/* Hash buckets of registered specifiers, read without locks */
+static trio_userdef_t *internalUserDef[MAX_USER_BUCKETS];
+/* Unregistered specifiers that readers may still be using */
+static trio_userdef_t *internalUserRetired = NULL;
+static int internalUserReaders = 0;
 #endif
 
 /*************************************************************************
@@ -957,6 +1187,49 @@ static trio_userdef_t *internalUserDef = NULL;
 # include "triostr.c"
 #endif
 
+/*************************************************************************
+ * TrioAllocate
+ *
+ * Description:
+ *  Allocate heap memory with the allocator, or with TRIO_MALLOC if there
+ *  is none. Callers resolve the allocator once with TrioGetAllocator and
+ *  keep it, so memory is released by the allocator that provided it.
+ */
+#if TRIO_FEATURE_DYNAMICSTRING || TRIO_FEATURE_COMPILE || TRIO_FEATURE_USER_DEFINED || TRIO_FEATURE_FD \
+ || TRIO_FEATURE_LOCALE || TRIO_FEATURE_SCANNER
+static TRIO_CONST trio_allocator_t *
+TrioGetAllocator
+TRIO_ARGS1((allocator),
+	   TRIO_CONST trio_allocator_t *allocator)
+{
+  return (allocator == NULL) ? internalAllocator : allocator;
+}
+
+static trio_pointer_t
+TrioAllocate
+TRIO_ARGS2((allocator, size),
+	   TRIO_CONST trio_allocator_t *allocator,
+	   size_t size)
+{
+  if (allocator)
+    return allocator->allocate(allocator->context, size);
+  return TRIO_MALLOC(size);
+}
+
+static void
+TrioDeallocate
+TRIO_ARGS2((allocator, pointer),
+	   TRIO_CONST trio_allocator_t *allocator,
+	   trio_pointer_t pointer)
+{
+  if (allocator)
+    allocator->deallocate(allocator->context, pointer);
+  else
+    TRIO_FREE(pointer);
+}
+#endif
+
+
 /*************************************************************************
  * TrioInitializeParameter
  *
@@ -1067,12 +1340,113 @@ TRIO_ARGS1((character),
 #endif
     case QUALIFIER_FIXED_SIZE:
     case QUALIFIER_ROUNDING_UPPER:
+    case QUALIFIER_SHORTEST:
+    case QUALIFIER_VIEW:
       return TRUE;
     default:
       return FALSE;
     }
 }
 
+/*************************************************************************
+ * TrioLocaleSetDecimalPoint
+ */
+#if TRIO_FEATURE_LOCALE || defined(USE_LOCALE)
+static void
+TrioLocaleSetDecimalPoint
+TRIO_ARGS2((locale, decimalPoint),
+	   trio_locale_t *locale,
+	   TRIO_CONST char *decimalPoint)
+{
+  trio_copy_max(locale->decimalPointString,
+		sizeof(locale->decimalPointString),
+		decimalPoint);
+  locale->decimalPointLength = trio_length(locale->decimalPointString);
+  locale->decimalPoint = (locale->decimalPointLength == 1)
+    ? locale->decimalPointString[0]
+    : NIL;
+}
+#endif
+
+/*************************************************************************
+ * TrioLocaleSetThousandSeparator
+ */
+#if TRIO_FEATURE_LOCALE || TRIO_EXTENSION || defined(USE_LOCALE)
+static void
+TrioLocaleSetThousandSeparator
+TRIO_ARGS2((locale, thousandSeparator),
+	   trio_locale_t *locale,
+	   TRIO_CONST char *thousandSeparator)
+{
+  trio_copy_max(locale->thousandSeparator,
+		sizeof(locale->thousandSeparator),
+		thousandSeparator);
+  locale->thousandSeparatorLength = trio_length(locale->thousandSeparator);
+}
+
+/*************************************************************************
+ * TrioLocaleSetGrouping
+ */
+static void
+TrioLocaleSetGrouping
+TRIO_ARGS2((locale, grouping),
+	   trio_locale_t *locale,
+	   TRIO_CONST char *grouping)
+{
+  trio_copy_max(locale->grouping,
+		sizeof(locale->grouping),
+		grouping);
+}
+#endif
+
+/*************************************************************************
+ * TrioLocaleFromSystem
+ *
+ * Description:
+ *  Fill in the conventions of the current C locale, for each of the
+ *  settings that are requested.
+ */
+#if defined(USE_LOCALE)
+static void
+TrioLocaleFromSystem
+TRIO_ARGS4((locale, decimalPoint, thousandSeparator, grouping),
+	   trio_locale_t *locale,
+	   BOOLEAN_T decimalPoint,
+	   BOOLEAN_T thousandSeparator,
+	   BOOLEAN_T grouping)
+{
+  struct lconv *values;
+
+  values = (struct lconv *)localeconv();
+  if (values == NULL)
+    return;
+
+  if (decimalPoint &&
+      (values->decimal_point) &&
+      (values->decimal_point[0] != NIL))
+    {
+      TrioLocaleSetDecimalPoint(locale, values->decimal_point);
+    }
+# if TRIO_EXTENSION
+  if (thousandSeparator &&
+      (values->thousands_sep) &&
+      (values->thousands_sep[0] != NIL))
+    {
+      TrioLocaleSetThousandSeparator(locale, values->thousands_sep);
+    }
+  if (grouping &&
+      (values->grouping) &&
+      (values->grouping[0] != NIL))
+    {
+      TrioLocaleSetGrouping(locale, values->grouping);
+    }
+# else
+  (void)thousandSeparator;
+  (void)grouping;
+# endif
+}
+#endif /* defined(USE_LOCALE) */
+
 /*************************************************************************
  * TrioSetLocale
  */
@@ -1080,57 +1454,48 @@ TRIO_ARGS1((character),
 static void
 TrioSetLocale(TRIO_NOARGS)
 {
+  TrioLocaleFromSystem(&internalLocale, TRUE, TRUE, TRUE);
   internalLocaleValues = (struct lconv *)localeconv();
-  if (internalLocaleValues)
+}
+#endif /* defined(USE_LOCALE) */
+
+/*************************************************************************
+ * TrioGetLocale
+ *
+ * Description:
+ *  Select the locale of a call: the explicit one if given, else the
+ *  one attached to the thread, else the default locale.
+ */
+static TRIO_CONST trio_locale_t *
+TrioGetLocale
+TRIO_ARGS1((locale),
+	   TRIO_CONST trio_locale_t *locale)
+{
+  if (locale)
+    return locale;
+#if TRIO_FEATURE_LOCALE
+  if (internalThreadLocale)
+    return internalThreadLocale;
+#endif
+#if defined(USE_LOCALE)
+  if (NULL == internalLocaleValues)
     {
-      if ((internalLocaleValues->decimal_point) &&
-	  (internalLocaleValues->decimal_point[0] != NIL))
-	{
-	  internalDecimalPointLength = trio_length(internalLocaleValues->decimal_point);
-	  if (internalDecimalPointLength == 1)
-	    {
-	      internalDecimalPoint = internalLocaleValues->decimal_point[0];
-	    }
-	  else
-	    {
-	      internalDecimalPoint = NIL;
-	      trio_copy_max(internalDecimalPointString,
-			    sizeof(internalDecimalPointString),
-			    internalLocaleValues->decimal_point);
-	    }
-	}
-# if TRIO_EXTENSION
-      if ((internalLocaleValues->thousands_sep) &&
-	  (internalLocaleValues->thousands_sep[0] != NIL))
-	{
-	  trio_copy_max(internalThousandSeparator,
-			sizeof(internalThousandSeparator),
-			internalLocaleValues->thousands_sep);
-	  internalThousandSeparatorLength = trio_length(internalThousandSeparator);
-	}
-# endif
-# if TRIO_EXTENSION
-      if ((internalLocaleValues->grouping) &&
-	  (internalLocaleValues->grouping[0] != NIL))
-	{
-	  trio_copy_max(internalGrouping,
-			sizeof(internalGrouping),
-			internalLocaleValues->grouping);
-	}
-# endif
+      TrioSetLocale();
     }
+#endif
+  return &internalLocale;
 }
-#endif /* defined(USE_LOCALE) */
 
 #if TRIO_FEATURE_FLOAT && TRIO_FEATURE_QUOTE
 static int
 TrioCalcThousandSeparatorLength
-TRIO_ARGS1((digits),
+TRIO_ARGS2((locale, digits),
+	   TRIO_CONST trio_locale_t *locale,
 	   int digits)
 {
   int count = 0;
   int step = NO_GROUPING;
-  char *groupingPointer = internalGrouping;
+  TRIO_CONST char *groupingPointer = locale->grouping;
 
   while (digits > 0)
     {
@@ -1153,7 +1518,7 @@ TRIO_ARGS1((digits),
 	  step = *groupingPointer++;
 	}
       if (digits > step)
-	count += internalThousandSeparatorLength;
+	count += locale->thousandSeparatorLength;
       digits -= step;
     }
   return count;
@@ -1163,11 +1528,12 @@ TRIO_ARGS1((digits),
 #if TRIO_FEATURE_QUOTE
 static BOOLEAN_T
 TrioFollowedBySeparator
-TRIO_ARGS1((position),
+TRIO_ARGS2((locale, position),
+	   TRIO_CONST trio_locale_t *locale,
 	   int position)
 {
   int step = 0;
-  char *groupingPointer = internalGrouping;
+  TRIO_CONST char *groupingPointer = locale->grouping;
 
   position--;
   if (position == 0)
@@ -1222,41 +1588,154 @@ TRIO_ARGS2((format, offsetPointer),
   return NO_POSITION;
 }
 
+/*************************************************************************
+ * TrioHashNamespace
+ */
+#if TRIO_FEATURE_USER_DEFINED
+static size_t
+TrioHashNamespace
+TRIO_ARGS1((name),
+	   TRIO_CONST char *name)
+{
+  size_t hash = 5381;
+
+  while (*name)
+    hash = (hash * 33) ^ (unsigned char)*name++;
+  return hash;
+}
+#endif
+
 /*************************************************************************
  * TrioFindNamespace
  *
- * Find registered user-defined specifier.
- * The prev argument is used for optimization only.
+ * Description:
+ *  Find registered user-defined specifier.
+ *
+ *  Entries are never modified after they have been linked into their
+ *  bucket, so when atomics are available the buckets are searched
+ *  without entering the critical region. Otherwise the :enter and
+ *  :leave callbacks are used to guard against concurrent registration.
+ *
+ *  The caller counts as a reader until it calls TrioReleaseNamespace.
+ *  Unlinked entries are not released while there are readers, and the
+ *  last reader to leave releases them instead.
  */
 #if TRIO_FEATURE_USER_DEFINED
 static trio_userdef_t *
 TrioFindNamespace
-TRIO_ARGS2((name, prev),
+TRIO_ARGS2((name, hash),
 	   TRIO_CONST char *name,
-	   trio_userdef_t **prev)
+	   size_t hash)
 {
   trio_userdef_t *def;
 
+#if !defined(USE_ATOMICS)
   if (internalEnterCriticalRegion)
     (void)internalEnterCriticalRegion(NULL);
+#endif
 
-  for (def = internalUserDef; def; def = def->next)
+  (void)TRIO_ATOMIC_ADD(internalUserReaders, 1);
+
+  for (def = TRIO_ATOMIC_LOAD(internalUserDef[hash & (MAX_USER_BUCKETS - 1)]);
+       def;
+       def = TRIO_ATOMIC_LOAD(def->next))
     {
       /* Case-sensitive string comparison */
-      if (trio_equal_case(def->name, name))
+      if ((def->hash == hash) && trio_equal_case(def->name, name))
 	break;
-
-      if (prev)
-	*prev = def;
     }
 
+#if !defined(USE_ATOMICS)
   if (internalLeaveCriticalRegion)
     (void)internalLeaveCriticalRegion(NULL);
+#endif
 
   return def;
 }
 #endif
 
+/*************************************************************************
+ * TrioTakeRetired
+ *
+ * Description:
+ *  Take the list of retired entries if there are no readers, or return
+ *  NULL. Must be called inside the critical region, where entries are
+ *  retired, so a reader that may still visit a retired entry is counted.
+ */
+#if TRIO_FEATURE_USER_DEFINED
+static trio_userdef_t *
+TrioTakeRetired(TRIO_NOARGS)
+{
+  trio_userdef_t *retired = NULL;
+
+  if (TRIO_ATOMIC_ADD(internalUserReaders, 0) == 0)
+    {
+      retired = internalUserRetired;
+      TRIO_ATOMIC_STORE(internalUserRetired, NULL);
+    }
+  return retired;
+}
+#endif
+
+/*************************************************************************
+ * TrioDeallocateRetired
+ *
+ * Description:
+ *  Release a list of retired entries taken by TrioTakeRetired.
+ */
+#if TRIO_FEATURE_USER_DEFINED
+static void
+TrioDeallocateRetired
+TRIO_ARGS1((retired),
+	   trio_userdef_t *retired)
+{
+  trio_userdef_t *def;
+
+  while (retired)
+    {
+      def = retired;
+      retired = retired->retired;
+      TrioDeallocate(def->allocator, def);
+    }
+}
+#endif
+
+/*************************************************************************
+ * TrioReleaseNamespace
+ *
+ * Description:
+ *  End the use of an entry returned by TrioFindNamespace. The last
+ *  reader to leave releases the entries that were unregistered while
+ *  there were readers.
+ */
+#if TRIO_FEATURE_USER_DEFINED
+static void
+TrioReleaseNamespace(TRIO_NOARGS)
+{
+  trio_userdef_t *retired;
+
+#if defined(USE_ATOMICS)
+  if ((TRIO_ATOMIC_ADD(internalUserReaders, -1) != 0) ||
+      (TRIO_ATOMIC_LOAD(internalUserRetired) == NULL))
+    return;
+#endif
+
+  if (internalEnterCriticalRegion)
+    (void)internalEnterCriticalRegion(NULL);
+
+#if !defined(USE_ATOMICS)
+  (void)TRIO_ATOMIC_ADD(internalUserReaders, -1);
+#endif
+  /* Another reader may have started since the count dropped to zero */
+  retired = TrioTakeRetired();
+
+  if (internalLeaveCriticalRegion)
+    (void)internalLeaveCriticalRegion(NULL);
+
+  TrioDeallocateRetired(retired);
+}
+#endif
+
 /*************************************************************************
  * TrioPower
  *
@@ -1665,6 +2144,21 @@ TRIO_ARGS4((type, format, offset, parameter),
 	  break;
 #endif
 
+#if TRIO_FEATURE_SHORTEST
+	case QUALIFIER_SHORTEST:
+	  parameter->flags |= FLAGS_SHORTEST;
+	  break;
+#endif
+
+#if TRIO_FEATURE_VIEW
+	case QUALIFIER_VIEW:
+	  /* Views are only stored by the scanning functions */
+	  if (type != TYPE_SCAN)
+	    return TRIO_ERROR_RETURN(TRIO_EINVAL, offset);
+	  parameter->flags |= FLAGS_VIEW;
+	  break;
+#endif
+
 	default:
 	  /* Bail out completely to make the error more obvious */
 	  return TRIO_ERROR_RETURN(TRIO_EINVAL, offset);
@@ -1692,6 +2186,17 @@ TRIO_ARGS4((type, format, offset, parameter),
 {
   parameter->baseSpecifier = NO_BASE;
 
+#if TRIO_FEATURE_VIEW
+  if (parameter->flags & FLAGS_VIEW)
+    {
+      /* Only plain strings and scanlists can be viewed in place */
+      if (((format[offset] != SPECIFIER_STRING) &&
+	   (format[offset] != SPECIFIER_GROUP)) ||
+	  (parameter->flags & (FLAGS_ALTERNATIVE | FLAGS_LONG | FLAGS_SHORT)))
+	return TRIO_ERROR_RETURN(TRIO_EINVAL, offset);
+    }
+#endif
+
   switch (format[offset++])
     {
 #if defined(SPECIFIER_CHAR_UPPER)
@@ -1925,20 +2430,25 @@ TRIO_ARGS4((type, format, offset, parameter),
 }
 
 /*************************************************************************
- * TrioParse
+ * TrioParseFormat
  *
  * Description:
- *  Parse the format string
+ *  Parse the format string into an array of parameters, terminated by
+ *  a sentinel. The arguments are not fetched (see TrioParseArguments)
+ *  so the result can be reused for several sets of arguments.
+ *
+ *  'indices' specifies the order in which the parameters must be
+ *  read from the va_args (this is necessary to handle positionals),
+ *  and 'maxParameter' is set to the highest index in use.
  */
 static int
-TrioParse
-TRIO_ARGS6((type, format, parameters, arglist, argfunc, argarray),
+TrioParseFormat
+TRIO_ARGS5((type, format, parameters, indices, maxParameter),
 	   int type,
 	   TRIO_CONST char *format,
 	   trio_parameter_t *parameters,
-	   va_list arglist,
-	   trio_argfunc_t argfunc,
-	   trio_pointer_t *argarray)
+	   int *indices,
+	   int *maxParameter)
 {
   /* Count the number of times a parameter is referenced */
   unsigned short usedEntries[MAX_PARAMETERS];
@@ -1951,33 +2461,22 @@ TRIO_ARGS6((type, format, parameters, arglist, argfunc, argarray),
 #if TRIO_FEATURE_STICKY
   BOOLEAN_T gotSticky = FALSE;  /* Are there any sticky modifiers at all? */
 #endif
-  /*
-   * indices specifies the order in which the parameters must be
-   * read from the va_args (this is necessary to handle positionals)
-   */
-  int indices[MAX_PARAMETERS];
   int pos = 0;
   /* Various variables */
 #if defined(TRIO_COMPILER_SUPPORTS_MULTIBYTE)
   int charlen;
 #endif
-  int save_errno;
   int i = -1;
   int num;
   trio_parameter_t workParameter;
   int status;
 
-  /* Both must be set or none must be set */
-  assert(((argfunc == NULL) && (argarray == NULL)) ||
-	 ((argfunc != NULL) && (argarray != NULL)));
-
   /*
    * The 'parameters' array is not initialized, but we need to
    * know which entries we have used.
    */
   memset(usedEntries, 0, sizeof(usedEntries));
 
-  save_errno = errno;
   offset = 0;
   parameterPosition = 0;
 #if defined(TRIO_COMPILER_SUPPORTS_MULTIBYTE)
@@ -1986,8 +2485,6 @@ TRIO_ARGS6((type, format, parameters, arglist, argfunc, argarray),
 
   while (format[offset])
     {
-      TrioInitializeParameter(&workParameter);
-
 #if defined(TRIO_COMPILER_SUPPORTS_MULTIBYTE)
       if (! isascii(format[offset]))
 	{
@@ -2012,6 +2509,7 @@ TRIO_ARGS6((type, format, parameters, arglist, argfunc, argarray),
 	      continue; /* while */
 	    }
 
+	  TrioInitializeParameter(&workParameter);
 	  status = TrioParseQualifiers(type, format, offset, &workParameter);
 	  if (status < 0)
 	    return status; /* Return qualifier syntax error */
@@ -2025,6 +2523,7 @@ TRIO_ARGS6((type, format, parameters, arglist, argfunc, argarray),
 #if TRIO_EXTENSION
       case CHAR_ALT_IDENTIFIER:
 	{
+	  TrioInitializeParameter(&workParameter);
 	  status = TrioParseQualifiers(type, format, offset, &workParameter);
 	  if (status < 0)
 	    continue; /* False alert, not a user defined specifier */
@@ -2204,7 +2703,39 @@ TRIO_ARGS6((type, format, parameters, arglist, argfunc, argarray),
 	  else /* double references detected */
 	    return TRIO_ERROR_RETURN(TRIO_EDBLREF, num);
 	}
+    }
+
+  *maxParameter = maxParam;
+  return pos + 1;
+}
+
+/*************************************************************************
+ * TrioParseArguments
+ *
+ * Description:
+ *  Fetch the arguments of the parameters found by TrioParseFormat
+ */
+static int
+TrioParseArguments
+TRIO_ARGS8((type, parameters, indices, maxParam, save_errno, arglist, argfunc, argarray),
+	   int type,
+	   trio_parameter_t *parameters,
+	   TRIO_CONST int *indices,
+	   int maxParam,
+	   int save_errno,
+	   va_list arglist,
+	   trio_argfunc_t argfunc,
+	   trio_pointer_t *argarray)
+{
+  int i;
+  int num;
+
+  /* Both must be set or none must be set */
+  assert(((argfunc == NULL) && (argarray == NULL)) ||
+	 ((argfunc != NULL) && (argarray != NULL)));
 
+  for (num = 0; num <= maxParam; num++)
+    {
       i = indices[num];
 
       /*
@@ -2240,6 +2771,15 @@ TRIO_ARGS6((type, format, parameters, arglist, argfunc, argarray),
 	{
 	case FORMAT_GROUP:
 	case FORMAT_STRING:
+#if TRIO_FEATURE_VIEW
+	  if ((type == TYPE_SCAN) && (parameters[i].flags & FLAGS_VIEW))
+	    {
+	      parameters[i].data.pointer = (argfunc == NULL)
+		? (trio_pointer_t)va_arg(arglist, trio_view_t *)
+		: argfunc(argarray, num, TRIO_TYPE_POINTER);
+	    }
+	  else
+#endif
 #if TRIO_FEATURE_WIDECHAR
 	  if (parameters[i].flags & FLAGS_WIDECHAR)
 	    {
@@ -2455,12 +2995,141 @@ TRIO_ARGS6((type, format, parameters, arglist, argfunc, argarray),
   return num;
 }
 
+/*************************************************************************
+ * TrioParse
+ *
+ * Description:
+ *  Parse the format string and fetch the arguments
+ */
+static int
+TrioParse
+TRIO_ARGS6((type, format, parameters, arglist, argfunc, argarray),
+	   int type,
+	   TRIO_CONST char *format,
+	   trio_parameter_t *parameters,
+	   va_list arglist,
+	   trio_argfunc_t argfunc,
+	   trio_pointer_t *argarray)
+{
+  int indices[MAX_PARAMETERS];
+  int maxParam = -1;
+  int save_errno;
+  int status;
+
+  save_errno = errno;
+  status = TrioParseFormat(type, format, parameters, indices, &maxParam);
+  if (status < 0)
+    return status;
+
+  return TrioParseArguments(type, parameters, indices, maxParam, save_errno,
+			    arglist, argfunc, argarray);
+}
+
 /*************************************************************************
  *
  * FORMATTING
  *
  ************************************************************************/
 
+/*************************************************************************
+ * TrioWriteBlock
+ *
+ * Description:
+ *  Output a block of characters.
+ *  The block is handed to the stream in one go if the stream supports
+ *  it, otherwise it is written one character at a time.
+ */
+static void
+TrioWriteBlock
+TRIO_ARGS3((self, block, length),
+	   trio_class_t *self,
+	   TRIO_CONST char *block,
+	   int length)
+{
+  assert(VALID(self));
+  assert(VALID(self->OutStream));
+
+  if (length <= 0)
+    return;
+
+  if (self->OutStreamBlock)
+    {
+      self->OutStreamBlock(self, block, length);
+    }
+  else
+    {
+      while (length-- > 0)
+	self->OutStream(self, *block++);
+    }
+}
+
+/*************************************************************************
+ * TrioWritePadding
+ *
+ * Description:
+ *  Output a run of padding characters.
+ *  The run is written in blocks if the stream supports it.
+ */
+static void
+TrioWritePadding
+TRIO_ARGS3((self, ch, count),
+	   trio_class_t *self,
+	   int ch,
+	   int count)
+{
+  char padding[MAX_STAGING];
+  int length;
+
+  assert(VALID(self));
+  assert(VALID(self->OutStream));
+
+  if (count <= 0)
+    return;
+
+  if (self->OutStreamBlock)
+    {
+      length = (count < (int)sizeof(padding)) ? count : (int)sizeof(padding);
+      memset(padding, ch, (size_t)length);
+      while (count > length)
+	{
+	  self->OutStreamBlock(self, padding, length);
+	  count -= length;
+	}
+      self->OutStreamBlock(self, padding, count);
+    }
+  else
+    {
+      while (count-- > 0)
+	self->OutStream(self, ch);
+    }
+}
+
+#if TRIO_FEATURE_FLOAT
+/*************************************************************************
+ * TrioWriteStaged
+ *
+ * Description:
+ *  Collect a character in a staging area which is written with
+ *  TrioWriteBlock when it becomes full. The caller must write out
+ *  the remaining characters when done.
+ */
+static void
+TrioWriteStaged
+TRIO_ARGS4((self, staging, staged, ch),
+	   trio_class_t *self,
+	   char *staging,
+	   int *staged,
+	   int ch)
+{
+  if (*staged >= MAX_STAGING)
+    {
+      TrioWriteBlock(self, staging, *staged);
+      *staged = 0;
+    }
+  staging[(*staged)++] = (char)ch;
+}
+#endif /* TRIO_FEATURE_FLOAT */
+
 /*************************************************************************
  * TrioWriteNumber
  *
@@ -2490,10 +3159,12 @@ TRIO_ARGS6((self, number, flags, width, precision, base),
   int i;
 #if TRIO_FEATURE_QUOTE
   int length;
-  char *p;
+  TRIO_CONST char *p;
 #endif
   int count;
   int digitOffset;
+  int shift;
+  unsigned int smallNumber;
 
   assert(VALID(self));
   assert(VALID(self->OutStream));
@@ -2518,7 +3189,7 @@ TRIO_ARGS6((self, number, flags, width, precision, base),
     {
       isNegative = ((trio_intmax_t)number < 0);
       if (isNegative)
-	number = -((trio_intmax_t)number);
+	number = (trio_uintmax_t)0 - number;
     }
 
   if (flags & FLAGS_QUAD)
@@ -2531,31 +3202,75 @@ TRIO_ARGS6((self, number, flags, width, precision, base),
   /* Build number */
   pointer = bufferend = &buffer[sizeof(buffer) - 1];
   *pointer-- = NIL;
-  for (i = 1; i < (int)sizeof(buffer); i++)
+  if ((base == BASE_DECIMAL) && !(flags & FLAGS_QUOTE))
     {
-      digitOffset = number % base;
-      *pointer-- = digits[digitOffset];
-      number /= base;
-      if (number == 0)
-	break;
+      /* Two digits per division, and native division when it fits */
+      while (number > UINT_MAX)
+	{
+	  digitOffset = (int)(number % 100) * 2;
+	  number /= 100;
+	  *pointer-- = internalDigitPairs[digitOffset + 1];
+	  *pointer-- = internalDigitPairs[digitOffset];
+	}
+      smallNumber = (unsigned int)number;
+      while (smallNumber >= 100)
+	{
+	  digitOffset = (int)(smallNumber % 100) * 2;
+	  smallNumber /= 100;
+	  *pointer-- = internalDigitPairs[digitOffset + 1];
+	  *pointer-- = internalDigitPairs[digitOffset];
+	}
+      if (smallNumber >= 10)
+	{
+	  digitOffset = (int)smallNumber * 2;
+	  *pointer-- = internalDigitPairs[digitOffset + 1];
+	  *pointer-- = internalDigitPairs[digitOffset];
+	}
+      else
+	{
+	  *pointer-- = digits[smallNumber];
+	}
+    }
+  else if (((base & (base - 1)) == 0) && !(flags & FLAGS_QUOTE))
+    {
+      /* Powers of two */
+      for (shift = 1; (1 << shift) < base; shift++)
+	continue;
+      do
+	{
+	  *pointer-- = digits[(int)(number & (base - 1))];
+	  number >>= shift;
+	}
+      while (number != 0);
+    }
+  else
+    {
+      for (i = 1; i < (int)sizeof(buffer); i++)
+	{
+	  digitOffset = number % base;
+	  *pointer-- = digits[digitOffset];
+	  number /= base;
+	  if (number == 0)
+	    break;
 
 #if TRIO_FEATURE_QUOTE
-      if ((flags & FLAGS_QUOTE) && TrioFollowedBySeparator(i + 1))
-	{
-	  /*
-	   * We are building the number from the least significant
-	   * to the most significant digit, so we have to copy the
-	   * thousand separator backwards
-	   */
-	  length = internalThousandSeparatorLength;
-	  if (((int)(pointer - buffer) - length) > 0)
+	  if ((flags & FLAGS_QUOTE) && TrioFollowedBySeparator(self->locale, i + 1))
 	    {
-	      p = &internalThousandSeparator[length - 1];
-	      while (length-- > 0)
-		*pointer-- = *p--;
+	      /*
+	       * We are building the number from the least significant
+	       * to the most significant digit, so we have to copy the
+	       * thousand separator backwards
+	       */
+	      length = self->locale->thousandSeparatorLength;
+	      if (((int)(pointer - buffer) - length) > 0)
+		{
+		  p = &self->locale->thousandSeparator[length - 1];
+		  while (length-- > 0)
+		    *pointer-- = *p--;
+		}
 	    }
-	}
 #endif
+	}
     }
 
   if (! ignoreNumber)
@@ -2602,8 +3317,7 @@ TRIO_ARGS6((self, number, flags, width, precision, base),
   if (! ((flags & FLAGS_LEFTADJUST) ||
 	 ((flags & FLAGS_NILPADDING) && (precision == NO_PRECISION))))
     {
-      while (width-- > count)
-	self->OutStream(self, CHAR_ADJUST);
+      TrioWritePadding(self, CHAR_ADJUST, width - count);
     }
 
   /* width has been adjusted for signs and alternatives */
@@ -2644,28 +3358,71 @@ TRIO_ARGS6((self, number, flags, width, precision, base),
     {
       if (precision == NO_PRECISION)
 	precision = width;
-      while (precision-- > 0)
+      if (precision > 0)
 	{
-	  self->OutStream(self, '0');
-	  width--;
+	  TrioWritePadding(self, '0', precision);
+	  width -= precision;
 	}
     }
 
   if (! ignoreNumber)
     {
       /* Output the number itself */
-      while (*(++pointer))
-	{
-	  self->OutStream(self, *pointer);
-	}
+      TrioWriteBlock(self, pointer + 1, (int)(bufferend - pointer) - 1);
     }
 
   /* Output trailing spaces if needed */
   if (flags & FLAGS_LEFTADJUST)
     {
-      while (width-- > 0)
-	self->OutStream(self, CHAR_ADJUST);
+      TrioWritePadding(self, CHAR_ADJUST, width);
+    }
+}
+
+/*************************************************************************
+ * TrioSpanPrintable
+ *
+ * Description:
+ *  Count the leading characters that can be written by %#s without
+ *  escaping. Words of printable ASCII characters other than backslash
+ *  are skipped with bit operations on a whole word at a time, and
+ *  only the remaining characters are classified with isprint.
+ */
+static int
+TrioSpanPrintable
+TRIO_ARGS2((string, length),
+	   TRIO_CONST char *string,
+	   int length)
+{
+  /* Each byte of ones is 0x01 and each byte of highs is 0x80 */
+  TRIO_CONST unsigned long ones = ~0UL / UCHAR_MAX;
+  TRIO_CONST unsigned long highs = ones * 0x80;
+  unsigned long word;
+  unsigned long backslash;
+  int run = 0;
+  int ch;
+
+  if (CHAR_BIT == 8)
+    {
+      while (length - run >= (int)sizeof(word))
+	{
+	  memcpy(&word, &string[run], sizeof(word));
+	  backslash = word ^ (ones * CHAR_BACKSLASH);
+	  /* Stop at bytes below space, above tilde, or equal to backslash */
+	  if (((word - ones * ' ') & ~word & highs)
+	      | (((word + ones) | word) & highs)
+	      | ((backslash - ones) & ~backslash & highs))
+	    break;
+	  run += (int)sizeof(word);
+	}
+    }
+  for (; run < length; run++)
+    {
+      /* The ctype parameters must be an unsigned char (or EOF) */
+      ch = (int)((unsigned char)string[run]);
+      if (!isprint(ch) || (ch == CHAR_BACKSLASH))
+	break;
     }
+  return run;
 }
 
 /*************************************************************************
@@ -2681,6 +3438,9 @@ TRIO_ARGS3((self, ch, flags),
 	   int ch,
 	   trio_flags_t flags)
 {
+  char escape[sizeof("\\xff")];
+  int length;
+
   if (flags & FLAGS_ALTERNATIVE)
     {
       if (! isprint(ch))
@@ -2689,29 +3449,43 @@ TRIO_ARGS3((self, ch, flags),
 	   * Non-printable characters are converted to C escapes or
 	   * \number, if no C escape exists.
 	   */
-	  self->OutStream(self, CHAR_BACKSLASH);
+	  escape[0] = CHAR_BACKSLASH;
+	  length = 2;
 	  switch (ch)
 	    {
-	    case '\007': self->OutStream(self, 'a'); break;
-	    case '\b': self->OutStream(self, 'b'); break;
-	    case '\f': self->OutStream(self, 'f'); break;
-	    case '\n': self->OutStream(self, 'n'); break;
-	    case '\r': self->OutStream(self, 'r'); break;
-	    case '\t': self->OutStream(self, 't'); break;
-	    case '\v': self->OutStream(self, 'v'); break;
-	    case '\\': self->OutStream(self, '\\'); break;
+	    case '\007': escape[1] = 'a'; break;
+	    case '\b': escape[1] = 'b'; break;
+	    case '\f': escape[1] = 'f'; break;
+	    case '\n': escape[1] = 'n'; break;
+	    case '\r': escape[1] = 'r'; break;
+	    case '\t': escape[1] = 't'; break;
+	    case '\v': escape[1] = 'v'; break;
+	    case '\\': escape[1] = '\\'; break;
 	    default:
-	      self->OutStream(self, 'x');
-	      TrioWriteNumber(self, (trio_uintmax_t)ch,
-			      FLAGS_UNSIGNED | FLAGS_NILPADDING,
-			      2, 2, BASE_HEX);
+	      escape[1] = 'x';
+	      if ((ch >= 0) && (ch <= UCHAR_MAX) && (CHAR_BIT == 8))
+		{
+		  escape[2] = internalDigitsLower[(ch >> 4) & 0x0F];
+		  escape[3] = internalDigitsLower[ch & 0x0F];
+		  length = 4;
+		}
+	      else
+		{
+		  TrioWriteBlock(self, escape, length);
+		  TrioWriteNumber(self, (trio_uintmax_t)ch,
+				  FLAGS_UNSIGNED | FLAGS_NILPADDING,
+				  2, 2, BASE_HEX);
+		  length = 0;
+		}
 	      break;
 	    }
+	  TrioWriteBlock(self, escape, length);
 	}
       else if (ch == CHAR_BACKSLASH)
 	{
-	  self->OutStream(self, CHAR_BACKSLASH);
-	  self->OutStream(self, CHAR_BACKSLASH);
+	  escape[0] = CHAR_BACKSLASH;
+	  escape[1] = CHAR_BACKSLASH;
+	  TrioWriteBlock(self, escape, 2);
 	}
       else
 	{
@@ -2740,6 +3514,7 @@ TRIO_ARGS5((self, string, flags, width, precision),
 	   int precision)
 {
   int length;
+  int run;
   int ch;
 
   assert(VALID(self));
@@ -2757,7 +3532,7 @@ TRIO_ARGS5((self, string, flags, width, precision),
     }
   else
     {
-      if (precision == 0)
+      if (precision == NO_PRECISION)
 	{
 	  length = trio_length(string);
 	}
@@ -2780,21 +3555,34 @@ TRIO_ARGS5((self, string, flags, width, precision),
 
   if (! (flags & FLAGS_LEFTADJUST))
     {
-      while (width-- > 0)
-	self->OutStream(self, CHAR_ADJUST);
+      TrioWritePadding(self, CHAR_ADJUST, width);
     }
 
-  while (length-- > 0)
+  if (flags & FLAGS_ALTERNATIVE)
     {
-      /* The ctype parameters must be an unsigned char (or EOF) */
-      ch = (int)((unsigned char)(*string++));
-      TrioWriteStringCharacter(self, ch, flags);
+      while (length > 0)
+	{
+	  /* Pass on runs of characters that need no escaping in bulk */
+	  run = TrioSpanPrintable(string, length);
+	  TrioWriteBlock(self, string, run);
+	  string += run;
+	  length -= run;
+	  if (length > 0)
+	    {
+	      ch = (int)((unsigned char)(*string++));
+	      TrioWriteStringCharacter(self, ch, flags);
+	      length--;
+	    }
+	}
+    }
+  else
+    {
+      TrioWriteBlock(self, string, length);
     }
 
   if (flags & FLAGS_LEFTADJUST)
     {
-      while (width-- > 0)
-	self->OutStream(self, CHAR_ADJUST);
+      TrioWritePadding(self, CHAR_ADJUST, width);
     }
 #if TRIO_FEATURE_QUOTE
   if (flags & FLAGS_QUOTE)
@@ -2892,8 +3680,7 @@ TRIO_ARGS5((self, wstring, flags, width, precision),
 
   if (! (flags & FLAGS_LEFTADJUST))
     {
-      while (width-- > 0)
-	self->OutStream(self, CHAR_ADJUST);
+      TrioWritePadding(self, CHAR_ADJUST, width);
     }
 
   while (length > 0)
@@ -2906,8 +3693,7 @@ TRIO_ARGS5((self, wstring, flags, width, precision),
 
   if (flags & FLAGS_LEFTADJUST)
     {
-      while (width-- > 0)
-	self->OutStream(self, CHAR_ADJUST);
+      TrioWritePadding(self, CHAR_ADJUST, width);
     }
 #if TRIO_FEATURE_QUOTE
   if (flags & FLAGS_QUOTE)
@@ -2917,2018 +3703,3953 @@ TRIO_ARGS5((self, wstring, flags, width, precision),
 #endif /* TRIO_FEATURE_WIDECHAR */
 
 /*************************************************************************
- * TrioWriteDouble
- *
- * http://wwwold.dkuug.dk/JTC1/SC22/WG14/www/docs/dr_211.htm
- *
- * "5.2.4.2.2 paragraph #4
- *
- *  The accuracy [...] is implementation defined, as is the accuracy
- *  of the conversion between floating-point internal representations
- *  and string representations performed by the library routine in
- *  <stdio.h>"
- */
-/* FIXME: handle all instances of constant long-double number (L)
- *   and *l() math functions.
+ * TrioBignumAssign
  */
 #if TRIO_FEATURE_FLOAT
 static void
-TrioWriteDouble
-TRIO_ARGS6((self, number, flags, width, precision, base),
-	   trio_class_t *self,
-	   trio_long_double_t number,
-	   trio_flags_t flags,
-	   int width,
-	   int precision,
-	   int base)
+TrioBignumAssign
+TRIO_ARGS2((self, value),
+	   trio_bignum_t *self,
+	   unsigned int value)
 {
-  trio_long_double_t integerNumber;
-  trio_long_double_t fractionNumber;
-  trio_long_double_t workNumber;
-  int integerDigits;
-  int fractionDigits;
-  int exponentDigits;
-  int workDigits;
-  int baseDigits;
-  int integerThreshold;
-  int fractionThreshold;
-  int expectedWidth;
-  int exponent = 0;
-  unsigned int uExponent = 0;
-  int exponentBase;
-  trio_long_double_t dblBase;
-  trio_long_double_t dblFractionBase;
-  trio_long_double_t integerAdjust;
-  trio_long_double_t fractionAdjust;
-  trio_long_double_t workFractionNumber;
-  trio_long_double_t workFractionAdjust;
-  int fractionDigitsInspect;
-  BOOLEAN_T isNegative;
-  BOOLEAN_T isExponentNegative = FALSE;
-  BOOLEAN_T requireTwoDigitExponent;
-  BOOLEAN_T isHex;
-  TRIO_CONST char *digits;
-# if TRIO_FEATURE_QUOTE
-  char *groupingPointer;
-# endif
+  assert(value <= 0xFFFF);
+
+  self->limb[0] = value;
+  self->length = (value == 0) ? 0 : 1;
+}
+
+/*************************************************************************
+ * TrioBignumMultiply
+ */
+static void
+TrioBignumMultiply
+TRIO_ARGS2((self, factor),
+	   trio_bignum_t *self,
+	   unsigned int factor)
+{
+  unsigned long carry = 0;
   int i;
-  int offset;
-  BOOLEAN_T hasOnlyZeroes;
-  int leadingFractionZeroes = -1;
-  int trailingZeroes;
-  BOOLEAN_T keepTrailingZeroes;
-  BOOLEAN_T keepDecimalPoint;
-  trio_long_double_t epsilon;
-  trio_long_double_t epsilonCorrection;
-  BOOLEAN_T adjustNumber = FALSE;
 
-  assert(VALID(self));
-  assert(VALID(self->OutStream));
-  assert(((base >= MIN_BASE) && (base <= MAX_BASE)) || (base == NO_BASE));
+  assert(factor <= 0xFFFF);
 
-  /* Determine sign and look for special quantities */
-  switch (trio_fpclassify_and_signbit(number, &isNegative))
+  for (i = 0; i < self->length; i++)
     {
-    case TRIO_FP_NAN:
-      TrioWriteString(self,
-		      (flags & FLAGS_UPPER)
-		      ? NAN_UPPER
-		      : NAN_LOWER,
-		      flags, width, precision);
-      return;
+      carry += (unsigned long)self->limb[i] * factor;
+      self->limb[i] = (unsigned int)(carry & 0xFFFF);
+      carry >>= 16;
+    }
+  if (carry != 0)
+    {
+      assert(self->length < MAX_BIGNUM_LIMBS);
+      self->limb[self->length++] = (unsigned int)carry;
+    }
+}
 
-    case TRIO_FP_INFINITE:
-      if (isNegative)
-	{
-	  /* Negative infinity */
-	  TrioWriteString(self,
-			  (flags & FLAGS_UPPER)
-			  ? "-" INFINITE_UPPER
-			  : "-" INFINITE_LOWER,
-			  flags, width, precision);
-	  return;
-	}
-      else
-	{
-	  /* Positive infinity */
-	  TrioWriteString(self,
-			  (flags & FLAGS_UPPER)
-			  ? INFINITE_UPPER
-			  : INFINITE_LOWER,
-			  flags, width, precision);
-	  return;
-	}
+/*************************************************************************
+ * TrioBignumShift
+ *
+ * Description:
+ *  Multiply by 2^bits
+ */
+static void
+TrioBignumShift
+TRIO_ARGS2((self, bits),
+	   trio_bignum_t *self,
+	   int bits)
+{
+  int words = bits / 16;
+  int i;
 
-    default:
-      /* Finitude */
-      break;
-    }
+  if (self->length == 0)
+    return;
 
-  /* Normal numbers */
-  if (flags & FLAGS_LONGDOUBLE)
+  TrioBignumMultiply(self, 1U << (bits % 16));
+  if (words > 0)
     {
-      baseDigits = (base == 10)
-	? LDBL_DIG
-	: (int)trio_floor(LDBL_MANT_DIG / TrioLogarithmBase(base));
-      epsilon = LDBL_EPSILON;
+      assert(self->length + words <= MAX_BIGNUM_LIMBS);
+      for (i = self->length - 1; i >= 0; i--)
+	self->limb[i + words] = self->limb[i];
+      for (i = 0; i < words; i++)
+	self->limb[i] = 0;
+      self->length += words;
     }
-  else if (flags & FLAGS_SHORT)
+}
+
+/*************************************************************************
+ * TrioBignumPower
+ *
+ * Description:
+ *  Multiply by 10^exponent
+ */
+static void
+TrioBignumPower
+TRIO_ARGS2((self, exponent),
+	   trio_bignum_t *self,
+	   int exponent)
+{
+  for (; exponent >= 4; exponent -= 4)
+    TrioBignumMultiply(self, 10000);
+  for (; exponent > 0; exponent--)
+    TrioBignumMultiply(self, 10);
+}
+
+/*************************************************************************
+ * TrioBignumAdd
+ */
+static void
+TrioBignumAdd
+TRIO_ARGS3((result, first, second),
+	   trio_bignum_t *result,
+	   TRIO_CONST trio_bignum_t *first,
+	   TRIO_CONST trio_bignum_t *second)
+{
+  unsigned long carry = 0;
+  int length;
+  int i;
+
+  length = (first->length > second->length) ? first->length : second->length;
+  for (i = 0; i < length; i++)
     {
-      baseDigits = (base == BASE_DECIMAL)
-	? FLT_DIG
-	: (int)trio_floor(FLT_MANT_DIG / TrioLogarithmBase(base));
-      epsilon = FLT_EPSILON;
+      if (i < first->length)
+	carry += first->limb[i];
+      if (i < second->length)
+	carry += second->limb[i];
+      result->limb[i] = (unsigned int)(carry & 0xFFFF);
+      carry >>= 16;
     }
-  else
+  if (carry != 0)
     {
-      baseDigits = (base == BASE_DECIMAL)
-	? DBL_DIG
-	: (int)trio_floor(DBL_MANT_DIG / TrioLogarithmBase(base));
-      epsilon = DBL_EPSILON;
+      assert(length < MAX_BIGNUM_LIMBS);
+      result->limb[length++] = (unsigned int)carry;
     }
+  result->length = length;
+}
 
-  digits = (flags & FLAGS_UPPER) ? internalDigitsUpper : internalDigitsLower;
-  isHex = (base == BASE_HEX);
-  if (base == NO_BASE)
-    base = BASE_DECIMAL;
-  dblBase = (trio_long_double_t)base;
-  /*
-   * Some log10() functions can "err by almost 3 ulps" according to
-   * http://www.cs.berkeley.edu/~wkahan/LOG10HAF.TXT
-   */
-  epsilonCorrection = 3 * epsilon;
-  keepTrailingZeroes = !( (flags & FLAGS_ROUNDING) ||
-			  ( (flags & FLAGS_FLOAT_G) &&
-			    !(flags & FLAGS_ALTERNATIVE) ) );
-
-# if TRIO_FEATURE_ROUNDING
-  if (flags & FLAGS_ROUNDING)
-    {
-      precision = baseDigits;
-    }
-# endif
+/*************************************************************************
+ * TrioBignumSubtract
+ *
+ * Description:
+ *  Subtract second from self. Second must not be larger than self.
+ */
+static void
+TrioBignumSubtract
+TRIO_ARGS2((self, second),
+	   trio_bignum_t *self,
+	   TRIO_CONST trio_bignum_t *second)
+{
+  long borrow = 0;
+  int i;
 
-  if (precision == NO_PRECISION)
+  for (i = 0; i < self->length; i++)
     {
-      if (isHex)
+      borrow += (long)self->limb[i];
+      if (i < second->length)
+	borrow -= (long)second->limb[i];
+      if (borrow < 0)
 	{
-	  keepTrailingZeroes = FALSE;
-	  precision = FLT_MANT_DIG;
+	  self->limb[i] = (unsigned int)(borrow + 0x10000L);
+	  borrow = -1;
 	}
       else
 	{
-	  precision = FLT_DIG;
+	  self->limb[i] = (unsigned int)borrow;
+	  borrow = 0;
 	}
     }
+  while ((self->length > 0) && (self->limb[self->length - 1] == 0))
+    self->length--;
+}
 
-  if (isNegative)
+/*************************************************************************
+ * TrioBignumCompare
+ */
+static int
+TrioBignumCompare
+TRIO_ARGS2((first, second),
+	   TRIO_CONST trio_bignum_t *first,
+	   TRIO_CONST trio_bignum_t *second)
+{
+  int i;
+
+  if (first->length != second->length)
+    return (first->length < second->length) ? -1 : 1;
+  for (i = first->length - 1; i >= 0; i--)
     {
-      number = -number;
+      if (first->limb[i] != second->limb[i])
+	return (first->limb[i] < second->limb[i]) ? -1 : 1;
     }
+  return 0;
+}
 
-  if (isHex)
+/*************************************************************************
+ * TrioBignumCompareSum
+ *
+ * Description:
+ *  Compare first + second with third
+ */
+static int
+TrioBignumCompareSum
+TRIO_ARGS3((first, second, third),
+	   TRIO_CONST trio_bignum_t *first,
+	   TRIO_CONST trio_bignum_t *second,
+	   TRIO_CONST trio_bignum_t *third)
+{
+  trio_bignum_t sum;
+
+  TrioBignumAdd(&sum, first, second);
+  return TrioBignumCompare(&sum, third);
+}
+
+/*************************************************************************
+ * TrioBignumFromDouble
+ *
+ * Description:
+ *  Store the mantissa of a positive number, and return the binary
+ *  exponent, so that number = self * 2^exponent
+ */
+static int
+TrioBignumFromDouble
+TRIO_ARGS2((self, number),
+	   trio_bignum_t *self,
+	   double number)
+{
+  double fraction;
+  int exponent;
+  int i;
+
+  fraction = frexp(number, &exponent);
+  exponent -= 64;
+  for (i = 3; i >= 0; i--)
     {
-      flags |= FLAGS_FLOAT_E;
+      fraction *= 65536.0;
+      self->limb[i] = (unsigned int)fraction;
+      fraction -= (double)self->limb[i];
+    }
+  self->length = 4;
+  /* Drop the trailing zero limbs */
+  while ((self->length > 1) && (self->limb[0] == 0))
+    {
+      for (i = 1; i < self->length; i++)
+	self->limb[i - 1] = self->limb[i];
+      self->length--;
+      exponent += 16;
     }
+  return exponent;
+}
 
- reprocess:
+/*************************************************************************
+ * TrioBignumDivide
+ *
+ * Description:
+ *  Divide by a small divisor and return the remainder
+ */
+static unsigned int
+TrioBignumDivide
+TRIO_ARGS2((self, divisor),
+	   trio_bignum_t *self,
+	   unsigned int divisor)
+{
+  unsigned long remainder = 0;
+  int i;
 
-  if (flags & FLAGS_FLOAT_G)
+  assert((divisor > 0) && (divisor <= 0xFFFF));
+
+  for (i = self->length - 1; i >= 0; i--)
     {
-      if (precision == 0)
-	precision = 1;
+      remainder = (remainder << 16) | self->limb[i];
+      self->limb[i] = (unsigned int)(remainder / divisor);
+      remainder %= divisor;
+    }
+  while ((self->length > 0) && (self->limb[self->length - 1] == 0))
+    self->length--;
+  return (unsigned int)remainder;
+}
 
-      if ( (number < TRIO_SUFFIX_LONG(1.0E-4)) ||
-	   (number >= TrioPower(base, (trio_long_double_t)precision)) )
-	{
-	  /* Use scientific notation */
-	  flags |= FLAGS_FLOAT_E;
-	}
-      else if (number < 1.0)
-	{
-	  /*
-	   * Use normal notation. If the integer part of the number is
-	   * zero, then adjust the precision to include leading fractional
-	   * zeros.
-	   */
-	  workNumber = TrioLogarithm(number, base);
-	  workNumber = TRIO_FABS(workNumber);
-	  if (workNumber - trio_floor(workNumber) < epsilon)
-	    workNumber--;
-	  leadingFractionZeroes = (int)trio_floor(workNumber);
-	}
+/*************************************************************************
+ * TrioBignumShiftRight
+ *
+ * Description:
+ *  Divide by 2^bits and return whether any of the discarded bits were set
+ */
+static BOOLEAN_T
+TrioBignumShiftRight
+TRIO_ARGS2((self, bits),
+	   trio_bignum_t *self,
+	   int bits)
+{
+  int words = bits / 16;
+  int i;
+  BOOLEAN_T isInexact = FALSE;
+
+  if (words >= self->length)
+    {
+      isInexact = (self->length > 0);
+      self->length = 0;
+      return isInexact;
+    }
+  for (i = 0; i < words; i++)
+    {
+      if (self->limb[i] != 0)
+	isInexact = TRUE;
     }
+  for (i = words; i < self->length; i++)
+    self->limb[i - words] = self->limb[i];
+  self->length -= words;
 
-  if (flags & FLAGS_FLOAT_E)
+  bits %= 16;
+  if (bits > 0)
     {
-      /* Scale the number */
-      workNumber = TrioLogarithm(number, base);
-      if (trio_isinf(workNumber) == -1)
-	{
-	  exponent = 0;
-	  /* Undo setting */
-	  if (flags & FLAGS_FLOAT_G)
-	    flags &= ~FLAGS_FLOAT_E;
-	}
-      else
+      if (self->limb[0] & ((1U << bits) - 1))
+	isInexact = TRUE;
+      for (i = 0; i < self->length; i++)
 	{
-	  exponent = (int)trio_floor(workNumber + epsilonCorrection);
-	  workNumber = number;
-	  /*
-           * We want to apply A / 10^B but the equivalent A * 10^-B gives better
-           * accuracy on platforms with true long double support.
-	   */
-#if defined(TRIO_DOUBLE_DOUBLE)
-	  workNumber /= TrioPower(dblBase, (trio_long_double_t)exponent);
-#else
-	  workNumber *= TrioPower(dblBase, (trio_long_double_t)-exponent);
-#endif
-	  if (trio_isinf(workNumber)) {
-	    /*
-	     * Scaling is done it two steps to avoid problems with subnormal
-	     * numbers.
-	     */
-	    workNumber /= TrioPower(dblBase, (trio_long_double_t)(exponent / 2));
-	    workNumber /= TrioPower(dblBase, (trio_long_double_t)(exponent - (exponent / 2)));
-	  }
-	  number = workNumber;
-	  isExponentNegative = (exponent < 0);
-	  uExponent = (isExponentNegative) ? -exponent : exponent;
-	  if (isHex)
-	    uExponent *= 4; /* log16(2) */
-#if TRIO_FEATURE_QUOTE
-	  /* No thousand separators */
-	  flags &= ~FLAGS_QUOTE;
-#endif
+	  self->limb[i] >>= bits;
+	  if (i + 1 < self->length)
+	    self->limb[i] |= (self->limb[i + 1] << (16 - bits)) & 0xFFFF;
 	}
+      while ((self->length > 0) && (self->limb[self->length - 1] == 0))
+	self->length--;
     }
+  return isInexact;
+}
 
-  integerNumber = trio_floor(number + epsilonCorrection);
-  fractionNumber = number - integerNumber;
+/*************************************************************************
+ * TrioBignumRound
+ *
+ * Description:
+ *  Calculate mantissa * 2^exponent * 10^scale rounded half to even
+ */
+static void
+TrioBignumRound
+TRIO_ARGS4((self, mantissa, exponent, scale),
+	   trio_bignum_t *self,
+	   TRIO_CONST trio_bignum_t *mantissa,
+	   int exponent,
+	   int scale)
+{
+  static TRIO_CONST unsigned int powers[] = { 1, 10, 100, 1000, 10000 };
+  trio_bignum_t one;
+  BOOLEAN_T isInexact = FALSE;
+  BOOLEAN_T isHalf;
 
-  /*
-   * Truncated number.
-   *
-   * Precision is number of significant digits for FLOAT_G and number of
-   * fractional digits for others.
-   */
-  integerDigits = 1;
-  if (integerNumber > epsilon)
+  /* Keep one extra binary digit for rounding */
+  *self = *mantissa;
+  TrioBignumShift(self, 1 + ((exponent > 0) ? exponent : 0));
+  if (scale > 0)
+    TrioBignumPower(self, scale);
+  for (; scale < 0; scale += 4)
     {
-      integerDigits += (int)(TrioLogarithm(integerNumber, base) + epsilonCorrection);
+      if (TrioBignumDivide(self, powers[(scale > -4) ? -scale : 4]) != 0)
+	isInexact = TRUE;
     }
+  if ((exponent < 0) && TrioBignumShiftRight(self, -exponent))
+    isInexact = TRUE;
 
-  fractionDigits = precision;
-  if (flags & FLAGS_FLOAT_G)
+  isHalf = (self->length > 0) && (self->limb[0] & 1);
+  (void)TrioBignumShiftRight(self, 1);
+  if (isHalf && (isInexact || ((self->length > 0) && (self->limb[0] & 1))))
     {
-      if (leadingFractionZeroes > 0)
-	{
-	  fractionDigits += leadingFractionZeroes;
-	}
-      if ((integerNumber > epsilon) || (number <= epsilon))
-	{
-	  fractionDigits -= integerDigits;
-	}
+      TrioBignumAssign(&one, 1);
+      TrioBignumAdd(self, self, &one);
     }
+}
 
-  dblFractionBase = TrioPower(base, fractionDigits);
+/*************************************************************************
+ * TrioBignumDigits
+ *
+ * Description:
+ *  Convert to decimal digits. The number is destroyed.
+ */
+static int
+TrioBignumDigits
+TRIO_ARGS2((self, digits),
+	   trio_bignum_t *self,
+	   char *digits)
+{
+  char reversed[MAX_DECIMAL_BUFFER];
+  unsigned int group;
+  int count = 0;
+  int i;
 
-  if (integerNumber < 1.0)
+  do
     {
-      workNumber = number * dblFractionBase + TRIO_SUFFIX_LONG(0.5);
-      if (trio_floor(number * dblFractionBase) != trio_floor(workNumber))
+      group = TrioBignumDivide(self, 10000);
+      for (i = 0; i < 4; i++)
 	{
-	  adjustNumber = TRUE;
-	  /* Remove a leading fraction zero if fraction is rounded up */
-	  if ((int)(TrioLogarithm(number * dblFractionBase, base) + epsilonCorrection) !=
-              (int)(TrioLogarithm(workNumber, base) + epsilonCorrection))
-	    {
-	      --leadingFractionZeroes;
-	    }
+	  reversed[count++] = (char)('0' + group % 10);
+	  group /= 10;
 	}
-      workNumber /= dblFractionBase;
+    }
+  while (self->length > 0);
+
+  /* Remove leading zeroes */
+  while ((count > 1) && (reversed[count - 1] == '0'))
+    count--;
+  for (i = 0; i < count; i++)
+    digits[i] = reversed[count - 1 - i];
+  return count;
+}
+#endif /* TRIO_FEATURE_FLOAT */
+
+/*************************************************************************
+ * TrioShortestDigits
+ *
+ * Description:
+ *  Generate the fewest decimal digits that read back as the positive
+ *  finite number in a floating-point type with mantissaDigits binary
+ *  digits and minimum exponent minExponent (as returned by frexp.)
+ *  Returns the number of digits, and stores the position of the decimal
+ *  point relative to the first digit in decimalExponent.
+ *
+ *  This is the free-format algorithm of Steele & White, as presented
+ *  by Burger & Dybvig in "Printing Floating-Point Numbers Quickly and
+ *  Accurately", using exact integer arithmetic throughout.
+ */
+#if TRIO_FEATURE_SHORTEST
+static int
+TrioShortestDigits
+TRIO_ARGS5((number, mantissaDigits, minExponent, digits, decimalExponent),
+	   double number,
+	   int mantissaDigits,
+	   int minExponent,
+	   char *digits,
+	   int *decimalExponent)
+{
+  trio_bignum_t remainder;
+  trio_bignum_t scale;
+  trio_bignum_t marginHigh;
+  trio_bignum_t marginLow;
+  double fraction;
+  double estimate;
+  int exponent;
+  int fractionExponent;
+  int unitExponent;
+  int shift;
+  int bit;
+  int k;
+  int count;
+  int digit;
+  int i;
+  BOOLEAN_T isEven;
+  BOOLEAN_T isLowCloser;
+  BOOLEAN_T low;
+  BOOLEAN_T high;
+
+  /*
+   * number = remainder * 2^fractionExponent, where remainder holds the
+   * mantissa in 64 bits, and the neighbours are 2^unitExponent away.
+   */
+  fraction = frexp(number, &exponent);
+  isLowCloser = ((fraction == 0.5) && (exponent > minExponent));
+  remainder.length = 4;
+  for (i = 3; i >= 0; i--)
+    {
+      fraction *= 65536.0;
+      remainder.limb[i] = (unsigned int)fraction;
+      fraction -= (double)remainder.limb[i];
+    }
+  while ((remainder.length > 0) && (remainder.limb[remainder.length - 1] == 0))
+    remainder.length--;
+  fractionExponent = exponent - 64;
+  unitExponent = ((exponent > minExponent) ? exponent : minExponent) - mantissaDigits;
+
+  /* Reading rounds half to even, so even mantissas include the midpoints */
+  bit = unitExponent - fractionExponent;
+  isEven = (((remainder.limb[bit / 16] >> (bit % 16)) & 1) == 0);
+
+  /*
+   * Scale by 2^shift to get integers, so that remainder / scale is the
+   * number, and the margins / scale are half the distances to the
+   * neighbours.
+   */
+  shift = (unitExponent - 2 < fractionExponent) ? unitExponent - 2 : fractionExponent;
+  shift = (shift < 0) ? -shift : 0;
+  TrioBignumShift(&remainder, fractionExponent + shift);
+  TrioBignumAssign(&scale, 1);
+  TrioBignumShift(&scale, shift);
+  TrioBignumAssign(&marginHigh, 1);
+  TrioBignumShift(&marginHigh, unitExponent - 1 + shift);
+  TrioBignumAssign(&marginLow, 1);
+  TrioBignumShift(&marginLow, unitExponent - ((isLowCloser) ? 2 : 1) + shift);
+
+  /* Estimate the decimal exponent from below and correct it */
+  estimate = (exponent - 1) * 0.30102999566398119521 - 1.0E-10;
+  k = (int)estimate;
+  if ((double)k < estimate)
+    k++;
+  if (k >= 0)
+    {
+      TrioBignumPower(&scale, k);
     }
   else
     {
-      workNumber = number + TRIO_SUFFIX_LONG(0.5) / dblFractionBase;
-      adjustNumber = (trio_floor(number) != trio_floor(workNumber));
+      TrioBignumPower(&remainder, -k);
+      TrioBignumPower(&marginHigh, -k);
+      TrioBignumPower(&marginLow, -k);
     }
-  if (adjustNumber)
+  for (;;)
     {
-      if ((flags & FLAGS_FLOAT_G) && !(flags & FLAGS_FLOAT_E))
-	{
-	  /* The adjustment may require a change to scientific notation */
-	  if ( (workNumber < TRIO_SUFFIX_LONG(1.0E-4)) ||
-	       (workNumber >= TrioPower(base, (trio_long_double_t)precision)) )
-	    {
-	      /* Use scientific notation */
-	      flags |= FLAGS_FLOAT_E;
-	      goto reprocess;
-	    }
-	}
+      i = TrioBignumCompareSum(&remainder, &marginHigh, &scale);
+      if ((isEven) ? (i < 0) : (i <= 0))
+	break;
+      TrioBignumMultiply(&scale, 10);
+      k++;
+    }
+  *decimalExponent = k;
 
-      if (flags & FLAGS_FLOAT_E)
-	{
-	  workDigits = 1 + (TrioLogarithm(trio_floor(workNumber), base) + epsilonCorrection);
-	  if (integerDigits == workDigits)
-	    {
-	      /* Adjust if the same number of digits are used */
-	      number += TRIO_SUFFIX_LONG(0.5) / dblFractionBase;
-	      integerNumber = trio_floor(number);
-	      fractionNumber = number - integerNumber;
-	    }
-	  else
-	    {
-	      /* Adjust if number was rounded up one digit (ie. 0.99 to 1.00) */
-	      exponent++;
-	      isExponentNegative = (exponent < 0);
-	      uExponent = (isExponentNegative) ? -exponent : exponent;
-	      if (isHex)
-		uExponent *= 4; /* log16(2) */
-	      workNumber = (number + TRIO_SUFFIX_LONG(0.5) / dblFractionBase) / dblBase;
-	      integerNumber = trio_floor(workNumber);
-	      fractionNumber = workNumber - integerNumber;
-	    }
-	}
-      else
+  /* Generate digits until the rest is within the margins */
+  for (count = 0; ; count++)
+    {
+      TrioBignumMultiply(&remainder, 10);
+      TrioBignumMultiply(&marginHigh, 10);
+      TrioBignumMultiply(&marginLow, 10);
+      for (digit = 0; TrioBignumCompare(&remainder, &scale) >= 0; digit++)
+	TrioBignumSubtract(&remainder, &scale);
+
+      i = TrioBignumCompare(&remainder, &marginLow);
+      low = (isEven) ? (i <= 0) : (i < 0);
+      i = TrioBignumCompareSum(&remainder, &marginHigh, &scale);
+      high = (isEven) ? (i >= 0) : (i > 0);
+      if (high)
 	{
-	  if (workNumber > 1.0)
+	  if (low)
 	    {
-	      /* Adjust if number was rounded up one digit (ie. 99 to 100) */
-	      integerNumber = trio_floor(workNumber);
-	      fractionNumber = 0.0;
-	      integerDigits = (integerNumber > epsilon)
-		? 1 + (int)(TrioLogarithm(integerNumber, base) + epsilonCorrection)
-		: 1;
-	      if (flags & FLAGS_FLOAT_G)
-		{
-		  if (flags & FLAGS_ALTERNATIVE)
-		    {
-		      fractionDigits = precision;
-		      if ((integerNumber > epsilon) || (number <= epsilon))
-			{
-			  fractionDigits -= integerDigits;
-			}
-		    }
-		  else
-		    {
-		      fractionDigits = 0;
-		    }
-		}
+	      /* Both digits read back correctly, so use the nearest */
+	      i = TrioBignumCompareSum(&remainder, &remainder, &scale);
+	      if ((i > 0) || ((i == 0) && (digit & 1)))
+		digit++;
 	    }
 	  else
 	    {
-	      integerNumber = trio_floor(workNumber);
-	      fractionNumber = workNumber - integerNumber;
-	      if (flags & FLAGS_FLOAT_G)
-		{
-		  if (flags & FLAGS_ALTERNATIVE)
-		    {
-		      fractionDigits = precision;
-		      if (leadingFractionZeroes > 0)
-			{
-			  fractionDigits += leadingFractionZeroes;
-			}
-		      if ((integerNumber > epsilon) || (number <= epsilon))
-			{
-			  fractionDigits -= integerDigits;
-			}
-		    }
-		}
+	      digit++;
 	    }
 	}
+      assert(digit < 10);
+      digits[count] = (char)('0' + digit);
+      if (low || high)
+	break;
     }
+  return count + 1;
+}
+#endif /* TRIO_FEATURE_SHORTEST */
 
-  /* Estimate accuracy */
-  integerAdjust = fractionAdjust = TRIO_SUFFIX_LONG(0.5);
-# if TRIO_FEATURE_ROUNDING
-  if (flags & FLAGS_ROUNDING)
-    {
-      if (integerDigits > baseDigits)
-	{
-	  integerThreshold = baseDigits;
-	  fractionDigits = 0;
-	  dblFractionBase = 1.0;
-	  fractionThreshold = 0;
-	  precision = 0; /* Disable decimal-point */
-	  integerAdjust = TrioPower(base, integerDigits - integerThreshold - 1);
-	  fractionAdjust = 0.0;
-	}
-      else
-	{
-	  integerThreshold = integerDigits;
-	  fractionThreshold = fractionDigits - integerThreshold;
-	  fractionAdjust = 1.0;
-	}
-    }
-  else
-# endif
+/*************************************************************************
+ * TrioCopyDecimalPoint
+ */
+#if TRIO_FEATURE_FLOAT
+static int
+TrioCopyDecimalPoint
+TRIO_ARGS2((locale, target),
+	   TRIO_CONST trio_locale_t *locale,
+	   char *target)
+{
+  int i;
+
+  if (locale->decimalPoint)
     {
-      integerThreshold = INT_MAX;
-      fractionThreshold = INT_MAX;
+      *target = locale->decimalPoint;
+      return 1;
     }
+  for (i = 0; i < locale->decimalPointLength; i++)
+    target[i] = locale->decimalPointString[i];
+  return locale->decimalPointLength;
+}
+#endif /* TRIO_FEATURE_FLOAT */
 
-  /*
-   * Calculate expected width.
-   *  sign + integer part + thousands separators + decimal point
-   *  + fraction + exponent
-   */
-  fractionAdjust /= dblFractionBase;
-  hasOnlyZeroes = (trio_floor((fractionNumber + fractionAdjust) *
-			       dblFractionBase) < epsilon);
-  keepDecimalPoint = ( (flags & FLAGS_ALTERNATIVE) ||
-		       !((precision == 0) ||
-			 (!keepTrailingZeroes && hasOnlyZeroes)) );
+/*************************************************************************
+ * TrioWriteDecimal
+ *
+ * Description:
+ *  Write the formatted digits of a number with sign and padding
+ */
+#if TRIO_FEATURE_FLOAT
+static void
+TrioWriteDecimal
+TRIO_ARGS6((self, buffer, length, isNegative, flags, width),
+	   trio_class_t *self,
+	   TRIO_CONST char *buffer,
+	   int length,
+	   BOOLEAN_T isNegative,
+	   trio_flags_t flags,
+	   int width)
+{
+  char sign = NIL;
 
-  expectedWidth = integerDigits + fractionDigits;
+  if (isNegative)
+    sign = '-';
+  else if (flags & FLAGS_SHOWSIGN)
+    sign = '+';
+  else if (flags & FLAGS_SPACE)
+    sign = ' ';
 
-  if (!keepTrailingZeroes)
+  width -= length + ((sign == NIL) ? 0 : 1);
+  if (!(flags & FLAGS_LEFTADJUST) && !(flags & FLAGS_NILPADDING))
     {
-      trailingZeroes = 0;
-      workFractionNumber = fractionNumber;
-      workFractionAdjust = fractionAdjust;
-      fractionDigitsInspect = fractionDigits;
+      TrioWritePadding(self, CHAR_ADJUST, width);
+      width = 0;
+    }
+  if (sign != NIL)
+    self->OutStream(self, sign);
+  if (!(flags & FLAGS_LEFTADJUST))
+    {
+      TrioWritePadding(self, '0', width);
+      width = 0;
+    }
+  TrioWriteBlock(self, buffer, length);
+  TrioWritePadding(self, CHAR_ADJUST, width);
+}
+#endif /* TRIO_FEATURE_FLOAT */
 
-      if (integerDigits > integerThreshold)
-	{
-	  fractionDigitsInspect = 0;
-	}
-      else if (fractionThreshold  <= fractionDigits)
-	{
-	  fractionDigitsInspect = fractionThreshold + 1;
-	}
+/*************************************************************************
+ * TrioWriteShortest
+ *
+ * Description:
+ *  Write a non-negative finite number with the fewest digits that read
+ *  back as the same number. The number is narrowed to float if the
+ *  short modifier is given.
+ */
+#if TRIO_FEATURE_SHORTEST
+static void
+TrioWriteShortest
+TRIO_ARGS5((self, number, isNegative, flags, width),
+	   trio_class_t *self,
+	   double number,
+	   BOOLEAN_T isNegative,
+	   trio_flags_t flags,
+	   int width)
+{
+  char digits[DBL_DIG + 4];
+  char buffer[MAX_DECIMAL_BUFFER];
+  int count;
+  int exponent;
+  int maxExponent;
+  int length = 0;
+  int i;
+  BOOLEAN_T useExponent;
 
-      trailingZeroes = fractionDigits - fractionDigitsInspect;
-      for (i = 0; i < fractionDigitsInspect; i++)
+  if (flags & FLAGS_SHORT)
+    {
+      if (number > FLT_MAX)
 	{
-	  workFractionNumber *= dblBase;
-	  workFractionAdjust *= dblBase;
-	  workNumber = trio_floor(workFractionNumber + workFractionAdjust);
-	  workFractionNumber -= workNumber;
-	  offset = (int)trio_fmod(workNumber, dblBase);
-	  if (offset == 0)
-	    {
-	      trailingZeroes++;
-	    }
-	  else
-	    {
-	      trailingZeroes = 0;
-	    }
+	  /* Overflows float */
+	  TrioWriteString(self,
+			  (flags & FLAGS_UPPER)
+			  ? ((isNegative) ? "-" INFINITE_UPPER : INFINITE_UPPER)
+			  : ((isNegative) ? "-" INFINITE_LOWER : INFINITE_LOWER),
+			  flags, width, NO_PRECISION);
+	  return;
 	}
-      expectedWidth -= trailingZeroes;
+      number = (double)(float)number;
+      maxExponent = FLT_DIG + 3;
     }
-
-  if (keepDecimalPoint)
+  else
     {
-      expectedWidth += internalDecimalPointLength;
+      maxExponent = DBL_DIG + 2;
     }
 
-#if TRIO_FEATURE_QUOTE
-  if (flags & FLAGS_QUOTE)
+  if (number == 0.0)
     {
-      expectedWidth += TrioCalcThousandSeparatorLength(integerDigits);
+      digits[0] = '0';
+      count = 1;
+      exponent = 0;
     }
-#endif
-
-  if (isNegative || (flags & FLAGS_SHOWSIGN) || (flags & FLAGS_SPACE))
+  else
     {
-      expectedWidth += sizeof("-") - 1;
+      count = (flags & FLAGS_SHORT)
+	? TrioShortestDigits(number, FLT_MANT_DIG, FLT_MIN_EXP, digits, &exponent)
+	: TrioShortestDigits(number, DBL_MANT_DIG, DBL_MIN_EXP, digits, &exponent);
+      /* Make it the exponent of the first digit */
+      exponent--;
     }
 
-  exponentDigits = 0;
-  if (flags & FLAGS_FLOAT_E)
+  if (flags & FLAGS_FLOAT_G)
+    useExponent = ((exponent < -4) || (exponent >= maxExponent));
+  else
+    useExponent = ((flags & FLAGS_FLOAT_E) != 0);
+
+  if (useExponent)
+    {
+      buffer[length++] = digits[0];
+      if ((count > 1) || (flags & FLAGS_ALTERNATIVE))
+	length += TrioCopyDecimalPoint(self->locale, &buffer[length]);
+      for (i = 1; i < count; i++)
+	buffer[length++] = digits[i];
+      buffer[length++] = (flags & FLAGS_UPPER) ? 'E' : 'e';
+      buffer[length++] = (exponent < 0) ? '-' : '+';
+      if (exponent < 0)
+	exponent = -exponent;
+      if (exponent >= 100)
+	buffer[length++] = (char)('0' + exponent / 100);
+      buffer[length++] = (char)('0' + (exponent / 10) % 10);
+      buffer[length++] = (char)('0' + exponent % 10);
+    }
+  else if (exponent < 0)
+    {
+      buffer[length++] = '0';
+      length += TrioCopyDecimalPoint(self->locale, &buffer[length]);
+      for (i = exponent + 1; i < 0; i++)
+	buffer[length++] = '0';
+      for (i = 0; i < count; i++)
+	buffer[length++] = digits[i];
+    }
+  else
     {
-      exponentDigits = (uExponent == 0)
-	? 1
-	: (int)trio_ceil(TrioLogarithm((double)(uExponent + 1),
-				       (isHex) ? 10 : base));
-    }
-  requireTwoDigitExponent = ((base == BASE_DECIMAL) && (exponentDigits == 1));
-  if (exponentDigits > 0)
-    {
-      expectedWidth += exponentDigits;
-      expectedWidth += (requireTwoDigitExponent
-			? sizeof("E+0") - 1
-			: sizeof("E+") - 1);
+      for (i = 0; i <= exponent; i++)
+	buffer[length++] = (i < count) ? digits[i] : '0';
+      if ((count > exponent + 1) || (flags & FLAGS_ALTERNATIVE))
+	length += TrioCopyDecimalPoint(self->locale, &buffer[length]);
+      for (; i < count; i++)
+	buffer[length++] = digits[i];
     }
 
-  if (isHex)
-    {
-      expectedWidth += sizeof("0X") - 1;
-    }
+  TrioWriteDecimal(self, buffer, length, isNegative, flags, width);
+}
+#endif /* TRIO_FEATURE_SHORTEST */
 
-  /* Output prefixing */
-  if (flags & FLAGS_NILPADDING)
-    {
-      /* Leading zeros must be after sign */
-      if (isNegative)
-	self->OutStream(self, '-');
-      else if (flags & FLAGS_SHOWSIGN)
-	self->OutStream(self, '+');
-      else if (flags & FLAGS_SPACE)
-	self->OutStream(self, ' ');
-      if (isHex)
-	{
-	  self->OutStream(self, '0');
-	  self->OutStream(self, (flags & FLAGS_UPPER) ? 'X' : 'x');
-	}
-      if (!(flags & FLAGS_LEFTADJUST))
-	{
-	  for (i = expectedWidth; i < width; i++)
-	    {
-	      self->OutStream(self, '0');
-	    }
-	}
-    }
-  else
-    {
-      /* Leading spaces must be before sign */
-      if (!(flags & FLAGS_LEFTADJUST))
-	{
-	  for (i = expectedWidth; i < width; i++)
-	    {
-	      self->OutStream(self, CHAR_ADJUST);
-	    }
-	}
-      if (isNegative)
-	self->OutStream(self, '-');
-      else if (flags & FLAGS_SHOWSIGN)
-	self->OutStream(self, '+');
-      else if (flags & FLAGS_SPACE)
-	self->OutStream(self, ' ');
-      if (isHex)
-	{
-	  self->OutStream(self, '0');
-	  self->OutStream(self, (flags & FLAGS_UPPER) ? 'X' : 'x');
-	}
-    }
+/*************************************************************************
+ * TrioWriteExact
+ *
+ * Description:
+ *  Write a non-negative finite double in decimal fixed or scientific
+ *  notation with correctly rounded digits. The digits are calculated
+ *  exactly with integer arithmetic, and rounded half to even.
+ */
+#if TRIO_FEATURE_FLOAT
+static void
+TrioWriteExact
+TRIO_ARGS6((self, number, isNegative, flags, width, precision),
+	   trio_class_t *self,
+	   double number,
+	   BOOLEAN_T isNegative,
+	   trio_flags_t flags,
+	   int width,
+	   int precision)
+{
+  trio_bignum_t mantissa;
+  trio_bignum_t work;
+  trio_bignum_t limit;
+  char digits[MAX_DECIMAL_BUFFER];
+  char buffer[MAX_DECIMAL_BUFFER];
+  int binaryExponent = 0;
+  int exponent;
+  int count;
+  int fractionDigits;
+  int length = 0;
+  int i;
+  BOOLEAN_T useExponent;
 
-  /* Output the integer part and thousand separators */
-  for (i = 0; i < integerDigits; i++)
+  if (number != 0.0)
+    binaryExponent = TrioBignumFromDouble(&mantissa, number);
+
+  if (flags & (FLAGS_FLOAT_E | FLAGS_FLOAT_G))
     {
-      workNumber = trio_floor(((integerNumber + integerAdjust)
-			       / TrioPower(base, integerDigits - i - 1)));
-      if (i > integerThreshold)
+      /* Significant digits */
+      if (flags & FLAGS_FLOAT_G)
 	{
-	  /* Beyond accuracy */
-	  self->OutStream(self, digits[0]);
+	  if (precision == 0)
+	    precision = 1;
 	}
       else
 	{
-	  self->OutStream(self, digits[(int)trio_fmod(workNumber, dblBase)]);
-	}
-
-#if TRIO_FEATURE_QUOTE
-      if (((flags & (FLAGS_FLOAT_E | FLAGS_QUOTE)) == FLAGS_QUOTE)
-	  && TrioFollowedBySeparator(integerDigits - i))
-	{
-	  for (groupingPointer = internalThousandSeparator;
-	       *groupingPointer != NIL;
-	       groupingPointer++)
-	    {
-	      self->OutStream(self, *groupingPointer);
-	    }
+	  precision++;
 	}
-#endif
-    }
-
-  /* Insert decimal point and build the fraction part */
-  trailingZeroes = 0;
 
-  if (keepDecimalPoint)
-    {
-      if (internalDecimalPoint)
+      if (number == 0.0)
 	{
-	  self->OutStream(self, internalDecimalPoint);
+	  digits[0] = '0';
+	  count = 1;
+	  exponent = 0;
 	}
       else
 	{
-	  for (i = 0; i < internalDecimalPointLength; i++)
+	  /* Estimate the exponent from below and correct it */
+	  (void)frexp(number, &exponent);
+	  exponent = (int)trio_floor((exponent - 1) * 0.30102999566398119521);
+	  TrioBignumAssign(&limit, 1);
+	  TrioBignumPower(&limit, precision);
+	  for (;;)
 	    {
-	      self->OutStream(self, internalDecimalPointString[i]);
+	      TrioBignumRound(&work, &mantissa, binaryExponent,
+			      precision - 1 - exponent);
+	      if (TrioBignumCompare(&work, &limit) < 0)
+		break;
+	      exponent++;
 	    }
+	  count = TrioBignumDigits(&work, digits);
 	}
-    }
 
-  for (i = 0; i < fractionDigits; i++)
-    {
-      if ((integerDigits > integerThreshold) || (i > fractionThreshold))
+      if (flags & FLAGS_FLOAT_G)
 	{
-	  /* Beyond accuracy */
-	  trailingZeroes++;
+	  /* Like TrioWriteDouble, small numbers are tested before rounding */
+	  useExponent = (((number != 0.0) && (number < 1.0E-4)) ||
+			 (exponent >= precision));
+	  fractionDigits = (useExponent) ? precision - 1 : precision - 1 - exponent;
+	  if (!(flags & FLAGS_ALTERNATIVE))
+	    {
+	      /* Remove trailing zeroes */
+	      while ((count > 1) && (digits[count - 1] == '0'))
+		count--;
+	      i = (useExponent) ? count - 1 : count - 1 - exponent;
+	      if (i < fractionDigits)
+		fractionDigits = (i < 0) ? 0 : i;
+	    }
 	}
       else
 	{
-	  fractionNumber *= dblBase;
-	  fractionAdjust *= dblBase;
-	  workNumber = trio_floor(fractionNumber + fractionAdjust);
-	  if (workNumber > fractionNumber)
-	    {
-	      /* fractionNumber should never become negative */
-	      fractionNumber = 0.0;
-	      fractionAdjust = 0.0;
-	    }
-	  else
-	    {
-	      fractionNumber -= workNumber;
-	    }
-	  offset = (int)trio_fmod(workNumber, dblBase);
-	  if (offset == 0)
-	    {
-	      trailingZeroes++;
-	    }
-	  else
-	    {
-	      while (trailingZeroes > 0)
-		{
-		  /* Not trailing zeroes after all */
-		  self->OutStream(self, digits[0]);
-		  trailingZeroes--;
-		}
-	      self->OutStream(self, digits[offset]);
-	    }
+	  useExponent = TRUE;
+	  fractionDigits = precision - 1;
 	}
     }
-
-  if (keepTrailingZeroes)
+  else
     {
-      while (trailingZeroes > 0)
+      /* Fraction digits */
+      useExponent = FALSE;
+      fractionDigits = precision;
+      if (number == 0.0)
 	{
-	  self->OutStream(self, digits[0]);
-	  trailingZeroes--;
+	  digits[0] = '0';
+	  count = 1;
 	}
-    }
-
-  /* Output exponent */
-  if (exponentDigits > 0)
-    {
-      self->OutStream(self,
-		      isHex
-		      ? ((flags & FLAGS_UPPER) ? 'P' : 'p')
-		      : ((flags & FLAGS_UPPER) ? 'E' : 'e'));
-      self->OutStream(self, (isExponentNegative) ? '-' : '+');
-
-      /* The exponent must contain at least two digits */
-      if (requireTwoDigitExponent)
-        self->OutStream(self, '0');
-
-      if (isHex)
-	base = 10;
-      exponentBase = (int)TrioPower(base, exponentDigits - 1);
-      for (i = 0; i < exponentDigits; i++)
+      else
 	{
-	  self->OutStream(self, digits[(uExponent / exponentBase) % base]);
-	  exponentBase /= base;
+	  TrioBignumRound(&work, &mantissa, binaryExponent, precision);
+	  count = TrioBignumDigits(&work, digits);
 	}
+      exponent = count - 1 - precision;
+    }
+
+  /* digits[i] has the weight 10^(exponent - i) */
+  if (useExponent)
+    {
+      buffer[length++] = digits[0];
+      if ((fractionDigits > 0) || (flags & FLAGS_ALTERNATIVE))
+	length += TrioCopyDecimalPoint(self->locale, &buffer[length]);
+      for (i = 1; i <= fractionDigits; i++)
+	buffer[length++] = (i < count) ? digits[i] : '0';
+      buffer[length++] = (flags & FLAGS_UPPER) ? 'E' : 'e';
+      buffer[length++] = (exponent < 0) ? '-' : '+';
+      if (exponent < 0)
+	exponent = -exponent;
+      if (exponent >= 100)
+	buffer[length++] = (char)('0' + exponent / 100);
+      buffer[length++] = (char)('0' + (exponent / 10) % 10);
+      buffer[length++] = (char)('0' + exponent % 10);
     }
-  /* Output trailing spaces */
-  if (flags & FLAGS_LEFTADJUST)
+  else
     {
-      for (i = expectedWidth; i < width; i++)
-	{
-	  self->OutStream(self, CHAR_ADJUST);
-	}
+      if (exponent < 0)
+	buffer[length++] = '0';
+      for (i = 0; i <= exponent; i++)
+	buffer[length++] = (i < count) ? digits[i] : '0';
+      if ((fractionDigits > 0) || (flags & FLAGS_ALTERNATIVE))
+	length += TrioCopyDecimalPoint(self->locale, &buffer[length]);
+      for (i = exponent + 1; i <= exponent + fractionDigits; i++)
+	buffer[length++] = ((i >= 0) && (i < count)) ? digits[i] : '0';
     }
+
+  TrioWriteDecimal(self, buffer, length, isNegative, flags, width);
 }
 #endif /* TRIO_FEATURE_FLOAT */
 
 /*************************************************************************
- * TrioFormatProcess
+ * TrioWriteDouble
  *
- * Description:
- *  This is the main engine for formatting output
+ * http://wwwold.dkuug.dk/JTC1/SC22/WG14/www/docs/dr_211.htm
+ *
+ * "5.2.4.2.2 paragraph #4
+ *
+ *  The accuracy [...] is implementation defined, as is the accuracy
+ *  of the conversion between floating-point internal representations
+ *  and string representations performed by the library routine in
+ *  <stdio.h>"
  */
-static int
-TrioFormatProcess
-TRIO_ARGS3((data, format, parameters),
-	   trio_class_t *data,
-	   TRIO_CONST char *format,
-	   trio_parameter_t *parameters)
+/* FIXME: handle all instances of constant long-double number (L)
+ *   and *l() math functions.
+ */
+#if TRIO_FEATURE_FLOAT
+static void
+TrioWriteDouble
+TRIO_ARGS6((self, number, flags, width, precision, base),
+	   trio_class_t *self,
+	   trio_long_double_t number,
+	   trio_flags_t flags,
+	   int width,
+	   int precision,
+	   int base)
 {
+  trio_long_double_t integerNumber;
+  trio_long_double_t fractionNumber;
+  trio_long_double_t workNumber;
+  int integerDigits;
+  int fractionDigits;
+  int exponentDigits;
+  int workDigits;
+  int baseDigits;
+  int integerThreshold;
+  int fractionThreshold;
+  int expectedWidth;
+  int exponent = 0;
+  unsigned int uExponent = 0;
+  int exponentBase;
+  trio_long_double_t dblBase;
+  trio_long_double_t dblFractionBase;
+  trio_long_double_t integerAdjust;
+  trio_long_double_t fractionAdjust;
+  trio_long_double_t workFractionNumber;
+  trio_long_double_t workFractionAdjust;
+  int fractionDigitsInspect;
+  BOOLEAN_T isNegative;
+  BOOLEAN_T isExponentNegative = FALSE;
+  BOOLEAN_T requireTwoDigitExponent;
+  BOOLEAN_T isHex;
+  TRIO_CONST char *digits;
+# if TRIO_FEATURE_QUOTE
+  TRIO_CONST char *groupingPointer;
+# endif
   int i;
-#if TRIO_FEATURE_ERRNO
-  TRIO_CONST char *string;
-#endif
-  trio_pointer_t pointer;
-  trio_flags_t flags;
-  int width;
-  int precision;
-  int base;
   int offset;
+  BOOLEAN_T hasOnlyZeroes;
+  int leadingFractionZeroes = -1;
+  int trailingZeroes;
+  BOOLEAN_T keepTrailingZeroes;
+  BOOLEAN_T keepDecimalPoint;
+  trio_long_double_t epsilon;
+  trio_long_double_t epsilonCorrection;
+  BOOLEAN_T adjustNumber = FALSE;
+  char staging[MAX_STAGING];
+  int staged = 0;
 
-  offset = 0;
-  i = 0;
+  assert(VALID(self));
+  assert(VALID(self->OutStream));
+  assert(((base >= MIN_BASE) && (base <= MAX_BASE)) || (base == NO_BASE));
 
-  for (;;)
+  /* Determine sign and look for special quantities */
+  switch (trio_fpclassify_and_signbit(number, &isNegative))
     {
-      /* Skip the parameter entries */
-      while (parameters[i].type == FORMAT_PARAMETER)
-	i++;
+    case TRIO_FP_NAN:
+      TrioWriteString(self,
+		      (flags & FLAGS_UPPER)
+		      ? NAN_UPPER
+		      : NAN_LOWER,
+		      flags, width, precision);
+      return;
 
-      /* Copy non conversion-specifier part of format string */
-      while (offset < parameters[i].beginOffset)
-        {
-	  if (CHAR_IDENTIFIER == format[offset] && CHAR_IDENTIFIER == format[offset + 1])
-	    {
-	      data->OutStream(data, CHAR_IDENTIFIER);
-	      offset += 2;
-	    }
-	  else
-	    {
-	      data->OutStream(data, format[offset++]);
-	    }
+    case TRIO_FP_INFINITE:
+      if (isNegative)
+	{
+	  /* Negative infinity */
+	  TrioWriteString(self,
+			  (flags & FLAGS_UPPER)
+			  ? "-" INFINITE_UPPER
+			  : "-" INFINITE_LOWER,
+			  flags, width, precision);
+	  return;
+	}
+      else
+	{
+	  /* Positive infinity */
+	  TrioWriteString(self,
+			  (flags & FLAGS_UPPER)
+			  ? INFINITE_UPPER
+			  : INFINITE_LOWER,
+			  flags, width, precision);
+	  return;
 	}
 
-      /* Abort if we reached end of format string */
-      if (parameters[i].type == FORMAT_SENTINEL)
-	break;
+    default:
+      /* Finitude */
+      break;
+    }
 
-      /* Output parameter */
-      flags = parameters[i].flags;
+# if TRIO_FEATURE_SHORTEST
+  if ((flags & FLAGS_SHORTEST) && !(flags & FLAGS_LONGDOUBLE) &&
+      ((base == NO_BASE) || (base == BASE_DECIMAL)))
+    {
+      TrioWriteShortest(self, (double)TRIO_FABS(number), isNegative, flags, width);
+      return;
+    }
+# endif
 
-      /* Find width */
-      width = parameters[i].width;
-      if (flags & FLAGS_WIDTH_PARAMETER)
-	{
-	  /* Get width from parameter list */
-	  width = (int)parameters[width].data.number.as_signed;
-	  if (width < 0)
-	    {
-	      /*
-	       * A negative width is the same as the - flag and
-	       * a positive width.
-	       */
-	      flags |= FLAGS_LEFTADJUST;
-	      flags &= ~FLAGS_NILPADDING;
-	      width = -width;
-	    }
-	}
+  if (!(flags & (FLAGS_LONGDOUBLE | FLAGS_ROUNDING | FLAGS_QUOTE)) &&
+      ((base == NO_BASE) || (base == BASE_DECIMAL)) &&
+      (precision <= DBL_DIG + 2))
+    {
+      /* Exact digits for the common cases */
+      TrioWriteExact(self, (double)TRIO_FABS(number), isNegative, flags, width,
+		     (precision == NO_PRECISION) ? FLT_DIG : precision);
+      return;
+    }
 
-      /* Find precision */
-      if (flags & FLAGS_PRECISION)
+  /* Normal numbers */
+  if (flags & FLAGS_LONGDOUBLE)
+    {
+      baseDigits = (base == 10)
+	? LDBL_DIG
+	: (int)trio_floor(LDBL_MANT_DIG / TrioLogarithmBase(base));
+      epsilon = LDBL_EPSILON;
+    }
+  else if (flags & FLAGS_SHORT)
+    {
+      baseDigits = (base == BASE_DECIMAL)
+	? FLT_DIG
+	: (int)trio_floor(FLT_MANT_DIG / TrioLogarithmBase(base));
+      epsilon = FLT_EPSILON;
+    }
+  else
+    {
+      baseDigits = (base == BASE_DECIMAL)
+	? DBL_DIG
+	: (int)trio_floor(DBL_MANT_DIG / TrioLogarithmBase(base));
+      epsilon = DBL_EPSILON;
+    }
+
+  digits = (flags & FLAGS_UPPER) ? internalDigitsUpper : internalDigitsLower;
+  isHex = (base == BASE_HEX);
+  if (base == NO_BASE)
+    base = BASE_DECIMAL;
+  dblBase = (trio_long_double_t)base;
+  /*
+   * Some log10() functions can "err by almost 3 ulps" according to
+   * http://www.cs.berkeley.edu/~wkahan/LOG10HAF.TXT
+   */
+  epsilonCorrection = 3 * epsilon;
+  keepTrailingZeroes = !( (flags & FLAGS_ROUNDING) ||
+			  ( (flags & FLAGS_FLOAT_G) &&
+			    !(flags & FLAGS_ALTERNATIVE) ) );
+
+# if TRIO_FEATURE_ROUNDING
+  if (flags & FLAGS_ROUNDING)
+    {
+      precision = baseDigits;
+    }
+# endif
+
+  if (precision == NO_PRECISION)
+    {
+      if (isHex)
 	{
-	  precision = parameters[i].precision;
-	  if (flags & FLAGS_PRECISION_PARAMETER)
-	    {
-	      /* Get precision from parameter list */
-	      precision = (int)parameters[precision].data.number.as_signed;
-	      if (precision < 0)
-		{
-		  /*
-		   * A negative precision is the same as no
-		   * precision
-		   */
-		  precision = NO_PRECISION;
-		}
-	    }
+	  keepTrailingZeroes = FALSE;
+	  precision = FLT_MANT_DIG;
 	}
       else
 	{
-	  precision = NO_PRECISION;
+	  precision = FLT_DIG;
 	}
+    }
 
-      /* Find base */
-      if (NO_BASE != parameters[i].baseSpecifier)
+  if (isNegative)
+    {
+      number = -number;
+    }
+
+  if (isHex)
+    {
+      flags |= FLAGS_FLOAT_E;
+    }
+
+ reprocess:
+
+  if (flags & FLAGS_FLOAT_G)
+    {
+      if (precision == 0)
+	precision = 1;
+
+      if ( (number < TRIO_SUFFIX_LONG(1.0E-4)) ||
+	   (number >= TrioPower(base, (trio_long_double_t)precision)) )
 	{
-	  /* Base from specifier has priority */
-	  base = parameters[i].baseSpecifier;
+	  /* Use scientific notation */
+	  flags |= FLAGS_FLOAT_E;
 	}
-      else if (flags & FLAGS_BASE_PARAMETER)
+      else if (number < 1.0)
 	{
-	  /* Get base from parameter list */
-	  base = parameters[i].base;
-	  base = (int)parameters[base].data.number.as_signed;
+	  /*
+	   * Use normal notation. If the integer part of the number is
+	   * zero, then adjust the precision to include leading fractional
+	   * zeros.
+	   */
+	  workNumber = TrioLogarithm(number, base);
+	  workNumber = TRIO_FABS(workNumber);
+	  if (workNumber - trio_floor(workNumber) < epsilon)
+	    workNumber--;
+	  leadingFractionZeroes = (int)trio_floor(workNumber);
 	}
-      else
+    }
+
+  if (flags & FLAGS_FLOAT_E)
+    {
+      /* Scale the number */
+      workNumber = TrioLogarithm(number, base);
+      if (trio_isinf(workNumber) == -1)
 	{
-	  /* Use base from format string */
-	  base = parameters[i].base;
+	  exponent = 0;
+	  /* Undo setting */
+	  if (flags & FLAGS_FLOAT_G)
+	    flags &= ~FLAGS_FLOAT_E;
 	}
-
-      switch (parameters[i].type)
-        {
-	case FORMAT_CHAR:
-#if TRIO_FEATURE_QUOTE
-	  if (flags & FLAGS_QUOTE)
-	    data->OutStream(data, CHAR_QUOTE);
-#endif
-	  if (! (flags & FLAGS_LEFTADJUST))
-	    {
-	      while (--width > 0)
-		data->OutStream(data, CHAR_ADJUST);
-	    }
-#if TRIO_FEATURE_WIDECHAR
-	  if (flags & FLAGS_WIDECHAR)
-	    {
-	      TrioWriteWideStringCharacter(data,
-					   (trio_wchar_t)parameters[i].data.number.as_signed,
-					   flags,
-					   NO_WIDTH);
-	    }
-	  else
+      else
+	{
+	  exponent = (int)trio_floor(workNumber + epsilonCorrection);
+	  workNumber = number;
+	  /*
+           * We want to apply A / 10^B but the equivalent A * 10^-B gives better
+           * accuracy on platforms with true long double support.
+	   */
+#if defined(TRIO_DOUBLE_DOUBLE)
+	  workNumber /= TrioPower(dblBase, (trio_long_double_t)exponent);
+#else
+	  workNumber *= TrioPower(dblBase, (trio_long_double_t)-exponent);
 #endif
-	  {
-	    TrioWriteStringCharacter(data,
-				     (int)parameters[i].data.number.as_signed,
-				     flags);
+	  if (trio_isinf(workNumber)) {
+	    /*
+	     * Scaling is done it two steps to avoid problems with subnormal
+	     * numbers.
+	     */
+	    workNumber /= TrioPower(dblBase, (trio_long_double_t)(exponent / 2));
+	    workNumber /= TrioPower(dblBase, (trio_long_double_t)(exponent - (exponent / 2)));
 	  }
-
-	  if (flags & FLAGS_LEFTADJUST)
-	    {
-	      while(--width > 0)
-		data->OutStream(data, CHAR_ADJUST);
-	    }
+	  number = workNumber;
+	  isExponentNegative = (exponent < 0);
+	  uExponent = (isExponentNegative) ? -exponent : exponent;
+	  if (isHex)
+	    uExponent *= 4; /* log16(2) */
 #if TRIO_FEATURE_QUOTE
-	  if (flags & FLAGS_QUOTE)
-	    data->OutStream(data, CHAR_QUOTE);
+	  /* No thousand separators */
+	  flags &= ~FLAGS_QUOTE;
 #endif
+	}
+    }
 
-	  break; /* FORMAT_CHAR */
-
-	case FORMAT_INT:
-	  TrioWriteNumber(data,
-			  parameters[i].data.number.as_unsigned,
-			  flags,
-			  width,
-			  precision,
-			  base);
-
-	  break; /* FORMAT_INT */
+  integerNumber = trio_floor(number + epsilonCorrection);
+  fractionNumber = number - integerNumber;
 
-#if TRIO_FEATURE_FLOAT
-	case FORMAT_DOUBLE:
-	  TrioWriteDouble(data,
-			  parameters[i].data.longdoubleNumber,
-			  flags,
-			  width,
-			  precision,
-			  base);
-	  break; /* FORMAT_DOUBLE */
-#endif
+  /*
+   * Truncated number.
+   *
+   * Precision is number of significant digits for FLOAT_G and number of
+   * fractional digits for others.
+   */
+  integerDigits = 1;
+  if (integerNumber > epsilon)
+    {
+      integerDigits += (int)(TrioLogarithm(integerNumber, base) + epsilonCorrection);
+    }
 
-	case FORMAT_STRING:
-#if TRIO_FEATURE_WIDECHAR
-	  if (flags & FLAGS_WIDECHAR)
+  fractionDigits = precision;
+  if (flags & FLAGS_FLOAT_G)
+    {
+      if (leadingFractionZeroes > 0)
+	{
+	  fractionDigits += leadingFractionZeroes;
+	}
+      if ((integerNumber > epsilon) || (number <= epsilon))
+	{
+	  fractionDigits -= integerDigits;
+	}
+    }
+
+  dblFractionBase = TrioPower(base, fractionDigits);
+
+  if (integerNumber < 1.0)
+    {
+      workNumber = number * dblFractionBase + TRIO_SUFFIX_LONG(0.5);
+      if (trio_floor(number * dblFractionBase) != trio_floor(workNumber))
+	{
+	  adjustNumber = TRUE;
+	  /* Remove a leading fraction zero if fraction is rounded up */
+	  if ((int)(TrioLogarithm(number * dblFractionBase, base) + epsilonCorrection) !=
+              (int)(TrioLogarithm(workNumber, base) + epsilonCorrection))
 	    {
-	      TrioWriteWideString(data,
-				  parameters[i].data.wstring,
-				  flags,
-				  width,
-				  precision);
+	      --leadingFractionZeroes;
 	    }
-	  else
-#endif
+	}
+      workNumber /= dblFractionBase;
+    }
+  else
+    {
+      workNumber = number + TRIO_SUFFIX_LONG(0.5) / dblFractionBase;
+      adjustNumber = (trio_floor(number) != trio_floor(workNumber));
+    }
+  if (adjustNumber)
+    {
+      if ((flags & FLAGS_FLOAT_G) && !(flags & FLAGS_FLOAT_E))
+	{
+	  /* The adjustment may require a change to scientific notation */
+	  if ( (workNumber < TRIO_SUFFIX_LONG(1.0E-4)) ||
+	       (workNumber >= TrioPower(base, (trio_long_double_t)precision)) )
 	    {
-	      TrioWriteString(data,
-			      parameters[i].data.string,
-			      flags,
-			      width,
-			      precision);
+	      /* Use scientific notation */
+	      flags |= FLAGS_FLOAT_E;
+	      goto reprocess;
 	    }
-	  break; /* FORMAT_STRING */
-
-	case FORMAT_POINTER:
-	  {
-	    trio_reference_t reference;
-
-	    reference.data = data;
-	    reference.parameter = &parameters[i];
-	    trio_print_pointer(&reference, parameters[i].data.pointer);
-	  }
-	  break; /* FORMAT_POINTER */
+	}
 
-	case FORMAT_COUNT:
-	  pointer = parameters[i].data.pointer;
-	  if (NULL != pointer)
+      if (flags & FLAGS_FLOAT_E)
+	{
+	  workDigits = 1 + (TrioLogarithm(trio_floor(workNumber), base) + epsilonCorrection);
+	  if (integerDigits == workDigits)
 	    {
-	      /*
-	       * C99 paragraph 7.19.6.1.8 says "the number of
-	       * characters written to the output stream so far by
-	       * this call", which is data->actually.committed
-	       */
-#if TRIO_FEATURE_SIZE_T || TRIO_FEATURE_SIZE_T_UPPER
-	      if (flags & FLAGS_SIZE_T)
-		*(size_t *)pointer = (size_t)data->actually.committed;
-	      else
-#endif
-#if TRIO_FEATURE_PTRDIFF_T
-	      if (flags & FLAGS_PTRDIFF_T)
-		*(ptrdiff_t *)pointer = (ptrdiff_t)data->actually.committed;
-	      else
-#endif
-#if TRIO_FEATURE_INTMAX_T
-	      if (flags & FLAGS_INTMAX_T)
-		*(trio_intmax_t *)pointer = (trio_intmax_t)data->actually.committed;
-	      else
-#endif
-	      if (flags & FLAGS_QUAD)
-		{
-		  *(trio_ulonglong_t *)pointer = (trio_ulonglong_t)data->actually.committed;
-		}
-	      else if (flags & FLAGS_LONG)
-		{
-		  *(long int *)pointer = (long int)data->actually.committed;
-		}
-	      else if (flags & FLAGS_SHORT)
+	      /* Adjust if the same number of digits are used */
+	      number += TRIO_SUFFIX_LONG(0.5) / dblFractionBase;
+	      integerNumber = trio_floor(number);
+	      fractionNumber = number - integerNumber;
+	    }
+	  else
+	    {
+	      /* Adjust if number was rounded up one digit (ie. 0.99 to 1.00) */
+	      exponent++;
+	      isExponentNegative = (exponent < 0);
+	      uExponent = (isExponentNegative) ? -exponent : exponent;
+	      if (isHex)
+		uExponent *= 4; /* log16(2) */
+	      workNumber = (number + TRIO_SUFFIX_LONG(0.5) / dblFractionBase) / dblBase;
+	      integerNumber = trio_floor(workNumber);
+	      fractionNumber = workNumber - integerNumber;
+	    }
+	}
+      else
+	{
+	  if (workNumber > 1.0)
+	    {
+	      /* Adjust if number was rounded up one digit (ie. 99 to 100) */
+	      integerNumber = trio_floor(workNumber);
+	      fractionNumber = 0.0;
+	      integerDigits = (integerNumber > epsilon)
+		? 1 + (int)(TrioLogarithm(integerNumber, base) + epsilonCorrection)
+		: 1;
+	      if (flags & FLAGS_FLOAT_G)
 		{
-		  *(short int *)pointer = (short int)data->actually.committed;
+		  if (flags & FLAGS_ALTERNATIVE)
+		    {
+		      fractionDigits = precision;
+		      if ((integerNumber > epsilon) || (number <= epsilon))
+			{
+			  fractionDigits -= integerDigits;
+			}
+		    }
+		  else
+		    {
+		      fractionDigits = 0;
+		    }
 		}
-	      else
+	    }
+	  else
+	    {
+	      integerNumber = trio_floor(workNumber);
+	      fractionNumber = workNumber - integerNumber;
+	      if (flags & FLAGS_FLOAT_G)
 		{
-		  *(int *)pointer = (int)data->actually.committed;
+		  if (flags & FLAGS_ALTERNATIVE)
+		    {
+		      fractionDigits = precision;
+		      if (leadingFractionZeroes > 0)
+			{
+			  fractionDigits += leadingFractionZeroes;
+			}
+		      if ((integerNumber > epsilon) || (number <= epsilon))
+			{
+			  fractionDigits -= integerDigits;
+			}
+		    }
 		}
 	    }
-	  break; /* FORMAT_COUNT */
+	}
+    }
 
-	case FORMAT_PARAMETER:
-	  break; /* FORMAT_PARAMETER */
+  /* Estimate accuracy */
+  integerAdjust = fractionAdjust = TRIO_SUFFIX_LONG(0.5);
+# if TRIO_FEATURE_ROUNDING
+  if (flags & FLAGS_ROUNDING)
+    {
+      if (integerDigits > baseDigits)
+	{
+	  integerThreshold = baseDigits;
+	  fractionDigits = 0;
+	  dblFractionBase = 1.0;
+	  fractionThreshold = 0;
+	  precision = 0; /* Disable decimal-point */
+	  integerAdjust = TrioPower(base, integerDigits - integerThreshold - 1);
+	  fractionAdjust = 0.0;
+	}
+      else
+	{
+	  integerThreshold = integerDigits;
+	  fractionThreshold = fractionDigits - integerThreshold;
+	  fractionAdjust = 1.0;
+	}
+    }
+  else
+# endif
+    {
+      integerThreshold = INT_MAX;
+      fractionThreshold = INT_MAX;
+    }
+
+  /*
+   * Calculate expected width.
+   *  sign + integer part + thousands separators + decimal point
+   *  + fraction + exponent
+   */
+  fractionAdjust /= dblFractionBase;
+  hasOnlyZeroes = (trio_floor((fractionNumber + fractionAdjust) *
+			       dblFractionBase) < epsilon);
+  keepDecimalPoint = ( (flags & FLAGS_ALTERNATIVE) ||
+		       !((precision == 0) ||
+			 (!keepTrailingZeroes && hasOnlyZeroes)) );
+
+  expectedWidth = integerDigits + fractionDigits;
+
+  if (!keepTrailingZeroes)
+    {
+      trailingZeroes = 0;
+      workFractionNumber = fractionNumber;
+      workFractionAdjust = fractionAdjust;
+      fractionDigitsInspect = fractionDigits;
+
+      if (integerDigits > integerThreshold)
+	{
+	  fractionDigitsInspect = 0;
+	}
+      else if (fractionThreshold  <= fractionDigits)
+	{
+	  fractionDigitsInspect = fractionThreshold + 1;
+	}
+
+      trailingZeroes = fractionDigits - fractionDigitsInspect;
+      for (i = 0; i < fractionDigitsInspect; i++)
+	{
+	  workFractionNumber *= dblBase;
+	  workFractionAdjust *= dblBase;
+	  workNumber = trio_floor(workFractionNumber + workFractionAdjust);
+	  workFractionNumber -= workNumber;
+	  offset = (int)trio_fmod(workNumber, dblBase);
+	  if (offset == 0)
+	    {
+	      trailingZeroes++;
+	    }
+	  else
+	    {
+	      trailingZeroes = 0;
+	    }
+	}
+      expectedWidth -= trailingZeroes;
+    }
+
+  if (keepDecimalPoint)
+    {
+      expectedWidth += self->locale->decimalPointLength;
+    }
+
+#if TRIO_FEATURE_QUOTE
+  if (flags & FLAGS_QUOTE)
+    {
+      expectedWidth += TrioCalcThousandSeparatorLength(self->locale,
+						       integerDigits);
+    }
+#endif
+
+  if (isNegative || (flags & FLAGS_SHOWSIGN) || (flags & FLAGS_SPACE))
+    {
+      expectedWidth += sizeof("-") - 1;
+    }
+
+  exponentDigits = 0;
+  if (flags & FLAGS_FLOAT_E)
+    {
+      exponentDigits = (uExponent == 0)
+	? 1
+	: (int)trio_ceil(TrioLogarithm((double)(uExponent + 1),
+				       (isHex) ? 10 : base));
+    }
+  requireTwoDigitExponent = ((base == BASE_DECIMAL) && (exponentDigits == 1));
+  if (exponentDigits > 0)
+    {
+      expectedWidth += exponentDigits;
+      expectedWidth += (requireTwoDigitExponent
+			? sizeof("E+0") - 1
+			: sizeof("E+") - 1);
+    }
+
+  if (isHex)
+    {
+      expectedWidth += sizeof("0X") - 1;
+    }
+
+  /* Output prefixing */
+  if (flags & FLAGS_NILPADDING)
+    {
+      /* Leading zeros must be after sign */
+      if (isNegative)
+	self->OutStream(self, '-');
+      else if (flags & FLAGS_SHOWSIGN)
+	self->OutStream(self, '+');
+      else if (flags & FLAGS_SPACE)
+	self->OutStream(self, ' ');
+      if (isHex)
+	{
+	  self->OutStream(self, '0');
+	  self->OutStream(self, (flags & FLAGS_UPPER) ? 'X' : 'x');
+	}
+      if (!(flags & FLAGS_LEFTADJUST))
+	{
+	  TrioWritePadding(self, '0', width - expectedWidth);
+	}
+    }
+  else
+    {
+      /* Leading spaces must be before sign */
+      if (!(flags & FLAGS_LEFTADJUST))
+	{
+	  TrioWritePadding(self, CHAR_ADJUST, width - expectedWidth);
+	}
+      if (isNegative)
+	self->OutStream(self, '-');
+      else if (flags & FLAGS_SHOWSIGN)
+	self->OutStream(self, '+');
+      else if (flags & FLAGS_SPACE)
+	self->OutStream(self, ' ');
+      if (isHex)
+	{
+	  self->OutStream(self, '0');
+	  self->OutStream(self, (flags & FLAGS_UPPER) ? 'X' : 'x');
+	}
+    }
+
+  /* Output the integer part and thousand separators */
+  for (i = 0; i < integerDigits; i++)
+    {
+      workNumber = trio_floor(((integerNumber + integerAdjust)
+			       / TrioPower(base, integerDigits - i - 1)));
+      if (i > integerThreshold)
+	{
+	  /* Beyond accuracy */
+	  TrioWriteStaged(self, staging, &staged, digits[0]);
+	}
+      else
+	{
+	  TrioWriteStaged(self, staging, &staged,
+			  digits[(int)trio_fmod(workNumber, dblBase)]);
+	}
+
+#if TRIO_FEATURE_QUOTE
+      if (((flags & (FLAGS_FLOAT_E | FLAGS_QUOTE)) == FLAGS_QUOTE)
+	  && TrioFollowedBySeparator(self->locale, integerDigits - i))
+	{
+	  for (groupingPointer = self->locale->thousandSeparator;
+	       *groupingPointer != NIL;
+	       groupingPointer++)
+	    {
+	      TrioWriteStaged(self, staging, &staged, *groupingPointer);
+	    }
+	}
+#endif
+    }
+
+  /* Insert decimal point and build the fraction part */
+  trailingZeroes = 0;
+
+  if (keepDecimalPoint)
+    {
+      if (self->locale->decimalPoint)
+	{
+	  TrioWriteStaged(self, staging, &staged, self->locale->decimalPoint);
+	}
+      else
+	{
+	  for (i = 0; i < self->locale->decimalPointLength; i++)
+	    {
+	      TrioWriteStaged(self, staging, &staged,
+			      self->locale->decimalPointString[i]);
+	    }
+	}
+    }
+
+  for (i = 0; i < fractionDigits; i++)
+    {
+      if ((integerDigits > integerThreshold) || (i > fractionThreshold))
+	{
+	  /* Beyond accuracy */
+	  trailingZeroes++;
+	}
+      else
+	{
+	  fractionNumber *= dblBase;
+	  fractionAdjust *= dblBase;
+	  workNumber = trio_floor(fractionNumber + fractionAdjust);
+	  if (workNumber > fractionNumber)
+	    {
+	      /* fractionNumber should never become negative */
+	      fractionNumber = 0.0;
+	      fractionAdjust = 0.0;
+	    }
+	  else
+	    {
+	      fractionNumber -= workNumber;
+	    }
+	  offset = (int)trio_fmod(workNumber, dblBase);
+	  if (offset == 0)
+	    {
+	      trailingZeroes++;
+	    }
+	  else
+	    {
+	      while (trailingZeroes > 0)
+		{
+		  /* Not trailing zeroes after all */
+		  TrioWriteStaged(self, staging, &staged, digits[0]);
+		  trailingZeroes--;
+		}
+	      TrioWriteStaged(self, staging, &staged, digits[offset]);
+	    }
+	}
+    }
+
+  if (keepTrailingZeroes)
+    {
+      while (trailingZeroes > 0)
+	{
+	  TrioWriteStaged(self, staging, &staged, digits[0]);
+	  trailingZeroes--;
+	}
+    }
+
+  /* Output exponent */
+  if (exponentDigits > 0)
+    {
+      TrioWriteStaged(self, staging, &staged,
+		      isHex
+		      ? ((flags & FLAGS_UPPER) ? 'P' : 'p')
+		      : ((flags & FLAGS_UPPER) ? 'E' : 'e'));
+      TrioWriteStaged(self, staging, &staged,
+		      (isExponentNegative) ? '-' : '+');
+
+      /* The exponent must contain at least two digits */
+      if (requireTwoDigitExponent)
+        TrioWriteStaged(self, staging, &staged, '0');
+
+      if (isHex)
+	base = 10;
+      exponentBase = (int)TrioPower(base, exponentDigits - 1);
+      for (i = 0; i < exponentDigits; i++)
+	{
+	  TrioWriteStaged(self, staging, &staged,
+			  digits[(uExponent / exponentBase) % base]);
+	  exponentBase /= base;
+	}
+    }
+  TrioWriteBlock(self, staging, staged);
+
+  /* Output trailing spaces */
+  if (flags & FLAGS_LEFTADJUST)
+    {
+      TrioWritePadding(self, CHAR_ADJUST, width - expectedWidth);
+    }
+}
+#endif /* TRIO_FEATURE_FLOAT */
+
+/*************************************************************************
+ * TrioFormatProcess
+ *
+ * Description:
+ *  This is the main engine for formatting output
+ */
+static int
+TrioFormatProcess
+TRIO_ARGS3((data, format, parameters),
+	   trio_class_t *data,
+	   TRIO_CONST char *format,
+	   trio_parameter_t *parameters)
+{
+  int i;
+#if TRIO_FEATURE_ERRNO
+  TRIO_CONST char *string;
+#endif
+  trio_pointer_t pointer;
+  trio_flags_t flags;
+  int width;
+  int precision;
+  int base;
+  int offset;
+  int length;
+  TRIO_CONST char *marker;
+
+  offset = 0;
+  i = 0;
+
+  for (;;)
+    {
+      /* Skip the parameter entries */
+      while (parameters[i].type == FORMAT_PARAMETER)
+	i++;
+
+      /* Copy non conversion-specifier part of format string */
+      while (offset < parameters[i].beginOffset)
+        {
+	  if (CHAR_IDENTIFIER == format[offset] && CHAR_IDENTIFIER == format[offset + 1])
+	    {
+	      data->OutStream(data, CHAR_IDENTIFIER);
+	      offset += 2;
+	    }
+	  else
+	    {
+	      /* Copy the run of characters up to the next identifier */
+	      length = parameters[i].beginOffset - offset;
+	      marker = (TRIO_CONST char *)memchr(&format[offset + 1],
+						 CHAR_IDENTIFIER,
+						 (size_t)(length - 1));
+	      if (marker)
+		length = (int)(marker - &format[offset]);
+	      TrioWriteBlock(data, &format[offset], length);
+	      offset += length;
+	    }
+	}
+
+      /* Abort if we reached end of format string */
+      if (parameters[i].type == FORMAT_SENTINEL)
+	break;
+
+      /* Output parameter */
+      flags = parameters[i].flags;
+
+      /* Find width */
+      width = parameters[i].width;
+      if (flags & FLAGS_WIDTH_PARAMETER)
+	{
+	  /* Get width from parameter list */
+	  width = (int)parameters[width].data.number.as_signed;
+	  if (width < 0)
+	    {
+	      /*
+	       * A negative width is the same as the - flag and
+	       * a positive width.
+	       */
+	      flags |= FLAGS_LEFTADJUST;
+	      flags &= ~FLAGS_NILPADDING;
+	      width = -width;
+	    }
+	}
+
+      /* Find precision */
+      if (flags & FLAGS_PRECISION)
+	{
+	  precision = parameters[i].precision;
+	  if (flags & FLAGS_PRECISION_PARAMETER)
+	    {
+	      /* Get precision from parameter list */
+	      precision = (int)parameters[precision].data.number.as_signed;
+	      if (precision < 0)
+		{
+		  /*
+		   * A negative precision is the same as no
+		   * precision
+		   */
+		  precision = NO_PRECISION;
+		}
+	    }
+	}
+      else
+	{
+	  precision = NO_PRECISION;
+	}
+
+      /* Find base */
+      if (NO_BASE != parameters[i].baseSpecifier)
+	{
+	  /* Base from specifier has priority */
+	  base = parameters[i].baseSpecifier;
+	}
+      else if (flags & FLAGS_BASE_PARAMETER)
+	{
+	  /* Get base from parameter list */
+	  base = parameters[i].base;
+	  base = (int)parameters[base].data.number.as_signed;
+	}
+      else
+	{
+	  /* Use base from format string */
+	  base = parameters[i].base;
+	}
+
+      switch (parameters[i].type)
+        {
+	case FORMAT_CHAR:
+#if TRIO_FEATURE_QUOTE
+	  if (flags & FLAGS_QUOTE)
+	    data->OutStream(data, CHAR_QUOTE);
+#endif
+	  if (! (flags & FLAGS_LEFTADJUST))
+	    {
+	      TrioWritePadding(data, CHAR_ADJUST, width - 1);
+	    }
+#if TRIO_FEATURE_WIDECHAR
+	  if (flags & FLAGS_WIDECHAR)
+	    {
+	      TrioWriteWideStringCharacter(data,
+					   (trio_wchar_t)parameters[i].data.number.as_signed,
+					   flags,
+					   NO_WIDTH);
+	    }
+	  else
+#endif
+	  {
+	    TrioWriteStringCharacter(data,
+				     (int)parameters[i].data.number.as_signed,
+				     flags);
+	  }
+
+	  if (flags & FLAGS_LEFTADJUST)
+	    {
+	      TrioWritePadding(data, CHAR_ADJUST, width - 1);
+	    }
+#if TRIO_FEATURE_QUOTE
+	  if (flags & FLAGS_QUOTE)
+	    data->OutStream(data, CHAR_QUOTE);
+#endif
+
+	  break; /* FORMAT_CHAR */
+
+	case FORMAT_INT:
+	  TrioWriteNumber(data,
+			  parameters[i].data.number.as_unsigned,
+			  flags,
+			  width,
+			  precision,
+			  base);
+
+	  break; /* FORMAT_INT */
+
+#if TRIO_FEATURE_FLOAT
+	case FORMAT_DOUBLE:
+	  TrioWriteDouble(data,
+			  parameters[i].data.longdoubleNumber,
+			  flags,
+			  width,
+			  precision,
+			  base);
+	  break; /* FORMAT_DOUBLE */
+#endif
+
+	case FORMAT_STRING:
+#if TRIO_FEATURE_WIDECHAR
+	  if (flags & FLAGS_WIDECHAR)
+	    {
+	      TrioWriteWideString(data,
+				  parameters[i].data.wstring,
+				  flags,
+				  width,
+				  precision);
+	    }
+	  else
+#endif
+	    {
+	      TrioWriteString(data,
+			      parameters[i].data.string,
+			      flags,
+			      width,
+			      precision);
+	    }
+	  break; /* FORMAT_STRING */
+
+	case FORMAT_POINTER:
+	  {
+	    trio_reference_t reference;
+
+	    reference.data = data;
+	    reference.parameter = &parameters[i];
+	    trio_print_pointer(&reference, parameters[i].data.pointer);
+	  }
+	  break; /* FORMAT_POINTER */
+
+	case FORMAT_COUNT:
+	  pointer = parameters[i].data.pointer;
+	  if (NULL != pointer)
+	    {
+	      /*
+	       * C99 paragraph 7.19.6.1.8 says "the number of
+	       * characters written to the output stream so far by
+	       * this call", which is data->actually.committed
+	       */
+#if TRIO_FEATURE_SIZE_T || TRIO_FEATURE_SIZE_T_UPPER
+	      if (flags & FLAGS_SIZE_T)
+		*(size_t *)pointer = (size_t)data->actually.committed;
+	      else
+#endif
+#if TRIO_FEATURE_PTRDIFF_T
+	      if (flags & FLAGS_PTRDIFF_T)
+		*(ptrdiff_t *)pointer = (ptrdiff_t)data->actually.committed;
+	      else
+#endif
+#if TRIO_FEATURE_INTMAX_T
+	      if (flags & FLAGS_INTMAX_T)
+		*(trio_intmax_t *)pointer = (trio_intmax_t)data->actually.committed;
+	      else
+#endif
+	      if (flags & FLAGS_QUAD)
+		{
+		  *(trio_ulonglong_t *)pointer = (trio_ulonglong_t)data->actually.committed;
+		}
+	      else if (flags & FLAGS_LONG)
+		{
+		  *(long int *)pointer = (long int)data->actually.committed;
+		}
+	      else if (flags & FLAGS_SHORT)
+		{
+		  *(short int *)pointer = (short int)data->actually.committed;
+		}
+	      else
+		{
+		  *(int *)pointer = (int)data->actually.committed;
+		}
+	    }
+	  break; /* FORMAT_COUNT */
+
+	case FORMAT_PARAMETER:
+	  break; /* FORMAT_PARAMETER */
+
+#if TRIO_FEATURE_ERRNO
+	case FORMAT_ERRNO:
+	  string = trio_error(parameters[i].data.errorNumber);
+	  if (string)
+	    {
+	      TrioWriteString(data,
+			      string,
+			      flags,
+			      width,
+			      precision);
+	    }
+	  else
+	  {
+	    data->OutStream(data, '#');
+	    TrioWriteNumber(data,
+			    (trio_uintmax_t)parameters[i].data.errorNumber,
+			    flags,
+			    width,
+			    precision,
+			    BASE_DECIMAL);
+	  }
+	  break; /* FORMAT_ERRNO */
+#endif /* TRIO_FEATURE_ERRNO */
+
+#if TRIO_FEATURE_USER_DEFINED
+	case FORMAT_USER_DEFINED:
+	  {
+	    trio_reference_t reference;
+	    trio_userdef_t *def = NULL;
+
+	    if (parameters[i].flags & FLAGS_USER_DEFINED_PARAMETER)
+	      {
+		/* Use handle */
+		if ((i > 0) ||
+		    (parameters[i - 1].type == FORMAT_PARAMETER))
+		  def = (trio_userdef_t *)parameters[i - 1].data.pointer;
+	      }
+	    else
+	      {
+		/* Look up trio_namespace */
+		def = TrioFindNamespace(parameters[i].user_defined.trio_namespace,
+					TrioHashNamespace(parameters[i].user_defined.trio_namespace));
+	      }
+	    if (def)
+	      {
+		reference.data = data;
+		reference.parameter = &parameters[i];
+		def->callback(&reference);
+	      }
+	    if ((parameters[i].flags & FLAGS_USER_DEFINED_PARAMETER) == 0)
+	      TrioReleaseNamespace();
+	  }
+	  break;
+#endif /* TRIO_FEATURE_USER_DEFINED */
+
+	default:
+	  break;
+	} /* switch parameter type */
+
+      /* Prepare for next */
+      offset = parameters[i].endOffset;
+      i++;
+    }
+
+  return data->processed;
+}
+
+/*************************************************************************
+ * TrioFormatRef
+ */
+#if TRIO_EXTENSION
+static int
+TrioFormatRef
+TRIO_ARGS5((reference, format, arglist, argfunc, argarray),
+	   trio_reference_t *reference,
+	   TRIO_CONST char *format,
+	   va_list arglist,
+	   trio_argfunc_t argfunc,
+	   trio_pointer_t *argarray)
+{
+  int status;
+  trio_parameter_t parameters[MAX_PARAMETERS];
+
+  status = TrioParse(TYPE_PRINT, format, parameters, arglist, argfunc, argarray);
+  if (status < 0)
+    return status;
+
+  status = TrioFormatProcess(reference->data, format, parameters);
+  if (reference->data->error != 0)
+    {
+      status = reference->data->error;
+    }
+  return status;
+}
+#endif /* TRIO_EXTENSION */
+
+/*************************************************************************
+ * TrioFormatCompiled
+ *
+ * Description:
+ *  Like TrioFormat, but with a format that has already been parsed by
+ *  trio_format_compile. Only the arguments are fetched.
+ */
+#if TRIO_FEATURE_COMPILE
+static int
+TrioFormatCompiled
+TRIO_ARGS9((destination, destinationSize, OutStream, OutStreamBlock, compiled, arglist, argfunc, argarray, locale),
+	   trio_pointer_t destination,
+	   size_t destinationSize,
+	   void (*OutStream) TRIO_PROTO((trio_class_t *, int)),
+	   void (*OutStreamBlock) TRIO_PROTO((trio_class_t *, TRIO_CONST char *, int)),
+	   TRIO_CONST trio_format_t *compiled,
+	   va_list arglist,
+	   trio_argfunc_t argfunc,
+	   trio_pointer_t *argarray,
+	   TRIO_CONST trio_locale_t *locale)
+{
+  int status;
+  trio_class_t data;
+  trio_parameter_t parameters[MAX_PARAMETERS];
+
+  assert(VALID(OutStream));
+  assert(VALID(compiled));
+
+  memset(&data, 0, sizeof(data));
+  data.OutStream = OutStream;
+  data.OutStreamBlock = OutStreamBlock;
+  data.location = destination;
+  data.max = destinationSize;
+  data.error = 0;
+  data.locale = TrioGetLocale(locale);
+
+  /* The arguments are stored in the parameters, so work on a copy */
+  memcpy(parameters, compiled->parameters,
+	 compiled->count * sizeof(trio_parameter_t));
+
+  status = TrioParseArguments(TYPE_PRINT, parameters,
+			      compiled->indices, compiled->maxParameter,
+			      errno, arglist, argfunc, argarray);
+  if (status < 0)
+    return status;
+
+  status = TrioFormatProcess(&data, compiled->format, parameters);
+  if (data.error != 0)
+    {
+      status = data.error;
+    }
+  return status;
+}
+#endif /* TRIO_FEATURE_COMPILE */
+
+/*************************************************************************
+ * TrioFormatCompile
+ *
+ * Description:
+ *  Compile a format string with an allocator that has already been
+ *  resolved, so NULL means TRIO_MALLOC and not the installed allocator.
+ */
+#if TRIO_FEATURE_COMPILE
+static trio_format_t *
+TrioFormatCompile
+TRIO_ARGS2((allocator, format),
+	   TRIO_CONST trio_allocator_t *allocator,
+	   TRIO_CONST char *format)
+{
+  trio_format_t *self;
+  trio_parameter_t parameters[MAX_PARAMETERS];
+  int indices[MAX_PARAMETERS];
+  int maxParam = -1;
+  int count;
+  size_t length;
+
+  assert(VALID(format));
+
+  count = TrioParseFormat(TYPE_PRINT, format, parameters, indices, &maxParam);
+  if (count < 0)
+    return NULL;
+
+  self = (trio_format_t *)TrioAllocate(allocator, sizeof(trio_format_t));
+  if (self == NULL)
+    return NULL;
+
+  /* The format string is stored after the parameters */
+  length = trio_length(format) + 1;
+  self->parameters = (trio_parameter_t *)TrioAllocate(allocator,
+						      count * sizeof(trio_parameter_t)
+						      + length);
+  if (self->parameters == NULL)
+    {
+      TrioDeallocate(allocator, self);
+      return NULL;
+    }
+  self->allocator = allocator;
+  memcpy(self->parameters, parameters, count * sizeof(trio_parameter_t));
+  self->count = count;
+  self->format = (char *)&self->parameters[count];
+  memcpy(self->format, format, length);
+  self->key = NULL;
+  if (maxParam >= 0)
+    memcpy(self->indices, indices, (maxParam + 1) * sizeof(int));
+  self->maxParameter = maxParam;
+  return self;
+}
+#endif /* TRIO_FEATURE_COMPILE */
+
+/*************************************************************************
+ * TrioFormatCacheLookup
+ *
+ * Description:
+ *  Find the compiled format for the format string in the cache, and add
+ *  it if there is a free entry. The entries are keyed by the address of
+ *  the format string, but the contents are compared as well in case the
+ *  string has been changed. Entries are never replaced, so they can be
+ *  read without locks.
+ *
+ *  The entries live until trio_format_cache_clear, so they are always
+ *  allocated with TRIO_MALLOC, never with the installed allocator.
+ */
+#if defined(USE_FORMAT_CACHE)
+static trio_format_t *
+TrioFormatCacheLookup
+TRIO_ARGS1((format),
+	   TRIO_CONST char *format)
+{
+  trio_format_t *compiled;
+  size_t hash;
+  int probe;
+
+  hash = (size_t)format;
+  hash ^= (hash >> 8) ^ (hash >> 16);
+
+  for (probe = 0; probe < MAX_FORMAT_CACHE_PROBE; probe++)
+    {
+      int slot = (int)((hash + probe) & (MAX_FORMAT_CACHE - 1));
+
+      compiled = TRIO_ATOMIC_LOAD(internalFormatCache[slot]);
+      if (compiled == NULL)
+	{
+	  TRIO_ATOMIC_INCREMENT(internalFormatCacheMisses);
+	  compiled = TrioFormatCompile(NULL, format);
+	  if (compiled == NULL)
+	    return NULL;
+	  compiled->key = format;
+	  if (TRIO_ATOMIC_SWAP_NULL(internalFormatCache[slot], compiled))
+	    return compiled;
+	  /* Another thread took the entry first */
+	  trio_format_destroy(compiled);
+	  return NULL;
+	}
+      if ((compiled->key == format) && trio_equal_case(compiled->format, format))
+	{
+	  TRIO_ATOMIC_INCREMENT(internalFormatCacheHits);
+	  return compiled;
+	}
+    }
+  TRIO_ATOMIC_INCREMENT(internalFormatCacheMisses);
+  return NULL;
+}
+#endif /* defined(USE_FORMAT_CACHE) */
+
+/*************************************************************************
+ * TrioFormat
+ */
+static int
+TrioFormat
+TRIO_ARGS9((destination, destinationSize, OutStream, OutStreamBlock, format, arglist, argfunc, argarray, locale),
+	   trio_pointer_t destination,
+	   size_t destinationSize,
+	   void (*OutStream) TRIO_PROTO((trio_class_t *, int)),
+	   void (*OutStreamBlock) TRIO_PROTO((trio_class_t *, TRIO_CONST char *, int)),
+	   TRIO_CONST char *format,
+	   va_list arglist,
+	   trio_argfunc_t argfunc,
+	   trio_pointer_t *argarray,
+	   TRIO_CONST trio_locale_t *locale)
+{
+  int status;
+  trio_class_t data;
+  trio_parameter_t parameters[MAX_PARAMETERS];
+
+  assert(VALID(OutStream));
+  assert(VALID(format));
+
+#if defined(USE_FORMAT_CACHE)
+  if (TRIO_ATOMIC_LOAD(internalFormatCacheEnabled))
+    {
+      TRIO_CONST trio_format_t *compiled = TrioFormatCacheLookup(format);
+      if (compiled)
+	return TrioFormatCompiled(destination, destinationSize, OutStream, OutStreamBlock,
+				  compiled, arglist, argfunc, argarray, locale);
+    }
+#endif
+
+  memset(&data, 0, sizeof(data));
+  data.OutStream = OutStream;
+  data.OutStreamBlock = OutStreamBlock;
+  data.location = destination;
+  data.max = destinationSize;
+  data.error = 0;
+  data.locale = TrioGetLocale(locale);
+
+  status = TrioParse(TYPE_PRINT, format, parameters, arglist, argfunc, argarray);
+  if (status < 0)
+    return status;
+
+  status = TrioFormatProcess(&data, format, parameters);
+  if (data.error != 0)
+    {
+      status = data.error;
+    }
+  return status;
+}
+
+/*************************************************************************
+ * TrioOutStreamFile
+ */
+#if TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO
+static void
+TrioOutStreamFile
+TRIO_ARGS2((self, output),
+	   trio_class_t *self,
+	   int output)
+{
+  FILE *file;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  file = (FILE *)self->location;
+  self->processed++;
+#if defined(USE_PUTC_UNLOCKED)
+  if (putc_unlocked(output, file) == EOF)
+#else
+  if (fputc(output, file) == EOF)
+#endif
+    {
+      self->error = TRIO_ERROR_RETURN(TRIO_EOF, 0);
+    }
+  else
+    {
+      self->actually.committed++;
+    }
+}
+
+/*************************************************************************
+ * TrioOutStreamFileBlock
+ */
+static void
+TrioOutStreamFileBlock
+TRIO_ARGS3((self, block, length),
+	   trio_class_t *self,
+	   TRIO_CONST char *block,
+	   int length)
+{
+  FILE *file;
+  size_t written;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  file = (FILE *)self->location;
+  self->processed += length;
+#if defined(USE_FWRITE_UNLOCKED)
+  written = fwrite_unlocked(block, sizeof(char), (size_t)length, file);
+#else
+  written = fwrite(block, sizeof(char), (size_t)length, file);
+#endif
+  self->actually.committed += (int)written;
+  if (written < (size_t)length)
+    {
+      self->error = TRIO_ERROR_RETURN(TRIO_EOF, 0);
+    }
+}
+
+/*************************************************************************
+ * TrioFormatFile
+ *
+ * Description:
+ *  Format to a stream. The stream is locked for the duration of the
+ *  call, so the output is not interleaved with output from other
+ *  threads, and the characters can be written without locking each
+ *  of them.
+ */
+static int
+TrioFormatFile
+TRIO_ARGS6((file, format, compiled, arglist, argfunc, argarray),
+	   FILE *file,
+	   TRIO_CONST char *format,
+	   TRIO_CONST trio_format_t *compiled,
+	   va_list arglist,
+	   trio_argfunc_t argfunc,
+	   trio_pointer_t *argarray)
+{
+  int status;
+
+#if defined(USE_FLOCKFILE)
+  flockfile(file);
+#endif
+#if TRIO_FEATURE_COMPILE
+  if (compiled)
+    status = TrioFormatCompiled(file, 0,
+				TrioOutStreamFile, TrioOutStreamFileBlock,
+				compiled, arglist, argfunc, argarray, NULL);
+  else
+#endif
+    status = TrioFormat(file, 0, TrioOutStreamFile, TrioOutStreamFileBlock,
+			format, arglist, argfunc, argarray, NULL);
+#if defined(USE_FLOCKFILE)
+  funlockfile(file);
+#endif
+  return status;
+}
+#endif /* TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO */
+
+/*************************************************************************
+ * TrioFlushFileDescriptor
+ *
+ * Description:
+ *  Write the buffered characters, followed by an optional block, to
+ *  the file descriptor. Interrupted and partial writes are resumed.
+ *  The buffer is always emptied.
+ */
+#if TRIO_FEATURE_FD
+static BOOLEAN_T
+TrioFlushFileDescriptor
+TRIO_ARGS3((output, block, length),
+	   trio_fdout_t *output,
+	   TRIO_CONST char *block,
+	   int length)
+{
+  TRIO_CONST char *pending;
+  int pendingLength;
+  long written;
+# if defined(USE_WRITEV)
+  struct iovec vector[2];
+# endif
+
+  pending = output->buffer;
+  pendingLength = output->length;
+  output->length = 0;
+
+  while (pendingLength + length > 0)
+    {
+# if defined(USE_WRITEV)
+      if ((pendingLength > 0) && (length > 0))
+	{
+	  vector[0].iov_base = (char *)pending;
+	  vector[0].iov_len = (size_t)pendingLength;
+	  vector[1].iov_base = (char *)block;
+	  vector[1].iov_len = (size_t)length;
+	  written = (long)writev(output->fd, vector, 2);
+	}
+      else
+# endif
+      if (pendingLength > 0)
+	{
+	  written = (long)write(output->fd, pending, (size_t)pendingLength);
+	}
+      else
+	{
+	  written = (long)write(output->fd, block, (size_t)length);
+	}
+
+      if (written < 0)
+	{
+# if defined(EINTR)
+	  if (errno == EINTR)
+	    continue;
+# endif
+	  return FALSE;
+	}
+      if (written == 0)
+	return FALSE;
+
+      if (written < pendingLength)
+	{
+	  pending += written;
+	  pendingLength -= (int)written;
+	}
+      else
+	{
+	  written -= pendingLength;
+	  pendingLength = 0;
+	  if (written > 0)
+	    {
+	      block += written;
+	      length -= (int)written;
+	    }
+	}
+    }
+  return TRUE;
+}
+#endif /* TRIO_FEATURE_FD */
+
+/*************************************************************************
+ * TrioOutStreamFileDescriptor
+ */
+#if TRIO_FEATURE_FD
+static void
+TrioOutStreamFileDescriptor
+TRIO_ARGS2((self, output),
+	   trio_class_t *self,
+	   int output)
+{
+  trio_fdout_t *fdout;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  fdout = (trio_fdout_t *)self->location;
+  self->processed++;
+  if (self->error == 0)
+    {
+      if ((fdout->length >= (int)sizeof(fdout->buffer))
+	  && !TrioFlushFileDescriptor(fdout, NULL, 0))
+	{
+	  self->error = TRIO_ERROR_RETURN(TRIO_ERRNO, 0);
+	  return;
+	}
+      fdout->buffer[fdout->length++] = (char)output;
+      self->actually.committed++;
+    }
+}
+
+/*************************************************************************
+ * TrioOutStreamFileDescriptorBlock
+ */
+static void
+TrioOutStreamFileDescriptorBlock
+TRIO_ARGS3((self, block, length),
+	   trio_class_t *self,
+	   TRIO_CONST char *block,
+	   int length)
+{
+  trio_fdout_t *fdout;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  fdout = (trio_fdout_t *)self->location;
+  self->processed += length;
+  if (self->error == 0)
+    {
+      if (fdout->length + length <= (int)sizeof(fdout->buffer))
+	{
+	  memcpy(&fdout->buffer[fdout->length], block, (size_t)length);
+	  fdout->length += length;
+	}
+      else if (!TrioFlushFileDescriptor(fdout, block, length))
+	{
+	  self->error = TRIO_ERROR_RETURN(TRIO_ERRNO, 0);
+	  return;
+	}
+      self->actually.committed += length;
+    }
+}
+
+/*************************************************************************
+ * TrioFormatFileDescriptor
+ *
+ * Description:
+ *  Format to a file descriptor through a buffer on the stack, so that
+ *  the output is passed to the operating system in a few large writes
+ *  instead of one write per character.
+ */
+static int
+TrioFormatFileDescriptor
+TRIO_ARGS5((fd, format, arglist, argfunc, argarray),
+	   int fd,
+	   TRIO_CONST char *format,
+	   va_list arglist,
+	   trio_argfunc_t argfunc,
+	   trio_pointer_t *argarray)
+{
+  int status;
+  trio_fdout_t output;
+
+  output.fd = fd;
+  output.length = 0;
+  status = TrioFormat(&output, 0,
+		      TrioOutStreamFileDescriptor,
+		      TrioOutStreamFileDescriptorBlock,
+		      format, arglist, argfunc, argarray, NULL);
+  if (!TrioFlushFileDescriptor(&output, NULL, 0) && (status >= 0))
+    {
+      status = TRIO_ERROR_RETURN(TRIO_ERRNO, 0);
+    }
+  return status;
+}
+#endif /* TRIO_FEATURE_FD */
+
+/*************************************************************************
+ * TrioOutStreamCustom
+ */
+#if TRIO_FEATURE_CLOSURE
+static void
+TrioOutStreamCustom
+TRIO_ARGS2((self, output),
+	   trio_class_t *self,
+	   int output)
+{
+  int status;
+  trio_custom_t *data;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  data = (trio_custom_t *)self->location;
+  if (data->stream.out)
+    {
+      status = (data->stream.out)(data->closure, output);
+      if (status >= 0)
+	{
+	  self->actually.committed++;
+	}
+      else
+	{
+	  if (self->error == 0)
+	    {
+	      self->error = TRIO_ERROR_RETURN(TRIO_ECUSTOM, -status);
+	    }
+	}
+    }
+  self->processed++;
+}
+#endif /* TRIO_FEATURE_CLOSURE */
+
+/*************************************************************************
+ * TrioOutStreamString
+ */
+static void
+TrioOutStreamString
+TRIO_ARGS2((self, output),
+	   trio_class_t *self,
+	   int output)
+{
+  char **buffer;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  buffer = (char **)self->location;
+  **buffer = (char)output;
+  (*buffer)++;
+  self->processed++;
+  self->actually.committed++;
+}
+
+/*************************************************************************
+ * TrioOutStreamStringBlock
+ */
+static void
+TrioOutStreamStringBlock
+TRIO_ARGS3((self, block, length),
+	   trio_class_t *self,
+	   TRIO_CONST char *block,
+	   int length)
+{
+  char **buffer;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  buffer = (char **)self->location;
+  memcpy(*buffer, block, (size_t)length);
+  *buffer += length;
+  self->processed += length;
+  self->actually.committed += length;
+}
+
+/*************************************************************************
+ * TrioOutStreamStringMax
+ */
+static void
+TrioOutStreamStringMax
+TRIO_ARGS2((self, output),
+	   trio_class_t *self,
+	   int output)
+{
+  char **buffer;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  buffer = (char **)self->location;
+
+  if (self->processed < self->max)
+    {
+      **buffer = (char)output;
+      (*buffer)++;
+      self->actually.committed++;
+    }
+  self->processed++;
+}
+
+/*************************************************************************
+ * TrioOutStreamStringMaxBlock
+ */
+static void
+TrioOutStreamStringMaxBlock
+TRIO_ARGS3((self, block, length),
+	   trio_class_t *self,
+	   TRIO_CONST char *block,
+	   int length)
+{
+  char **buffer;
+  int available;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  buffer = (char **)self->location;
+
+  available = self->max - self->processed;
+  if (available > length)
+    available = length;
+  if (available > 0)
+    {
+      memcpy(*buffer, block, (size_t)available);
+      *buffer += available;
+      self->actually.committed += available;
+    }
+  self->processed += length;
+}
+
+/*************************************************************************
+ * TrioOutStreamStringDynamic
+ */
+#if TRIO_FEATURE_DYNAMICSTRING
+static void
+TrioOutStreamStringDynamic
+TRIO_ARGS2((self, output),
+	   trio_class_t *self,
+	   int output)
+{
+  trio_buffer_t *buffer;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  buffer = (trio_buffer_t *)self->location;
+  if (self->error == 0)
+    {
+      if ((buffer->length + 1 < buffer->allocated) || trio_buffer_reserve(buffer, 1))
+	{
+	  buffer->content[buffer->length++] = (char)output;
+	  self->actually.committed++;
+	}
+      else
+	{
+	  self->error = TRIO_ERROR_RETURN(TRIO_ENOMEM, 0);
+	}
+    }
+  /* The processed variable must always be increased */
+  self->processed++;
+}
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
+
+/*************************************************************************
+ * TrioOutStreamStringDynamicBlock
+ */
+#if TRIO_FEATURE_DYNAMICSTRING
+static void
+TrioOutStreamStringDynamicBlock
+TRIO_ARGS3((self, block, length),
+	   trio_class_t *self,
+	   TRIO_CONST char *block,
+	   int length)
+{
+  trio_buffer_t *buffer;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  buffer = (trio_buffer_t *)self->location;
+  if (self->error == 0)
+    {
+      if ((buffer->length + length < buffer->allocated)
+	  || trio_buffer_reserve(buffer, (size_t)length))
+	{
+	  memcpy(&buffer->content[buffer->length], block, (size_t)length);
+	  buffer->length += length;
+	  self->actually.committed += length;
+	}
+      else
+	{
+	  self->error = TRIO_ERROR_RETURN(TRIO_ENOMEM, 0);
+	}
+    }
+  self->processed += length;
+}
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
+
+/*************************************************************************
+ * TrioFormatBuffer
+ *
+ * Description:
+ *  Append to a buffer string and terminate it.
+ */
+#if TRIO_FEATURE_DYNAMICSTRING
+static int
+TrioFormatBuffer
+TRIO_ARGS5((buffer, format, arglist, argfunc, argarray),
+	   trio_buffer_t *buffer,
+	   TRIO_CONST char *format,
+	   va_list arglist,
+	   trio_argfunc_t argfunc,
+	   trio_pointer_t *argarray)
+{
+  int status;
+
+  status = TrioFormat(buffer, 0,
+		      TrioOutStreamStringDynamic,
+		      TrioOutStreamStringDynamicBlock,
+		      format, arglist, argfunc, argarray, NULL);
+  /* There is always room for the terminating zero */
+  buffer->content[buffer->length] = NIL;
+  return status;
+}
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
+
+/*************************************************************************
+ * TrioFormatDynamic
+ *
+ * Description:
+ *  Print to a newly allocated string. The output is collected in an
+ *  on-stack buffer, which is only moved to the heap if it overflows,
+ *  and the result is returned in a single allocation of the final size.
+ *  The memory is obtained from allocator, or the installed allocator if
+ *  it is NULL.
+ */
+#if TRIO_FEATURE_DYNAMICSTRING
+static int
+TrioFormatDynamic
+TRIO_ARGS6((allocator, result, format, arglist, argfunc, argarray),
+	   TRIO_CONST trio_allocator_t *allocator,
+	   char **result,
+	   TRIO_CONST char *format,
+	   va_list arglist,
+	   trio_argfunc_t argfunc,
+	   trio_pointer_t *argarray)
+{
+  trio_buffer_t buffer;
+  char scratch[MAX_DYNAMIC_SCRATCH];
+  int status;
+
+  trio_buffer_init_storage(&buffer, scratch, sizeof(scratch),
+			   TrioGetAllocator(allocator));
+
+  *result = NULL;
+  status = TrioFormatBuffer(&buffer, format, arglist, argfunc, argarray);
+  if (status >= 0)
+    {
+      *result = trio_buffer_extract(&buffer);
+      if (*result == NULL)
+	status = TRIO_ERROR_RETURN(TRIO_ENOMEM, 0);
+    }
+  trio_buffer_destroy(&buffer);
+  return status;
+}
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
+
+/*************************************************************************
+ * TrioArrayGetter
+ */
+static
+trio_pointer_t TrioArrayGetter(trio_pointer_t context, int index, int type)
+{
+  /* Utility function for the printfv family */
+  trio_pointer_t *argarray = (trio_pointer_t *)context;
+  if (type) {}
+  return argarray[index];
+}
+
+/*************************************************************************
+ *
+ * Formatted printing functions
+ *
+ ************************************************************************/
+
+/** @addtogroup Printf
+    @{
+*/
+
+/*************************************************************************
+ * printf
+ */
+
+/**
+   Print to standard output stream.
+
+   @param format Formatting string.
+   @param ... Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_STDIO
+TRIO_PUBLIC int
+trio_printf
+TRIO_VARGS2((format, va_alist),
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
+{
+  int status;
+  va_list args;
+
+  assert(VALID(format));
+
+  TRIO_VA_START(args, format);
+  status = TrioFormatFile(stdout, format, NULL, args, NULL, NULL);
+  TRIO_VA_END(args);
+  return status;
+}
+#endif /* TRIO_FEATURE_STDIO */
+
+/**
+   Print to standard output stream.
 
-#if TRIO_FEATURE_ERRNO
-	case FORMAT_ERRNO:
-	  string = trio_error(parameters[i].data.errorNumber);
-	  if (string)
-	    {
-	      TrioWriteString(data,
-			      string,
-			      flags,
-			      width,
-			      precision);
-	    }
-	  else
-	  {
-	    data->OutStream(data, '#');
-	    TrioWriteNumber(data,
-			    (trio_uintmax_t)parameters[i].data.errorNumber,
-			    flags,
-			    width,
-			    precision,
-			    BASE_DECIMAL);
-	  }
-	  break; /* FORMAT_ERRNO */
-#endif /* TRIO_FEATURE_ERRNO */
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_STDIO
+TRIO_PUBLIC int
+trio_vprintf
+TRIO_ARGS2((format, args),
+	   TRIO_CONST char *format,
+	   va_list args)
+{
+  assert(VALID(format));
 
-#if TRIO_FEATURE_USER_DEFINED
-	case FORMAT_USER_DEFINED:
-	  {
-	    trio_reference_t reference;
-	    trio_userdef_t *def = NULL;
+  return TrioFormatFile(stdout, format, NULL, args, NULL, NULL);
+}
+#endif /* TRIO_FEATURE_STDIO */
 
-	    if (parameters[i].flags & FLAGS_USER_DEFINED_PARAMETER)
-	      {
-		/* Use handle */
-		if ((i > 0) ||
-		    (parameters[i - 1].type == FORMAT_PARAMETER))
-		  def = (trio_userdef_t *)parameters[i - 1].data.pointer;
-	      }
-	    else
-	      {
-		/* Look up trio_namespace */
-		def = TrioFindNamespace(parameters[i].user_defined.trio_namespace, NULL);
-	      }
-	    if (def)
-	      {
-		reference.data = data;
-		reference.parameter = &parameters[i];
-		def->callback(&reference);
-	      }
-	  }
-	  break;
-#endif /* TRIO_FEATURE_USER_DEFINED */
+/**
+   Print to standard output stream.
 
-	default:
-	  break;
-	} /* switch parameter type */
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_STDIO
+TRIO_PUBLIC int
+trio_printfv
+TRIO_ARGS2((format, args),
+	   TRIO_CONST char *format,
+	   trio_pointer_t * args)
+{
+  static va_list unused;
 
-      /* Prepare for next */
-      offset = parameters[i].endOffset;
-      i++;
-    }
+  assert(VALID(format));
 
-  return data->processed;
+  return TrioFormatFile(stdout, format, NULL,
+			unused, TrioArrayGetter, args);
 }
+#endif /* TRIO_FEATURE_STDIO */
 
 /*************************************************************************
- * TrioFormatRef
+ * fprintf
  */
-#if TRIO_EXTENSION
-static int
-TrioFormatRef
-TRIO_ARGS5((reference, format, arglist, argfunc, argarray),
-	   trio_reference_t *reference,
-	   TRIO_CONST char *format,
-	   va_list arglist,
-	   trio_argfunc_t argfunc,
-	   trio_pointer_t *argarray)
+
+/**
+   Print to file.
+
+   @param file File pointer.
+   @param format Formatting string.
+   @param ... Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_FILE
+TRIO_PUBLIC int
+trio_fprintf
+TRIO_VARGS3((file, format, va_alist),
+	    FILE *file,
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
 {
   int status;
-  trio_parameter_t parameters[MAX_PARAMETERS];
+  va_list args;
 
-  status = TrioParse(TYPE_PRINT, format, parameters, arglist, argfunc, argarray);
-  if (status < 0)
-    return status;
+  assert(VALID(file));
+  assert(VALID(format));
 
-  status = TrioFormatProcess(reference->data, format, parameters);
-  if (reference->data->error != 0)
-    {
-      status = reference->data->error;
-    }
+  TRIO_VA_START(args, format);
+  status = TrioFormatFile(file, format, NULL, args, NULL, NULL);
+  TRIO_VA_END(args);
   return status;
 }
-#endif /* TRIO_EXTENSION */
+#endif /* TRIO_FEATURE_FILE */
 
-/*************************************************************************
- * TrioFormat
+/**
+   Print to file.
+
+   @param file File pointer.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of printed characters.
  */
-static int
-TrioFormat
-TRIO_ARGS7((destination, destinationSize, OutStream, format, arglist, argfunc, argarray),
-	   trio_pointer_t destination,
-	   size_t destinationSize,
-	   void (*OutStream) TRIO_PROTO((trio_class_t *, int)),
+#if TRIO_FEATURE_FILE
+TRIO_PUBLIC int
+trio_vfprintf
+TRIO_ARGS3((file, format, args),
+	   FILE *file,
 	   TRIO_CONST char *format,
-	   va_list arglist,
-	   trio_argfunc_t argfunc,
-	   trio_pointer_t *argarray)
+	   va_list args)
 {
-  int status;
-  trio_class_t data;
-  trio_parameter_t parameters[MAX_PARAMETERS];
-
-  assert(VALID(OutStream));
+  assert(VALID(file));
   assert(VALID(format));
 
-  memset(&data, 0, sizeof(data));
-  data.OutStream = OutStream;
-  data.location = destination;
-  data.max = destinationSize;
-  data.error = 0;
+  return TrioFormatFile(file, format, NULL, args, NULL, NULL);
+}
+#endif /* TRIO_FEATURE_FILE */
 
-#if defined(USE_LOCALE)
-  if (NULL == internalLocaleValues)
-    {
-      TrioSetLocale();
-    }
-#endif
+/**
+   Print to file.
 
-  status = TrioParse(TYPE_PRINT, format, parameters, arglist, argfunc, argarray);
-  if (status < 0)
-    return status;
+   @param file File pointer.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_FILE
+TRIO_PUBLIC int
+trio_fprintfv
+TRIO_ARGS3((file, format, args),
+	   FILE *file,
+	   TRIO_CONST char *format,
+	   trio_pointer_t * args)
+{
+  static va_list unused;
 
-  status = TrioFormatProcess(&data, format, parameters);
-  if (data.error != 0)
-    {
-      status = data.error;
-    }
-  return status;
+  assert(VALID(file));
+  assert(VALID(format));
+
+  return TrioFormatFile(file, format, NULL,
+			unused, TrioArrayGetter, args);
 }
+#endif /* TRIO_FEATURE_FILE */
 
 /*************************************************************************
- * TrioOutStreamFile
+ * dprintf
  */
-#if TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO
-static void
-TrioOutStreamFile
-TRIO_ARGS2((self, output),
-	   trio_class_t *self,
-	   int output)
+
+/**
+   Print to file descriptor.
+
+   The output is collected in a small buffer and passed to the file
+   descriptor in as few writes as possible.
+
+   @param fd File descriptor.
+   @param format Formatting string.
+   @param ... Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_FD
+TRIO_PUBLIC int
+trio_dprintf
+TRIO_VARGS3((fd, format, va_alist),
+	    int fd,
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
 {
-  FILE *file;
+  int status;
+  va_list args;
 
-  assert(VALID(self));
-  assert(VALID(self->location));
+  assert(VALID(format));
 
-  file = (FILE *)self->location;
-  self->processed++;
-  if (fputc(output, file) == EOF)
-    {
-      self->error = TRIO_ERROR_RETURN(TRIO_EOF, 0);
-    }
-  else
-    {
-      self->actually.committed++;
-    }
+  TRIO_VA_START(args, format);
+  status = TrioFormatFileDescriptor(fd, format, args, NULL, NULL);
+  TRIO_VA_END(args);
+  return status;
+}
+#endif /* TRIO_FEATURE_FD */
+
+/**
+   Print to file descriptor.
+
+   @param fd File descriptor.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_FD
+TRIO_PUBLIC int
+trio_vdprintf
+TRIO_ARGS3((fd, format, args),
+	   int fd,
+	   TRIO_CONST char *format,
+	   va_list args)
+{
+  assert(VALID(format));
+
+  return TrioFormatFileDescriptor(fd, format, args, NULL, NULL);
 }
-#endif /* TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO */
+#endif /* TRIO_FEATURE_FD */
 
-/*************************************************************************
- * TrioOutStreamFileDescriptor
+/**
+   Print to file descriptor.
+
+   @param fd File descriptor.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of printed characters.
  */
 #if TRIO_FEATURE_FD
-static void
-TrioOutStreamFileDescriptor
-TRIO_ARGS2((self, output),
-	   trio_class_t *self,
-	   int output)
+TRIO_PUBLIC int
+trio_dprintfv
+TRIO_ARGS3((fd, format, args),
+	   int fd,
+	   TRIO_CONST char *format,
+	   trio_pointer_t *args)
 {
-  int fd;
-  char ch;
+  static va_list unused;
 
-  assert(VALID(self));
+  assert(VALID(format));
 
-  fd = *((int *)self->location);
-  ch = (char)output;
-  self->processed++;
-  if (write(fd, &ch, sizeof(char)) == -1)
-    {
-      self->error = TRIO_ERROR_RETURN(TRIO_ERRNO, 0);
-    }
-  else
-    {
-      self->actually.committed++;
-    }
+  return TrioFormatFileDescriptor(fd, format,
+				  unused, TrioArrayGetter, args);
 }
 #endif /* TRIO_FEATURE_FD */
 
 /*************************************************************************
- * TrioOutStreamCustom
+ * cprintf
  */
 #if TRIO_FEATURE_CLOSURE
-static void
-TrioOutStreamCustom
-TRIO_ARGS2((self, output),
-	   trio_class_t *self,
-	   int output)
+TRIO_PUBLIC int
+trio_cprintf
+TRIO_VARGS4((stream, closure, format, va_alist),
+	    trio_outstream_t stream,
+	    trio_pointer_t closure,
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
 {
   int status;
-  trio_custom_t *data;
+  va_list args;
+  trio_custom_t data;
 
-  assert(VALID(self));
-  assert(VALID(self->location));
+  assert(VALID(stream));
+  assert(VALID(format));
 
-  data = (trio_custom_t *)self->location;
-  if (data->stream.out)
-    {
-      status = (data->stream.out)(data->closure, output);
-      if (status >= 0)
-	{
-	  self->actually.committed++;
-	}
-      else
-	{
-	  if (self->error == 0)
-	    {
-	      self->error = TRIO_ERROR_RETURN(TRIO_ECUSTOM, -status);
-	    }
-	}
-    }
-  self->processed++;
+  TRIO_VA_START(args, format);
+  data.stream.out = stream;
+  data.closure = closure;
+  status = TrioFormat(&data, 0, TrioOutStreamCustom, NULL,
+		      format, args, NULL, NULL, NULL);
+  TRIO_VA_END(args);
+  return status;
 }
 #endif /* TRIO_FEATURE_CLOSURE */
 
-/*************************************************************************
- * TrioOutStreamString
- */
-static void
-TrioOutStreamString
-TRIO_ARGS2((self, output),
-	   trio_class_t *self,
-	   int output)
+#if TRIO_FEATURE_CLOSURE
+TRIO_PUBLIC int
+trio_vcprintf
+TRIO_ARGS4((stream, closure, format, args),
+	   trio_outstream_t stream,
+	   trio_pointer_t closure,
+	   TRIO_CONST char *format,
+	   va_list args)
 {
-  char **buffer;
+  trio_custom_t data;
 
-  assert(VALID(self));
-  assert(VALID(self->location));
+  assert(VALID(stream));
+  assert(VALID(format));
 
-  buffer = (char **)self->location;
-  **buffer = (char)output;
-  (*buffer)++;
-  self->processed++;
-  self->actually.committed++;
+  data.stream.out = stream;
+  data.closure = closure;
+  return TrioFormat(&data, 0, TrioOutStreamCustom, NULL,
+		    format, args, NULL, NULL, NULL);
 }
+#endif /* TRIO_FEATURE_CLOSURE */
 
-/*************************************************************************
- * TrioOutStreamStringMax
- */
-static void
-TrioOutStreamStringMax
-TRIO_ARGS2((self, output),
-	   trio_class_t *self,
-	   int output)
+#if TRIO_FEATURE_CLOSURE
+TRIO_PUBLIC int
+trio_cprintfv
+TRIO_ARGS4((stream, closure, format, args),
+	   trio_outstream_t stream,
+	   trio_pointer_t closure,
+	   TRIO_CONST char *format,
+	   trio_pointer_t *args)
 {
-  char **buffer;
+  static va_list unused;
+  trio_custom_t data;
 
-  assert(VALID(self));
-  assert(VALID(self->location));
+  assert(VALID(stream));
+  assert(VALID(format));
 
-  buffer = (char **)self->location;
+  data.stream.out = stream;
+  data.closure = closure;
+  return TrioFormat(&data, 0, TrioOutStreamCustom, NULL, format,
+		    unused, TrioArrayGetter, args, NULL);
+}
+#endif /* TRIO_FEATURE_CLOSURE */
 
-  if (self->processed < self->max)
-    {
-      **buffer = (char)output;
-      (*buffer)++;
-      self->actually.committed++;
-    }
-  self->processed++;
+#if TRIO_FEATURE_CLOSURE && TRIO_FEATURE_ARGFUNC
+TRIO_PUBLIC int
+trio_cprintff
+TRIO_ARGS5((stream, closure, format, argfunc, context),
+	   trio_outstream_t stream,
+	   trio_pointer_t closure,
+	   TRIO_CONST char *format,
+	   trio_argfunc_t argfunc,
+	   trio_pointer_t context)
+{
+  static va_list unused;
+  trio_custom_t data;
+
+  assert(VALID(stream));
+  assert(VALID(format));
+  assert(VALID(argfunc));
+
+  data.stream.out = stream;
+  data.closure = closure;
+  return TrioFormat(&data, 0, TrioOutStreamCustom, NULL, format,
+                    unused, argfunc, (trio_pointer_t *)context, NULL);
 }
+#endif /* TRIO_FEATURE_CLOSURE && TRIO_FEATURE_ARGFUNC */
 
 /*************************************************************************
- * TrioOutStreamStringDynamic
+ * sprintf
  */
-#if TRIO_FEATURE_DYNAMICSTRING
-static void
-TrioOutStreamStringDynamic
-TRIO_ARGS2((self, output),
-	   trio_class_t *self,
-	   int output)
+
+/**
+   Print to string.
+
+   @param buffer Output string.
+   @param format Formatting string.
+   @param ... Arguments.
+   @return Number of printed characters.
+ */
+TRIO_PUBLIC int
+trio_sprintf
+TRIO_VARGS3((buffer, format, va_alist),
+	    char *buffer,
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
 {
-  assert(VALID(self));
-  assert(VALID(self->location));
+  int status;
+  va_list args;
 
-  if (self->error == 0)
-    {
-      trio_xstring_append_char((trio_string_t *)self->location,
-			       (char)output);
-      self->actually.committed++;
-    }
-  /* The processed variable must always be increased */
-  self->processed++;
+  assert(VALID(buffer));
+  assert(VALID(format));
+
+  TRIO_VA_START(args, format);
+  status = TrioFormat(&buffer, 0, TrioOutStreamString, TrioOutStreamStringBlock,
+		      format, args, NULL, NULL, NULL);
+  *buffer = NIL; /* Terminate with NIL character */
+  TRIO_VA_END(args);
+  return status;
 }
-#endif /* TRIO_FEATURE_DYNAMICSTRING */
 
-/*************************************************************************
- * TrioArrayGetter
+/**
+   Print to string.
+
+   @param buffer Output string.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of printed characters.
  */
-static
-trio_pointer_t TrioArrayGetter(trio_pointer_t context, int index, int type)
+TRIO_PUBLIC int
+trio_vsprintf
+TRIO_ARGS3((buffer, format, args),
+	   char *buffer,
+	   TRIO_CONST char *format,
+	   va_list args)
 {
-  /* Utility function for the printfv family */
-  trio_pointer_t *argarray = (trio_pointer_t *)context;
-  if (type) {}
-  return argarray[index];
+  int status;
+
+  assert(VALID(buffer));
+  assert(VALID(format));
+
+  status = TrioFormat(&buffer, 0, TrioOutStreamString, TrioOutStreamStringBlock,
+		      format, args, NULL, NULL, NULL);
+  *buffer = NIL;
+  return status;
 }
 
-/*************************************************************************
- *
- * Formatted printing functions
- *
- ************************************************************************/
+/**
+   Print to string.
+
+   @param buffer Output string.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of printed characters.
+ */
+TRIO_PUBLIC int
+trio_sprintfv
+TRIO_ARGS3((buffer, format, args),
+	   char *buffer,
+	   TRIO_CONST char *format,
+	   trio_pointer_t *args)
+{
+  static va_list unused;
+  int status;
+
+  assert(VALID(buffer));
+  assert(VALID(format));
 
-/** @addtogroup Printf
-    @{
-*/
+  status = TrioFormat(&buffer, 0, TrioOutStreamString, TrioOutStreamStringBlock,
+		      format,
+		      unused, TrioArrayGetter, args, NULL);
+  *buffer = NIL;
+  return status;
+}
 
 /*************************************************************************
- * printf
+ * snprintf
  */
 
 /**
-   Print to standard output stream.
+   Print at most @p max characters to string.
 
+   @param buffer Output string.
+   @param max Maximum number of characters to print.
    @param format Formatting string.
    @param ... Arguments.
    @return Number of printed characters.
  */
-#if TRIO_FEATURE_STDIO
 TRIO_PUBLIC int
-trio_printf
-TRIO_VARGS2((format, va_alist),
+trio_snprintf
+TRIO_VARGS4((buffer, max, format, va_alist),
+	    char *buffer,
+	    size_t max,
 	    TRIO_CONST char *format,
 	    TRIO_VA_DECL)
 {
   int status;
   va_list args;
 
+  assert(VALID(buffer) || (max == 0));
   assert(VALID(format));
 
   TRIO_VA_START(args, format);
-  status = TrioFormat(stdout, 0, TrioOutStreamFile, format, args, NULL, NULL);
+  status = TrioFormat(&buffer, max > 0 ? max - 1 : 0,
+		      TrioOutStreamStringMax, TrioOutStreamStringMaxBlock,
+		      format, args, NULL, NULL, NULL);
+  if (max > 0)
+    *buffer = NIL;
   TRIO_VA_END(args);
   return status;
 }
-#endif /* TRIO_FEATURE_STDIO */
 
 /**
-   Print to standard output stream.
+   Print at most @p max characters to string.
 
+   @param buffer Output string.
+   @param max Maximum number of characters to print.
    @param format Formatting string.
    @param args Arguments.
    @return Number of printed characters.
  */
-#if TRIO_FEATURE_STDIO
 TRIO_PUBLIC int
-trio_vprintf
-TRIO_ARGS2((format, args),
+trio_vsnprintf
+TRIO_ARGS4((buffer, max, format, args),
+	   char *buffer,
+	   size_t max,
 	   TRIO_CONST char *format,
 	   va_list args)
 {
-  assert(VALID(format));
-
-  return TrioFormat(stdout, 0, TrioOutStreamFile, format, args, NULL, NULL);
-}
-#endif /* TRIO_FEATURE_STDIO */
-
-/**
-   Print to standard output stream.
-
-   @param format Formatting string.
-   @param args Arguments.
-   @return Number of printed characters.
- */
-#if TRIO_FEATURE_STDIO
-TRIO_PUBLIC int
-trio_printfv
-TRIO_ARGS2((format, args),
-	   TRIO_CONST char *format,
-	   trio_pointer_t * args)
-{
-  static va_list unused;
+  int status;
 
+  assert(VALID(buffer) || (max == 0));
   assert(VALID(format));
 
-  return TrioFormat(stdout, 0, TrioOutStreamFile, format,
-		    unused, TrioArrayGetter, args);
+  status = TrioFormat(&buffer, max > 0 ? max - 1 : 0,
+		      TrioOutStreamStringMax, TrioOutStreamStringMaxBlock,
+		      format, args, NULL, NULL, NULL);
+  if (max > 0)
+    *buffer = NIL;
+  return status;
 }
-#endif /* TRIO_FEATURE_STDIO */
-
-/*************************************************************************
- * fprintf
- */
 
 /**
-   Print to file.
+   Print at most @p max characters to string using a given locale.
 
-   @param file File pointer.
+   @param buffer Output string.
+   @param max Maximum number of characters to print.
+   @param locale Locale object, or NULL for the current locale.
    @param format Formatting string.
    @param ... Arguments.
    @return Number of printed characters.
  */
-#if TRIO_FEATURE_FILE
+#if TRIO_FEATURE_LOCALE
 TRIO_PUBLIC int
-trio_fprintf
-TRIO_VARGS3((file, format, va_alist),
-	    FILE *file,
+trio_snprintf_l
+TRIO_VARGS5((buffer, max, locale, format, va_alist),
+	    char *buffer,
+	    size_t max,
+	    TRIO_CONST trio_locale_t *locale,
 	    TRIO_CONST char *format,
 	    TRIO_VA_DECL)
 {
   int status;
   va_list args;
 
-  assert(VALID(file));
+  assert(VALID(buffer) || (max == 0));
   assert(VALID(format));
 
   TRIO_VA_START(args, format);
-  status = TrioFormat(file, 0, TrioOutStreamFile, format, args, NULL, NULL);
+  status = TrioFormat(&buffer, max > 0 ? max - 1 : 0,
+		      TrioOutStreamStringMax, TrioOutStreamStringMaxBlock,
+		      format, args, NULL, NULL, locale);
+  if (max > 0)
+    *buffer = NIL;
   TRIO_VA_END(args);
   return status;
 }
-#endif /* TRIO_FEATURE_FILE */
+#endif /* TRIO_FEATURE_LOCALE */
 
 /**
-   Print to file.
+   Print at most @p max characters to string using a given locale.
 
-   @param file File pointer.
+   @param buffer Output string.
+   @param max Maximum number of characters to print.
+   @param locale Locale object, or NULL for the current locale.
    @param format Formatting string.
    @param args Arguments.
    @return Number of printed characters.
  */
-#if TRIO_FEATURE_FILE
+#if TRIO_FEATURE_LOCALE
 TRIO_PUBLIC int
-trio_vfprintf
-TRIO_ARGS3((file, format, args),
-	   FILE *file,
+trio_vsnprintf_l
+TRIO_ARGS5((buffer, max, locale, format, args),
+	   char *buffer,
+	   size_t max,
+	   TRIO_CONST trio_locale_t *locale,
 	   TRIO_CONST char *format,
 	   va_list args)
 {
-  assert(VALID(file));
+  int status;
+
+  assert(VALID(buffer) || (max == 0));
   assert(VALID(format));
 
-  return TrioFormat(file, 0, TrioOutStreamFile, format, args, NULL, NULL);
+  status = TrioFormat(&buffer, max > 0 ? max - 1 : 0,
+		      TrioOutStreamStringMax, TrioOutStreamStringMaxBlock,
+		      format, args, NULL, NULL, locale);
+  if (max > 0)
+    *buffer = NIL;
+  return status;
 }
-#endif /* TRIO_FEATURE_FILE */
+#endif /* TRIO_FEATURE_LOCALE */
 
 /**
-   Print to file.
+   Print at most @p max characters to string.
 
-   @param file File pointer.
+   @param buffer Output string.
+   @param max Maximum number of characters to print.
    @param format Formatting string.
    @param args Arguments.
    @return Number of printed characters.
  */
-#if TRIO_FEATURE_FILE
 TRIO_PUBLIC int
-trio_fprintfv
-TRIO_ARGS3((file, format, args),
-	   FILE *file,
+trio_snprintfv
+TRIO_ARGS4((buffer, max, format, args),
+	   char *buffer,
+	   size_t max,
 	   TRIO_CONST char *format,
-	   trio_pointer_t * args)
+	   trio_pointer_t *args)
 {
   static va_list unused;
+  int status;
 
-  assert(VALID(file));
+  assert(VALID(buffer) || (max == 0));
   assert(VALID(format));
 
-  return TrioFormat(file, 0, TrioOutStreamFile, format,
-		    unused, TrioArrayGetter, args);
+  status = TrioFormat(&buffer, max > 0 ? max - 1 : 0,
+		      TrioOutStreamStringMax, TrioOutStreamStringMaxBlock, format,
+		      unused, TrioArrayGetter, args, NULL);
+  if (max > 0)
+    *buffer = NIL;
+  return status;
 }
-#endif /* TRIO_FEATURE_FILE */
 
 /*************************************************************************
- * dprintf
- */
-
-/**
-   Print to file descriptor.
-
-   @param fd File descriptor.
-   @param format Formatting string.
-   @param ... Arguments.
-   @return Number of printed characters.
+ * snprintfcat
+ * Appends the new string to the buffer string overwriting the '\0'
+ * character at the end of buffer.
  */
-#if TRIO_FEATURE_FD
+#if TRIO_EXTENSION
 TRIO_PUBLIC int
-trio_dprintf
-TRIO_VARGS3((fd, format, va_alist),
-	    int fd,
+trio_snprintfcat
+TRIO_VARGS4((buffer, max, format, va_alist),
+	    char *buffer,
+	    size_t max,
 	    TRIO_CONST char *format,
 	    TRIO_VA_DECL)
 {
   int status;
   va_list args;
+  size_t buf_len;
+
+  TRIO_VA_START(args, format);
 
+  assert(VALID(buffer));
   assert(VALID(format));
 
-  TRIO_VA_START(args, format);
-  status = TrioFormat(&fd, 0, TrioOutStreamFileDescriptor, format, args, NULL, NULL);
+  buf_len = trio_length(buffer);
+  buffer = &buffer[buf_len];
+
+  status = TrioFormat(&buffer, max - 1 - buf_len,
+		      TrioOutStreamStringMax, TrioOutStreamStringMaxBlock,
+		      format, args, NULL, NULL, NULL);
   TRIO_VA_END(args);
+  *buffer = NIL;
   return status;
 }
-#endif /* TRIO_FEATURE_FD */
-
-/**
-   Print to file descriptor.
+#endif
 
-   @param fd File descriptor.
-   @param format Formatting string.
-   @param args Arguments.
-   @return Number of printed characters.
- */
-#if TRIO_FEATURE_FD
+#if TRIO_EXTENSION
 TRIO_PUBLIC int
-trio_vdprintf
-TRIO_ARGS3((fd, format, args),
-	   int fd,
+trio_vsnprintfcat
+TRIO_ARGS4((buffer, max, format, args),
+	   char *buffer,
+	   size_t max,
 	   TRIO_CONST char *format,
 	   va_list args)
 {
+  int status;
+  size_t buf_len;
+
+  assert(VALID(buffer));
   assert(VALID(format));
 
-  return TrioFormat(&fd, 0, TrioOutStreamFileDescriptor, format, args, NULL, NULL);
+  buf_len = trio_length(buffer);
+  buffer = &buffer[buf_len];
+  status = TrioFormat(&buffer, max - 1 - buf_len,
+		      TrioOutStreamStringMax, TrioOutStreamStringMaxBlock,
+		      format, args, NULL, NULL, NULL);
+  *buffer = NIL;
+  return status;
 }
-#endif /* TRIO_FEATURE_FD */
+#endif
+
+/*************************************************************************
+ * trio_set_allocator
+ */
 
 /**
-   Print to file descriptor.
+   Install a heap allocator.
+
+   All memory that trio allocates is obtained from @p allocator after
+   this call, unless another allocator is passed to one of the *_a
+   functions. Objects such as compiled formats and dynamic strings are
+   released by the allocator that provided them, so objects created
+   before the call are still valid afterwards. Strings returned by
+   trio_asprintf() and friends must be released with the deallocate
+   function of the allocator.
+
+   The string functions use the allocator as well, as if by
+   trio_string_set_allocator(). Plain strings from trio_create() and
+   trio_duplicate() do not remember their allocator, so they must be
+   released with trio_destroy() before the allocator is changed.
+
+   The allocator is not copied and must remain valid while it is used.
+   All three functions must be provided. This function should be called
+   before trio is used by other threads.
+
+   @param allocator Allocator, or NULL to use the default allocator.
+*/
+TRIO_PUBLIC void
+trio_set_allocator
+TRIO_ARGS1((allocator),
+	   TRIO_CONST trio_allocator_t *allocator)
+{
+  assert((allocator == NULL) || (VALID(allocator->allocate)
+				 && VALID(allocator->reallocate)
+				 && VALID(allocator->deallocate)));
 
-   @param fd File descriptor.
-   @param format Formatting string.
-   @param args Arguments.
-   @return Number of printed characters.
+  internalAllocator = allocator;
+  /* Also used by the string functions, such as trio_duplicate */
+  trio_string_set_allocator(allocator);
+}
+
+/*************************************************************************
+ * trio_aprintf
  */
-#if TRIO_FEATURE_FD
-TRIO_PUBLIC int
-trio_dprintfv
-TRIO_ARGS3((fd, format, args),
-	   int fd,
+
+#if TRIO_DEPRECATED && TRIO_FEATURE_DYNAMICSTRING
+TRIO_PUBLIC char *
+trio_aprintf
+TRIO_VARGS2((format, va_alist),
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
+{
+  va_list args;
+  char *result;
+
+  assert(VALID(format));
+
+  TRIO_VA_START(args, format);
+  (void)TrioFormatDynamic(NULL, &result, format, args, NULL, NULL);
+  TRIO_VA_END(args);
+  return result;
+}
+#endif /* TRIO_DEPRECATED && TRIO_FEATURE_DYNAMICSTRING */
+
+#if TRIO_DEPRECATED && TRIO_FEATURE_DYNAMICSTRING
+TRIO_PUBLIC char *
+trio_vaprintf
+TRIO_ARGS2((format, args),
 	   TRIO_CONST char *format,
-	   trio_pointer_t *args)
+	   va_list args)
 {
-  static va_list unused;
+  char *result;
 
   assert(VALID(format));
 
-  return TrioFormat(&fd, 0, TrioOutStreamFileDescriptor, format,
-		    unused, TrioArrayGetter, args);
+  (void)TrioFormatDynamic(NULL, &result, format, args, NULL, NULL);
+  return result;
 }
-#endif /* TRIO_FEATURE_FD */
+#endif /* TRIO_DEPRECATED && TRIO_FEATURE_DYNAMICSTRING */
 
-/*************************************************************************
- * cprintf
+/**
+   Allocate and print to string.
+   The memory allocated and returned by @p result must be freed by the
+   calling application.
+
+   @param result Output string.
+   @param format Formatting string.
+   @param ... Arguments.
+   @return Number of printed characters.
  */
-#if TRIO_FEATURE_CLOSURE
+#if TRIO_FEATURE_DYNAMICSTRING
 TRIO_PUBLIC int
-trio_cprintf
-TRIO_VARGS4((stream, closure, format, va_alist),
-	    trio_outstream_t stream,
-	    trio_pointer_t closure,
+trio_asprintf
+TRIO_VARGS3((result, format, va_alist),
+	    char **result,
 	    TRIO_CONST char *format,
 	    TRIO_VA_DECL)
 {
-  int status;
   va_list args;
-  trio_custom_t data;
+  int status;
 
-  assert(VALID(stream));
   assert(VALID(format));
 
   TRIO_VA_START(args, format);
-  data.stream.out = stream;
-  data.closure = closure;
-  status = TrioFormat(&data, 0, TrioOutStreamCustom, format, args, NULL, NULL);
+  status = TrioFormatDynamic(NULL, result, format, args, NULL, NULL);
   TRIO_VA_END(args);
   return status;
 }
-#endif /* TRIO_FEATURE_CLOSURE */
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
 
-#if TRIO_FEATURE_CLOSURE
+/**
+   Allocate and print to string.
+   The memory allocated and returned by @p result must be freed by the
+   calling application.
+
+   @param result Output string.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_DYNAMICSTRING
 TRIO_PUBLIC int
-trio_vcprintf
-TRIO_ARGS4((stream, closure, format, args),
-	   trio_outstream_t stream,
-	   trio_pointer_t closure,
+trio_vasprintf
+TRIO_ARGS3((result, format, args),
+	   char **result,
 	   TRIO_CONST char *format,
 	   va_list args)
 {
-  trio_custom_t data;
-
-  assert(VALID(stream));
   assert(VALID(format));
 
-  data.stream.out = stream;
-  data.closure = closure;
-  return TrioFormat(&data, 0, TrioOutStreamCustom, format, args, NULL, NULL);
+  return TrioFormatDynamic(NULL, result, format, args, NULL, NULL);
 }
-#endif /* TRIO_FEATURE_CLOSURE */
-
-#if TRIO_FEATURE_CLOSURE
-TRIO_PUBLIC int
-trio_cprintfv
-TRIO_ARGS4((stream, closure, format, args),
-	   trio_outstream_t stream,
-	   trio_pointer_t closure,
-	   TRIO_CONST char *format,
-	   trio_pointer_t *args)
-{
-  static va_list unused;
-  trio_custom_t data;
-
-  assert(VALID(stream));
-  assert(VALID(format));
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
 
-  data.stream.out = stream;
-  data.closure = closure;
-  return TrioFormat(&data, 0, TrioOutStreamCustom, format,
-		    unused, TrioArrayGetter, args);
-}
-#endif /* TRIO_FEATURE_CLOSURE */
+/**
+   Allocate and print to string.
+   The memory allocated and returned by @p result must be freed by the
+   calling application.
 
-#if TRIO_FEATURE_CLOSURE && TRIO_FEATURE_ARGFUNC
+   @param result Output string.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_DYNAMICSTRING
 TRIO_PUBLIC int
-trio_cprintff
-TRIO_ARGS5((stream, closure, format, argfunc, context),
-	   trio_outstream_t stream,
-	   trio_pointer_t closure,
-	   TRIO_CONST char *format,
-	   trio_argfunc_t argfunc,
-	   trio_pointer_t context)
+trio_asprintfv
+TRIO_ARGS3((result, format, args),
+           char **result,
+           TRIO_CONST char *format,
+           trio_pointer_t * args)
 {
   static va_list unused;
-  trio_custom_t data;
 
-  assert(VALID(stream));
   assert(VALID(format));
-  assert(VALID(argfunc));
 
-  data.stream.out = stream;
-  data.closure = closure;
-  return TrioFormat(&data, 0, TrioOutStreamCustom, format,
-                    unused, argfunc, (trio_pointer_t *)context);
+  return TrioFormatDynamic(NULL, result, format, unused, TrioArrayGetter, args);
 }
-#endif /* TRIO_FEATURE_CLOSURE && TRIO_FEATURE_ARGFUNC */
-
-/*************************************************************************
- * sprintf
- */
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
 
 /**
-   Print to string.
+   Append to buffer string.
 
-   @param buffer Output string.
+   The content of the buffer string remains zero terminated. If memory
+   allocation fails, an error is returned and the characters that did
+   not fit are discarded.
+
+   @param buffer Buffer string.
    @param format Formatting string.
    @param ... Arguments.
    @return Number of printed characters.
  */
+#if TRIO_FEATURE_DYNAMICSTRING
 TRIO_PUBLIC int
-trio_sprintf
+trio_bprintf
 TRIO_VARGS3((buffer, format, va_alist),
-	    char *buffer,
+	    trio_buffer_t *buffer,
 	    TRIO_CONST char *format,
 	    TRIO_VA_DECL)
 {
-  int status;
   va_list args;
+  int status;
 
   assert(VALID(buffer));
   assert(VALID(format));
 
   TRIO_VA_START(args, format);
-  status = TrioFormat(&buffer, 0, TrioOutStreamString, format, args, NULL, NULL);
-  *buffer = NIL; /* Terminate with NIL character */
+  status = TrioFormatBuffer(buffer, format, args, NULL, NULL);
   TRIO_VA_END(args);
   return status;
 }
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
 
 /**
-   Print to string.
+   Append to buffer string.
 
-   @param buffer Output string.
+   @param buffer Buffer string.
    @param format Formatting string.
    @param args Arguments.
    @return Number of printed characters.
  */
+#if TRIO_FEATURE_DYNAMICSTRING
 TRIO_PUBLIC int
-trio_vsprintf
+trio_vbprintf
 TRIO_ARGS3((buffer, format, args),
-	   char *buffer,
+	   trio_buffer_t *buffer,
 	   TRIO_CONST char *format,
 	   va_list args)
 {
-  int status;
-
   assert(VALID(buffer));
   assert(VALID(format));
 
-  status = TrioFormat(&buffer, 0, TrioOutStreamString, format, args, NULL, NULL);
-  *buffer = NIL;
-  return status;
+  return TrioFormatBuffer(buffer, format, args, NULL, NULL);
 }
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
 
 /**
-   Print to string.
+   Append to buffer string.
 
-   @param buffer Output string.
+   @param buffer Buffer string.
    @param format Formatting string.
    @param args Arguments.
    @return Number of printed characters.
  */
+#if TRIO_FEATURE_DYNAMICSTRING
 TRIO_PUBLIC int
-trio_sprintfv
+trio_bprintfv
 TRIO_ARGS3((buffer, format, args),
-	   char *buffer,
+	   trio_buffer_t *buffer,
 	   TRIO_CONST char *format,
 	   trio_pointer_t *args)
 {
   static va_list unused;
-  int status;
 
   assert(VALID(buffer));
   assert(VALID(format));
 
-  status = TrioFormat(&buffer, 0, TrioOutStreamString, format,
-		      unused, TrioArrayGetter, args);
-  *buffer = NIL;
-  return status;
+  return TrioFormatBuffer(buffer, format, unused, TrioArrayGetter, args);
 }
-
-/*************************************************************************
- * snprintf
- */
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
 
 /**
-   Print at most @p max characters to string.
+   Allocate with an allocator and print to string.
+   The memory allocated and returned by @p result must be released with
+   the deallocate function of @p allocator.
 
-   @param buffer Output string.
-   @param max Maximum number of characters to print.
+   @param allocator Allocator, or NULL to use the installed allocator.
+   @param result Output string.
    @param format Formatting string.
    @param ... Arguments.
    @return Number of printed characters.
  */
+#if TRIO_FEATURE_DYNAMICSTRING
 TRIO_PUBLIC int
-trio_snprintf
-TRIO_VARGS4((buffer, max, format, va_alist),
-	    char *buffer,
-	    size_t max,
+trio_asprintf_a
+TRIO_VARGS4((allocator, result, format, va_alist),
+	    TRIO_CONST trio_allocator_t *allocator,
+	    char **result,
 	    TRIO_CONST char *format,
 	    TRIO_VA_DECL)
 {
-  int status;
   va_list args;
+  int status;
 
-  assert(VALID(buffer) || (max == 0));
   assert(VALID(format));
 
   TRIO_VA_START(args, format);
-  status = TrioFormat(&buffer, max > 0 ? max - 1 : 0,
-		      TrioOutStreamStringMax, format, args, NULL, NULL);
-  if (max > 0)
-    *buffer = NIL;
+  status = TrioFormatDynamic(allocator, result, format, args, NULL, NULL);
   TRIO_VA_END(args);
   return status;
 }
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
 
 /**
-   Print at most @p max characters to string.
+   Allocate with an allocator and print to string.
+   The memory allocated and returned by @p result must be released with
+   the deallocate function of @p allocator.
 
-   @param buffer Output string.
-   @param max Maximum number of characters to print.
+   @param allocator Allocator, or NULL to use the installed allocator.
+   @param result Output string.
    @param format Formatting string.
    @param args Arguments.
    @return Number of printed characters.
  */
+#if TRIO_FEATURE_DYNAMICSTRING
 TRIO_PUBLIC int
-trio_vsnprintf
-TRIO_ARGS4((buffer, max, format, args),
-	   char *buffer,
-	   size_t max,
+trio_vasprintf_a
+TRIO_ARGS4((allocator, result, format, args),
+	   TRIO_CONST trio_allocator_t *allocator,
+	   char **result,
 	   TRIO_CONST char *format,
 	   va_list args)
 {
-  int status;
-
-  assert(VALID(buffer) || (max == 0));
   assert(VALID(format));
 
-  status = TrioFormat(&buffer, max > 0 ? max - 1 : 0,
-		      TrioOutStreamStringMax, format, args, NULL, NULL);
-  if (max > 0)
-    *buffer = NIL;
-  return status;
+  return TrioFormatDynamic(allocator, result, format, args, NULL, NULL);
 }
+#endif /* TRIO_FEATURE_DYNAMICSTRING */
+
+/*************************************************************************
+ * Compiled formats
+ */
 
 /**
-   Print at most @p max characters to string.
+   Compile a format string.
+
+   The format string is parsed once, and the result can be used to
+   print any number of times with the *printf_compiled functions,
+   which only have to fetch the arguments. The compiled format does
+   not refer to @p format after the call, and it is not modified when
+   used, so it can be shared between threads.
 
-   @param buffer Output string.
-   @param max Maximum number of characters to print.
    @param format Formatting string.
-   @param args Arguments.
-   @return Number of printed characters.
- */
-TRIO_PUBLIC int
-trio_snprintfv
-TRIO_ARGS4((buffer, max, format, args),
-	   char *buffer,
-	   size_t max,
-	   TRIO_CONST char *format,
-	   trio_pointer_t *args)
+   @return Compiled format, or NULL if the format string is invalid or
+   allocation failed.
+*/
+#if TRIO_FEATURE_COMPILE
+TRIO_PUBLIC trio_format_t *
+trio_format_compile
+TRIO_ARGS1((format),
+	   TRIO_CONST char *format)
 {
-  static va_list unused;
-  int status;
+  return trio_format_compile_a(NULL, format);
+}
+#endif /* TRIO_FEATURE_COMPILE */
 
-  assert(VALID(buffer) || (max == 0));
+/**
+   Compile a format string with an allocator.
+
+   The compiled format is allocated with @p allocator, and it is
+   released with the same allocator by trio_format_destroy().
+
+   @param allocator Allocator, or NULL to use the installed allocator.
+   @param format Formatting string.
+   @return Compiled format, or NULL if the format string is invalid or
+   allocation failed.
+*/
+#if TRIO_FEATURE_COMPILE
+TRIO_PUBLIC trio_format_t *
+trio_format_compile_a
+TRIO_ARGS2((allocator, format),
+	   TRIO_CONST trio_allocator_t *allocator,
+	   TRIO_CONST char *format)
+{
   assert(VALID(format));
 
-  status = TrioFormat(&buffer, max > 0 ? max - 1 : 0,
-		      TrioOutStreamStringMax, format,
-		      unused, TrioArrayGetter, args);
-  if (max > 0)
-    *buffer = NIL;
-  return status;
+  return TrioFormatCompile(TrioGetAllocator(allocator), format);
 }
+#endif /* TRIO_FEATURE_COMPILE */
 
-/*************************************************************************
- * snprintfcat
- * Appends the new string to the buffer string overwriting the '\0'
- * character at the end of buffer.
+/**
+   Destroy a compiled format.
+
+   @param compiled Compiled format.
+*/
+#if TRIO_FEATURE_COMPILE
+TRIO_PUBLIC void
+trio_format_destroy
+TRIO_ARGS1((compiled),
+	   trio_format_t *compiled)
+{
+  if (compiled)
+    {
+      TrioDeallocate(compiled->allocator, compiled->parameters);
+      TrioDeallocate(compiled->allocator, compiled);
+    }
+}
+#endif /* TRIO_FEATURE_COMPILE */
+
+/**
+   Print to standard output stream with a compiled format.
+
+   @param compiled Compiled format.
+   @param ... Arguments.
+   @return Number of printed characters.
  */
-#if TRIO_EXTENSION
+#if TRIO_FEATURE_COMPILE && TRIO_FEATURE_STDIO
 TRIO_PUBLIC int
-trio_snprintfcat
-TRIO_VARGS4((buffer, max, format, va_alist),
-	    char *buffer,
-	    size_t max,
-	    TRIO_CONST char *format,
+trio_printf_compiled
+TRIO_VARGS2((compiled, va_alist),
+	    TRIO_CONST trio_format_t *compiled,
 	    TRIO_VA_DECL)
 {
   int status;
   va_list args;
-  size_t buf_len;
-
-  TRIO_VA_START(args, format);
-
-  assert(VALID(buffer));
-  assert(VALID(format));
 
-  buf_len = trio_length(buffer);
-  buffer = &buffer[buf_len];
+  assert(VALID(compiled));
 
-  status = TrioFormat(&buffer, max - 1 - buf_len,
-		      TrioOutStreamStringMax, format, args, NULL, NULL);
+  TRIO_VA_START(args, compiled);
+  status = TrioFormatFile(stdout, NULL, compiled, args, NULL, NULL);
   TRIO_VA_END(args);
-  *buffer = NIL;
   return status;
 }
-#endif
+#endif /* TRIO_FEATURE_COMPILE && TRIO_FEATURE_STDIO */
 
-#if TRIO_EXTENSION
+/**
+   Print to standard output stream with a compiled format.
+
+   @param compiled Compiled format.
+   @param args Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_COMPILE && TRIO_FEATURE_STDIO
 TRIO_PUBLIC int
-trio_vsnprintfcat
-TRIO_ARGS4((buffer, max, format, args),
-	   char *buffer,
-	   size_t max,
-	   TRIO_CONST char *format,
+trio_vprintf_compiled
+TRIO_ARGS2((compiled, args),
+	   TRIO_CONST trio_format_t *compiled,
 	   va_list args)
 {
-  int status;
-  size_t buf_len;
+  assert(VALID(compiled));
 
-  assert(VALID(buffer));
-  assert(VALID(format));
-
-  buf_len = trio_length(buffer);
-  buffer = &buffer[buf_len];
-  status = TrioFormat(&buffer, max - 1 - buf_len,
-		      TrioOutStreamStringMax, format, args, NULL, NULL);
-  *buffer = NIL;
-  return status;
+  return TrioFormatFile(stdout, NULL, compiled, args, NULL, NULL);
 }
-#endif
+#endif /* TRIO_FEATURE_COMPILE && TRIO_FEATURE_STDIO */
 
-/*************************************************************************
- * trio_aprintf
- */
+/**
+   Print to stream with a compiled format.
 
-#if TRIO_DEPRECATED && TRIO_FEATURE_DYNAMICSTRING
-TRIO_PUBLIC char *
-trio_aprintf
-TRIO_VARGS2((format, va_alist),
-	    TRIO_CONST char *format,
+   @param file Stream.
+   @param compiled Compiled format.
+   @param ... Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_COMPILE && TRIO_FEATURE_FILE
+TRIO_PUBLIC int
+trio_fprintf_compiled
+TRIO_VARGS3((file, compiled, va_alist),
+	    FILE *file,
+	    TRIO_CONST trio_format_t *compiled,
 	    TRIO_VA_DECL)
 {
+  int status;
   va_list args;
-  trio_string_t *info;
-  char *result = NULL;
 
-  assert(VALID(format));
-
-  info = trio_xstring_duplicate("");
-  if (info)
-    {
-      TRIO_VA_START(args, format);
-      (void)TrioFormat(info, 0, TrioOutStreamStringDynamic,
-		       format, args, NULL, NULL);
-      TRIO_VA_END(args);
+  assert(VALID(file));
+  assert(VALID(compiled));
 
-      trio_string_terminate(info);
-      result = trio_string_extract(info);
-      trio_string_destroy(info);
-    }
-  return result;
+  TRIO_VA_START(args, compiled);
+  status = TrioFormatFile(file, NULL, compiled, args, NULL, NULL);
+  TRIO_VA_END(args);
+  return status;
 }
-#endif /* TRIO_DEPRECATED && TRIO_FEATURE_DYNAMICSTRING */
+#endif /* TRIO_FEATURE_COMPILE && TRIO_FEATURE_FILE */
 
-#if TRIO_DEPRECATED && TRIO_FEATURE_DYNAMICSTRING
-TRIO_PUBLIC char *
-trio_vaprintf
-TRIO_ARGS2((format, args),
-	   TRIO_CONST char *format,
+/**
+   Print to stream with a compiled format.
+
+   @param file Stream.
+   @param compiled Compiled format.
+   @param args Arguments.
+   @return Number of printed characters.
+ */
+#if TRIO_FEATURE_COMPILE && TRIO_FEATURE_FILE
+TRIO_PUBLIC int
+trio_vfprintf_compiled
+TRIO_ARGS3((file, compiled, args),
+	   FILE *file,
+	   TRIO_CONST trio_format_t *compiled,
 	   va_list args)
 {
-  trio_string_t *info;
-  char *result = NULL;
-
-  assert(VALID(format));
+  assert(VALID(file));
+  assert(VALID(compiled));
 
-  info = trio_xstring_duplicate("");
-  if (info)
-    {
-      (void)TrioFormat(info, 0, TrioOutStreamStringDynamic,
-		       format, args, NULL, NULL);
-      trio_string_terminate(info);
-      result = trio_string_extract(info);
-      trio_string_destroy(info);
-    }
-  return result;
+  return TrioFormatFile(file, NULL, compiled, args, NULL, NULL);
 }
-#endif /* TRIO_DEPRECATED && TRIO_FEATURE_DYNAMICSTRING */
+#endif /* TRIO_FEATURE_COMPILE && TRIO_FEATURE_FILE */
 
 /**
-   Allocate and print to string.
-   The memory allocated and returned by @p result must be freed by the
-   calling application.
+   Print at most @p max characters to string with a compiled format.
 
-   @param result Output string.
-   @param format Formatting string.
+   @param buffer Output string.
+   @param max Maximum number of characters to print.
+   @param compiled Compiled format.
    @param ... Arguments.
    @return Number of printed characters.
  */
-#if TRIO_FEATURE_DYNAMICSTRING
+#if TRIO_FEATURE_COMPILE
 TRIO_PUBLIC int
-trio_asprintf
-TRIO_VARGS3((result, format, va_alist),
-	    char **result,
-	    TRIO_CONST char *format,
+trio_snprintf_compiled
+TRIO_VARGS4((buffer, max, compiled, va_alist),
+	    char *buffer,
+	    size_t max,
+	    TRIO_CONST trio_format_t *compiled,
 	    TRIO_VA_DECL)
 {
-  va_list args;
   int status;
-  trio_string_t *info;
-
-  assert(VALID(format));
+  va_list args;
 
-  *result = NULL;
+  assert(VALID(buffer) || (max == 0));
+  assert(VALID(compiled));
 
-  info = trio_xstring_duplicate("");
-  if (info == NULL)
-    {
-      status = TRIO_ERROR_RETURN(TRIO_ENOMEM, 0);
-    }
-  else
-    {
-      TRIO_VA_START(args, format);
-      status = TrioFormat(info, 0, TrioOutStreamStringDynamic,
-			  format, args, NULL, NULL);
-      TRIO_VA_END(args);
-      if (status >= 0)
-	{
-	  trio_string_terminate(info);
-	  *result = trio_string_extract(info);
-	}
-      trio_string_destroy(info);
-    }
+  TRIO_VA_START(args, compiled);
+  status = TrioFormatCompiled(&buffer, max > 0 ? max - 1 : 0,
+			      TrioOutStreamStringMax, TrioOutStreamStringMaxBlock,
+			      compiled, args, NULL, NULL, NULL);
+  if (max > 0)
+    *buffer = NIL;
+  TRIO_VA_END(args);
   return status;
 }
-#endif /* TRIO_FEATURE_DYNAMICSTRING */
+#endif /* TRIO_FEATURE_COMPILE */
 
 /**
-   Allocate and print to string.
-   The memory allocated and returned by @p result must be freed by the
-   calling application.
+   Print at most @p max characters to string with a compiled format.
 
-   @param result Output string.
-   @param format Formatting string.
+   @param buffer Output string.
+   @param max Maximum number of characters to print.
+   @param compiled Compiled format.
    @param args Arguments.
    @return Number of printed characters.
  */
-#if TRIO_FEATURE_DYNAMICSTRING
+#if TRIO_FEATURE_COMPILE
 TRIO_PUBLIC int
-trio_vasprintf
-TRIO_ARGS3((result, format, args),
-	   char **result,
-	   TRIO_CONST char *format,
+trio_vsnprintf_compiled
+TRIO_ARGS4((buffer, max, compiled, args),
+	   char *buffer,
+	   size_t max,
+	   TRIO_CONST trio_format_t *compiled,
 	   va_list args)
 {
   int status;
-  trio_string_t *info;
-
-  assert(VALID(format));
 
-  *result = NULL;
+  assert(VALID(buffer) || (max == 0));
+  assert(VALID(compiled));
 
-  info = trio_xstring_duplicate("");
-  if (info == NULL)
-    {
-      status = TRIO_ERROR_RETURN(TRIO_ENOMEM, 0);
-    }
-  else
-    {
-      status = TrioFormat(info, 0, TrioOutStreamStringDynamic,
-			  format, args, NULL, NULL);
-      if (status >= 0)
-	{
-	  trio_string_terminate(info);
-	  *result = trio_string_extract(info);
-	}
-      trio_string_destroy(info);
-    }
+  status = TrioFormatCompiled(&buffer, max > 0 ? max - 1 : 0,
+			      TrioOutStreamStringMax, TrioOutStreamStringMaxBlock,
+			      compiled, args, NULL, NULL, NULL);
+  if (max > 0)
+    *buffer = NIL;
   return status;
 }
-#endif /* TRIO_FEATURE_DYNAMICSTRING */
+#endif /* TRIO_FEATURE_COMPILE */
 
 /**
-   Allocate and print to string.
-   The memory allocated and returned by @p result must be freed by the
-   calling application.
+   Enable or disable the cache of parsed format strings.
 
-   @param result Output string.
-   @param format Formatting string.
-   @param args Arguments.
-   @return Number of printed characters.
- */
-#if TRIO_FEATURE_DYNAMICSTRING
+   When enabled, the printf functions remember the parsed format
+   strings, so formatting with the same format string again does not
+   parse it again. The cache is keyed by the address of the format
+   string, and is intended for format strings that are string literals.
+   The cache has a fixed number of entries, which are kept until
+   @ref trio_format_cache_clear is called.
+
+   @param enable Non-zero to enable the cache, zero to disable it.
+   @return Non-zero if the cache is available on this platform.
+*/
+#if TRIO_FEATURE_FORMAT_CACHE
 TRIO_PUBLIC int
-trio_asprintfv
-TRIO_ARGS3((result, format, args),
-           char **result,
-           TRIO_CONST char *format,
-           trio_pointer_t * args)
+trio_format_cache_enable
+TRIO_ARGS1((enable),
+	   int enable)
 {
-  static va_list unused;
-  int status;
-  trio_string_t *info;
+#if defined(USE_FORMAT_CACHE)
+  TRIO_ATOMIC_STORE(internalFormatCacheEnabled, (enable != 0));
+  return TRUE;
+#else
+  (void)enable;
+  return FALSE;
+#endif
+}
+#endif /* TRIO_FEATURE_FORMAT_CACHE */
 
-  assert(VALID(format));
+/**
+   Remove all entries from the cache of parsed format strings, and reset
+   the statistics.
 
-  *result = NULL;
+   This must not be called while other threads are formatting.
+*/
+#if TRIO_FEATURE_FORMAT_CACHE
+TRIO_PUBLIC void
+trio_format_cache_clear(TRIO_NOARGS)
+{
+#if defined(USE_FORMAT_CACHE)
+  int i;
 
-  info = trio_xstring_duplicate("");
-  if (info == NULL)
-    {
-      status = TRIO_ERROR_RETURN(TRIO_ENOMEM, 0);
-    }
-  else
+  for (i = 0; i < MAX_FORMAT_CACHE; i++)
     {
-      status = TrioFormat(info, 0, TrioOutStreamStringDynamic, format,
-                          unused, TrioArrayGetter, args);
-      if (status >= 0)
-        {
-          trio_string_terminate(info);
-          *result = trio_string_extract(info);
-        }
-      trio_string_destroy(info);
+      trio_format_destroy(internalFormatCache[i]);
+      internalFormatCache[i] = NULL;
     }
-  return status;
+  internalFormatCacheHits = 0;
+  internalFormatCacheMisses = 0;
+#endif
 }
-#endif /* TRIO_FEATURE_DYNAMICSTRING */
+#endif /* TRIO_FEATURE_FORMAT_CACHE */
+
+/**
+   Get the statistics of the cache of parsed format strings.
+
+   @param hits Number of format strings found in the cache.
+   @param misses Number of format strings not found in the cache.
+*/
+#if TRIO_FEATURE_FORMAT_CACHE
+TRIO_PUBLIC void
+trio_format_cache_statistics
+TRIO_ARGS2((hits, misses),
+	   unsigned long *hits,
+	   unsigned long *misses)
+{
+#if defined(USE_FORMAT_CACHE)
+  if (hits)
+    *hits = TRIO_ATOMIC_LOAD(internalFormatCacheHits);
+  if (misses)
+    *misses = TRIO_ATOMIC_LOAD(internalFormatCacheMisses);
+#else
+  if (hits)
+    *hits = 0;
+  if (misses)
+    *misses = 0;
+#endif
+}
+#endif /* TRIO_FEATURE_FORMAT_CACHE */
 
 #if defined(TRIO_DOCUMENTATION)
 # include "doc/doc_printf.h"
@@ -4969,8 +7690,11 @@ TRIO_ARGS2((callback, name),
 	   trio_callback_t callback,
 	   TRIO_CONST char *name)
 {
+  TRIO_CONST trio_allocator_t *allocator;
   trio_userdef_t *def;
-  trio_userdef_t *prev = NULL;
+  trio_userdef_t *other;
+  trio_userdef_t **bucket = NULL;
+  size_t length = 0;
 
   if (callback == NULL)
     return NULL;
@@ -4992,38 +7716,58 @@ TRIO_ARGS2((callback, name),
 	}
 
       /* Bail out if namespace is too long */
-      if (trio_length(name) >= MAX_USER_NAME)
-	return NULL;
-
-      /* Bail out if namespace already is registered */
-      def = TrioFindNamespace(name, &prev);
-      if (def)
+      length = trio_length(name) + 1;
+      if (length > MAX_USER_NAME)
 	return NULL;
     }
 
-  def = (trio_userdef_t *)TRIO_MALLOC(sizeof(trio_userdef_t));
+  allocator = TrioGetAllocator(NULL);
+  def = (trio_userdef_t *)TrioAllocate(allocator, sizeof(trio_userdef_t) + length);
   if (def)
     {
-      if (internalEnterCriticalRegion)
-	(void)internalEnterCriticalRegion(NULL);
-
+      /* Initialize */
+      def->callback = callback;
+      def->allocator = allocator;
+      def->retired = NULL;
+      /* The name is stored after the entry */
+      def->name = NULL;
+      def->hash = 0;
       if (name)
 	{
-	  /* Link into internal list */
-	  if (prev == NULL)
-	    internalUserDef = def;
-	  else
-	    prev->next = def;
+	  def->name = (char *)&def[1];
+	  memcpy(def->name, name, length);
+	  def->hash = TrioHashNamespace(name);
+	  bucket = &internalUserDef[def->hash & (MAX_USER_BUCKETS - 1)];
 	}
-      /* Initialize */
-      def->callback = callback;
-      def->name = (name == NULL)
-	? NULL
-	: trio_duplicate(name);
       def->next = NULL;
 
-      if (internalLeaveCriticalRegion)
-	(void)internalLeaveCriticalRegion(NULL);
+      if (bucket)
+	{
+	  if (internalEnterCriticalRegion)
+	    (void)internalEnterCriticalRegion(NULL);
+
+	  /* Bail out if namespace already is registered */
+	  for (other = *bucket; other; other = other->next)
+	    {
+	      if ((other->hash == def->hash) && trio_equal_case(other->name, name))
+		break;
+	    }
+	  if (other == NULL)
+	    {
+	      /* Publish the complete entry at the head of the bucket */
+	      def->next = *bucket;
+	      TRIO_ATOMIC_STORE(*bucket, def);
+	    }
+
+	  if (internalLeaveCriticalRegion)
+	    (void)internalLeaveCriticalRegion(NULL);
+
+	  if (other)
+	    {
+	      TrioDeallocate(allocator, def);
+	      def = NULL;
+	    }
+	}
     }
   return (trio_pointer_t)def;
 }
@@ -5031,6 +7775,12 @@ TRIO_ARGS2((callback, name),
 /**
    Unregister an existing user-defined specifier.
 
+   The specifier is unlinked at once. Formatting that looks up a
+   specifier by name in another thread may still be visiting the entry,
+   in which case its memory is released when the last of those lookups
+   finishes.
+   The handle itself must not be used after this call.
+
    @param handle
  */
 TRIO_PUBLIC
@@ -5040,30 +7790,48 @@ TRIO_ARGS1((handle),
 	   trio_pointer_t handle)
 {
   trio_userdef_t *self = (trio_userdef_t *)handle;
-  trio_userdef_t *def;
-  trio_userdef_t *prev = NULL;
+  trio_userdef_t **link;
+  trio_userdef_t *retired;
 
   assert(VALID(self));
 
-  if (self->name)
+  if (self->name == NULL)
+    {
+      /* Unnamed specifiers are only reachable through the handle */
+      TrioDeallocate(self->allocator, self);
+    }
+  else
     {
-      def = TrioFindNamespace(self->name, &prev);
-      if (def)
+      if (internalEnterCriticalRegion)
+	(void)internalEnterCriticalRegion(NULL);
+
+      for (link = &internalUserDef[self->hash & (MAX_USER_BUCKETS - 1)];
+	   *link;
+	   link = &(*link)->next)
 	{
-	  if (internalEnterCriticalRegion)
-	    (void)internalEnterCriticalRegion(NULL);
+	  if (*link == self)
+	    {
+	      /* Readers positioned at self can still follow self->next */
+	      TRIO_ATOMIC_STORE(*link, self->next);
+	      break;
+	    }
+	}
 
-	  if (prev == NULL)
-	    internalUserDef = internalUserDef->next;
-	  else
-	    prev->next = def->next;
+      /*
+       * Retire the entry instead of releasing it. A reader that starts
+       * after the unlink above cannot reach any retired entry, so the
+       * retired entries are released here if there are no readers, or
+       * else by the last reader in TrioReleaseNamespace.
+       */
+      self->retired = internalUserRetired;
+      TRIO_ATOMIC_STORE(internalUserRetired, self);
+      retired = TrioTakeRetired();
 
-	  if (internalLeaveCriticalRegion)
-	    (void)internalLeaveCriticalRegion(NULL);
-	}
-      trio_destroy(self->name);
+      if (internalLeaveCriticalRegion)
+	(void)internalLeaveCriticalRegion(NULL);
+
+      TrioDeallocateRetired(retired);
     }
-  TRIO_FREE(self);
 }
 
 /*************************************************************************
@@ -5770,6 +8538,8 @@ TRIO_ARGS2((ref, pointer),
  * Decimal point can only be one character. The input argument is a
  * string to enable multibyte characters. At most MB_LEN_MAX characters
  * will be used.
+ *
+ * This changes the default locale, which is shared by all threads.
  */
 #if TRIO_FEATURE_LOCALE
 TRIO_PUBLIC void
@@ -5783,18 +8553,7 @@ TRIO_ARGS1((decimalPoint),
       TrioSetLocale();
     }
 #endif
-  internalDecimalPointLength = trio_length(decimalPoint);
-  if (internalDecimalPointLength == 1)
-    {
-      internalDecimalPoint = *decimalPoint;
-    }
-  else
-    {
-      internalDecimalPoint = NIL;
-      trio_copy_max(internalDecimalPointString,
-		    sizeof(internalDecimalPointString),
-		    decimalPoint);
-    }
+  TrioLocaleSetDecimalPoint(&internalLocale, decimalPoint);
 }
 #endif
 
@@ -5815,10 +8574,7 @@ TRIO_ARGS1((thousandSeparator),
       TrioSetLocale();
     }
 # endif
-  trio_copy_max(internalThousandSeparator,
-		sizeof(internalThousandSeparator),
-		thousandSeparator);
-  internalThousandSeparatorLength = trio_length(internalThousandSeparator);
+  TrioLocaleSetThousandSeparator(&internalLocale, thousandSeparator);
 }
 #endif
 
@@ -5846,19 +8602,226 @@ TRIO_ARGS1((grouping),
       TrioSetLocale();
     }
 # endif
-  trio_copy_max(internalGrouping,
-		sizeof(internalGrouping),
-		grouping);
+  TrioLocaleSetGrouping(&internalLocale, grouping);
+}
+#endif
+
+#if TRIO_FEATURE_LOCALE
+
+/**
+   Create a locale object.
+
+   A locale object holds the decimal point, thousand separator and
+   grouping used for formatting and scanning numbers. It cannot be
+   changed after it has been created, so it can be shared freely
+   between threads. It is used either by passing it to the functions
+   ending in @c _l, or by attaching it to a thread with
+   @ref trio_locale_use.
+
+   @param decimalPoint Decimal point, or NULL to use the one of the
+   current C locale.
+   @param thousandSeparator Thousand separator, or NULL to use the one
+   of the current C locale.
+   @param grouping Grouping (see @c grouping in @c LC_NUMERIC), or NULL
+   to use the one of the current C locale.
+   @return Locale object, or NULL if memory could not be allocated.
+
+   The object is allocated with the allocator set by
+   @ref trio_set_allocator and must be released with
+   @ref trio_locale_destroy.
+*/
+TRIO_PUBLIC trio_locale_t *
+trio_locale_create
+TRIO_ARGS3((decimalPoint, thousandSeparator, grouping),
+	   TRIO_CONST char *decimalPoint,
+	   TRIO_CONST char *thousandSeparator,
+	   TRIO_CONST char *grouping)
+{
+  TRIO_CONST trio_allocator_t *allocator = TrioGetAllocator(NULL);
+  trio_locale_t *locale;
+
+  locale = (trio_locale_t *)TrioAllocate(allocator, sizeof(trio_locale_t));
+  if (locale)
+    {
+      /* Start from the built-in conventions */
+      TrioLocaleSetDecimalPoint(locale, ".");
+      TrioLocaleSetThousandSeparator(locale, ",");
+      locale->grouping[0] = (char)NO_GROUPING;
+      locale->allocator = allocator;
+#if defined(USE_LOCALE)
+      TrioLocaleFromSystem(locale,
+			   (decimalPoint == NULL),
+			   (thousandSeparator == NULL),
+			   (grouping == NULL));
+#endif
+      if (decimalPoint)
+	TrioLocaleSetDecimalPoint(locale, decimalPoint);
+      if (thousandSeparator)
+	TrioLocaleSetThousandSeparator(locale, thousandSeparator);
+      if (grouping)
+	TrioLocaleSetGrouping(locale, grouping);
+    }
+  return locale;
+}
+
+/**
+   Destroy a locale object.
+
+   @param locale Locale object created by @ref trio_locale_create.
+
+   The locale must not be in use by any thread.
+*/
+TRIO_PUBLIC void
+trio_locale_destroy
+TRIO_ARGS1((locale),
+	   trio_locale_t *locale)
+{
+  if (locale)
+    TrioDeallocate(locale->allocator, locale);
+}
+
+/**
+   Attach a locale object to the calling thread.
+
+   The locale is used by all formatting and scanning functions called
+   from this thread, except the @c _l functions, which use their own
+   locale argument.
+
+   @param locale Locale object, or NULL to return to the default locale.
+   @return The locale that was previously attached to the thread.
+
+   On compilers without thread-local storage the attached locale is
+   shared by all threads.
+*/
+TRIO_PUBLIC TRIO_CONST trio_locale_t *
+trio_locale_use
+TRIO_ARGS1((locale),
+	   TRIO_CONST trio_locale_t *locale)
+{
+  TRIO_CONST trio_locale_t *previous = internalThreadLocale;
+
+  internalThreadLocale = locale;
+  return previous;
+}
+
+#endif /* TRIO_FEATURE_LOCALE */
+
+/*************************************************************************
+ *
+ * SCANNING
+ *
+ ************************************************************************/
+
+#if TRIO_FEATURE_SCANF
+
+static void TrioInStreamString TRIO_PROTO((trio_class_t *self, int *intPointer));
+static void TrioInStreamStringMax TRIO_PROTO((trio_class_t *self, int *intPointer));
+
+/* Streams that read directly from a string held in memory */
+#define IS_STRING_STREAM(self) \
+  (((self)->InStream == TrioInStreamString) || \
+   ((self)->InStream == TrioInStreamStringMax))
+
+/*************************************************************************
+ * TrioStringWidth
+ *
+ * Description:
+ *  Limit the width of a fast path for string streams to the characters
+ *  that are left in a bounded string, including the current one.
+ */
+static int
+TrioStringWidth
+TRIO_ARGS2((self, width),
+	   trio_class_t *self,
+	   int width)
+{
+  int left;
+
+  if (self->InStream != TrioInStreamStringMax)
+    return width;
+
+  left = self->max - self->processed + 1;
+  return ((width == NO_WIDTH) || (width > left)) ? left : width;
 }
-#endif
 
 /*************************************************************************
+ * TrioStringAdvance
  *
- * SCANNING
+ * Description:
+ *  Move a string stream forward to end, which must not be before the
+ *  current character, leaving it exactly as if the characters up to end
+ *  had been read one by one. The character at end is loaded through the
+ *  regular stream, so the terminating zero and the limit of bounded
+ *  strings are handled there. Returns the new current character.
+ */
+static int
+TrioStringAdvance
+TRIO_ARGS2((self, end),
+	   trio_class_t *self,
+	   TRIO_CONST unsigned char *end)
+{
+  unsigned char **buffer;
+
+  assert(IS_STRING_STREAM(self));
+  assert(self->current != EOF);
+
+  /* The current character has already been consumed from the string */
+  buffer = (unsigned char **)self->location;
+  self->processed += (int)(end - (*buffer - 1)) - 1;
+  *buffer = (unsigned char *)end;
+  self->InStream(self, NULL);
+  return self->current;
+}
+
+/*************************************************************************
+ * TrioSkipWhitespacesString
  *
- ************************************************************************/
+ * Description:
+ *  Skip ASCII whitespaces directly in the source of a string stream,
+ *  starting with the current character, which must be one. Long runs
+ *  in terminated strings are handed to strspn. Bounded strings may end
+ *  with a zero before the limit, so they are never read ahead. Returns
+ *  the first character that was not skipped, loaded through the regular
+ *  stream.
+ */
+static int
+TrioSkipWhitespacesString
+TRIO_ARGS1((self),
+	   trio_class_t *self)
+{
+  unsigned char **buffer;
+  TRIO_CONST unsigned char *start;
+  TRIO_CONST unsigned char *current;
+  TRIO_CONST unsigned char *end;
 
-#if TRIO_FEATURE_SCANF
+  assert(IS_STRING_STREAM(self));
+
+  buffer = (unsigned char **)self->location;
+  start = *buffer - 1;
+  current = start + 1;
+  if (self->InStream == TrioInStreamString)
+    {
+      /* The terminating zero ends the run */
+      end = start + MAX_WHITESPACE_RUN;
+      while ((current != end) &&
+	     ((*current == ' ') || ((*current >= '\t') && (*current <= '\r'))))
+	{
+	  current++;
+	}
+      if (current == end)
+	current += strspn((TRIO_CONST char *)current, " \t\n\v\f\r");
+    }
+  else
+    {
+      end = start + TrioStringWidth(self, NO_WIDTH);
+      while ((current != end) &&
+	     ((*current == ' ') || ((*current >= '\t') && (*current <= '\r'))))
+	{
+	  current++;
+	}
+    }
+  return TrioStringAdvance(self, current);
+}
 
 /*************************************************************************
  * TrioSkipWhitespaces
@@ -5871,6 +8834,15 @@ TRIO_ARGS1((self),
   int ch;
 
   ch = self->current;
+  if (((ch == ' ') || ((ch >= '\t') && (ch <= '\r'))) &&
+      IS_STRING_STREAM(self))
+    {
+      /*
+       * ASCII whitespaces are whitespaces in every locale, so only the
+       * character where the fast path stops needs isspace below.
+       */
+      ch = TrioSkipWhitespacesString(self);
+    }
   while (isspace(ch))
     {
       self->InStream(self, &ch);
@@ -5882,46 +8854,74 @@ TRIO_ARGS1((self),
  * TrioGetCollation
  */
 #if TRIO_EXTENSION
-static void
+static char *
 TrioGetCollation(TRIO_NOARGS)
 {
+  char *collation;
+  char *row;
   int i;
   int j;
   int k;
   char first[2];
   char second[2];
 
+  collation = TRIO_ATOMIC_LOAD(internalCollationArray);
+  if (collation)
+    return collation;
+
+  /*
+   * The array lives for the rest of the process, so it is not taken
+   * from the installed allocator, which may be an arena that is reset.
+   */
+  collation = (char *)TRIO_MALLOC(MAX_CHARACTER_CLASS * MAX_CHARACTER_CLASS);
+  if (collation == NULL)
+    return NULL;
+
   /* This is computationally expensive */
   first[1] = NIL;
   second[1] = NIL;
   for (i = 0; i < MAX_CHARACTER_CLASS; i++)
     {
+      row = &collation[i * MAX_CHARACTER_CLASS];
       k = 0;
       first[0] = (char)i;
       for (j = 0; j < MAX_CHARACTER_CLASS; j++)
 	{
 	  second[0] = (char)j;
 	  if (trio_equal_locale(first, second))
-	    internalCollationArray[i][k++] = (char)j;
+	    row[k++] = (char)j;
 	}
-      internalCollationArray[i][k] = NIL;
+      row[k] = NIL;
     }
+
+  /* Publish the array, or use the one from a thread that got there first */
+  if (!TRIO_ATOMIC_SWAP_NULL(internalCollationArray, collation))
+    {
+      TRIO_FREE(collation);
+      collation = TRIO_ATOMIC_LOAD(internalCollationArray);
+    }
+  return collation;
 }
 #endif
 
 /*************************************************************************
  * TrioGetCharacterClass
  *
+ * Description:
+ *  Compile the scanlist of a %[...] conversion into a bitmap. An
+ *  excluding scanlist is inverted, so the bitmap always holds the
+ *  characters that are accepted.
+ *
  * FIXME:
  *  multibyte
  */
 static int
 TrioGetCharacterClass
-TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
+TRIO_ARGS4((format, offsetPointer, flagsPointer, scanlist),
 	   TRIO_CONST char *format,
 	   int *offsetPointer,
 	   trio_flags_t *flagsPointer,
-	   int *characterclass)
+	   trio_scanlist_t *scanlist)
 {
   int offset = *offsetPointer;
   int i;
@@ -5943,7 +8943,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
    */
   if (format[offset] == SPECIFIER_UNGROUP)
     {
-      characterclass[(int)SPECIFIER_UNGROUP]++;
+      TRIO_SCANLIST_ADD(scanlist, SPECIFIER_UNGROUP);
       offset++;
     }
   /*
@@ -5952,7 +8952,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
    */
   if (format[offset] == QUALIFIER_MINUS)
     {
-      characterclass[(int)QUALIFIER_MINUS]++;
+      TRIO_SCANLIST_ADD(scanlist, QUALIFIER_MINUS);
       offset++;
     }
   /* Collect characters */
@@ -5982,7 +8982,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 	  if (range_end == SPECIFIER_UNGROUP)
 	    {
 	      /* Trailing minus is included */
-	      characterclass[(int)ch]++;
+	      TRIO_SCANLIST_ADD(scanlist, ch);
 	      ch = range_end;
 	      break; /* for */
 	    }
@@ -5992,7 +8992,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 	    return TRIO_ERROR_RETURN(TRIO_ERANGE, offset);
 
 	  for (i = (int)range_begin; i <= (int)range_end; i++)
-	    characterclass[i]++;
+	    TRIO_SCANLIST_ADD(scanlist, i);
 
 	  ch = range_end;
 	  break;
@@ -6025,15 +9025,13 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 
 	    case QUALIFIER_EQUAL: /* Equivalence class expressions */
 	      {
+		char *collation;
 		unsigned int j;
 		unsigned int k;
 
-		if (internalCollationUnconverted)
-		  {
-		    /* Lazy evaluation of collation array */
-		    TrioGetCollation();
-		    internalCollationUnconverted = FALSE;
-		  }
+		collation = TrioGetCollation();
+		if (collation == NULL)
+		  return TRIO_ERROR_RETURN(TRIO_ENOMEM, offset);
 		for (i = offset + 2; ; i++)
 		  {
 		    if (format[i] == NIL)
@@ -6044,9 +9042,9 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		    else
 		      {
 			/* Mark any equivalent character */
-			k = (unsigned int)format[i];
-			for (j = 0; internalCollationArray[k][j] != NIL; j++)
-			  characterclass[(int)internalCollationArray[k][j]]++;
+			k = (unsigned int)(unsigned char)format[i] * MAX_CHARACTER_CLASS;
+			for (j = 0; collation[k + j] != NIL; j++)
+			  TRIO_SCANLIST_ADD(scanlist, collation[k + j]);
 		      }
 		  }
 		if (format[++i] != SPECIFIER_UNGROUP)
@@ -6063,7 +9061,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (isalnum(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_ALNUM) - 1;
 		}
 	      else if (trio_equal_max(CLASS_ALPHA, sizeof(CLASS_ALPHA) - 1,
@@ -6071,7 +9069,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (isalpha(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_ALPHA) - 1;
 		}
 	      else if (trio_equal_max(CLASS_CNTRL, sizeof(CLASS_CNTRL) - 1,
@@ -6079,7 +9077,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (iscntrl(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_CNTRL) - 1;
 		}
 	      else if (trio_equal_max(CLASS_DIGIT, sizeof(CLASS_DIGIT) - 1,
@@ -6087,7 +9085,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (isdigit(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_DIGIT) - 1;
 		}
 	      else if (trio_equal_max(CLASS_GRAPH, sizeof(CLASS_GRAPH) - 1,
@@ -6095,7 +9093,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (isgraph(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_GRAPH) - 1;
 		}
 	      else if (trio_equal_max(CLASS_LOWER, sizeof(CLASS_LOWER) - 1,
@@ -6103,7 +9101,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (islower(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_LOWER) - 1;
 		}
 	      else if (trio_equal_max(CLASS_PRINT, sizeof(CLASS_PRINT) - 1,
@@ -6111,7 +9109,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (isprint(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_PRINT) - 1;
 		}
 	      else if (trio_equal_max(CLASS_PUNCT, sizeof(CLASS_PUNCT) - 1,
@@ -6119,7 +9117,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (ispunct(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_PUNCT) - 1;
 		}
 	      else if (trio_equal_max(CLASS_SPACE, sizeof(CLASS_SPACE) - 1,
@@ -6127,7 +9125,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (isspace(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_SPACE) - 1;
 		}
 	      else if (trio_equal_max(CLASS_UPPER, sizeof(CLASS_UPPER) - 1,
@@ -6135,7 +9133,7 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (isupper(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_UPPER) - 1;
 		}
 	      else if (trio_equal_max(CLASS_XDIGIT, sizeof(CLASS_XDIGIT) - 1,
@@ -6143,17 +9141,17 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 		{
 		  for (i = 0; i < MAX_CHARACTER_CLASS; i++)
 		    if (isxdigit(i))
-		      characterclass[i]++;
+		      TRIO_SCANLIST_ADD(scanlist, i);
 		  offset += sizeof(CLASS_XDIGIT) - 1;
 		}
 	      else
 		{
-		  characterclass[(int)ch]++;
+		  TRIO_SCANLIST_ADD(scanlist, ch);
 		}
 	      break;
 
 	    default:
-	      characterclass[(int)ch]++;
+	      TRIO_SCANLIST_ADD(scanlist, ch);
 	      break;
 	    }
 	  break;
@@ -6161,18 +9159,151 @@ TRIO_ARGS4((format, offsetPointer, flagsPointer, characterclass),
 #endif /* TRIO_EXTENSION */
 
 	default:
-	  characterclass[(int)ch]++;
+	  TRIO_SCANLIST_ADD(scanlist, ch);
 	  break;
 	}
     }
+
+  if (*flagsPointer & FLAGS_EXCLUDE)
+    {
+      for (i = 0; i < (int)sizeof(scanlist->member); i++)
+	scanlist->member[i] = (unsigned char)~scanlist->member[i];
+    }
   return 0;
 }
 
+/*************************************************************************
+ * TrioReadDigitsString
+ *
+ * Description:
+ *  Accumulate a run of digits directly from the source of a string
+ *  stream, and leave the stream positioned on the first character after
+ *  the run exactly as if the digits had been read one by one. Decimal
+ *  digits are combined eight at a time, and hexadecimal digits four at
+ *  a time with shifts.
+ *
+ *  The digits are validated in order, so nothing beyond the terminating
+ *  zero is ever touched. Overflow is reported through overflow, and
+ *  the digits are still consumed.
+ *
+ *  Returns the number of digits read.
+ */
+static int
+TrioReadDigitsString
+TRIO_ARGS5((self, target, width, base, overflow),
+	   trio_class_t *self,
+	   trio_uintmax_t *target,
+	   int width,
+	   int base,
+	   BOOLEAN_T *overflow)
+{
+  unsigned char **buffer;
+  TRIO_CONST unsigned char *start;
+  TRIO_CONST unsigned char *current;
+  trio_uintmax_t number = *target;
+  trio_uintmax_t cutoff;
+  unsigned long high;
+  unsigned long low;
+  int digit;
+  int left;
+  int count;
+  int i;
+
+  assert(VALID(self));
+  assert(IS_STRING_STREAM(self));
+  assert(self->current != EOF);
+
+  /* The current character has already been consumed from the string */
+  buffer = (unsigned char **)self->location;
+  start = *buffer - 1;
+  current = start;
+  left = (width == NO_WIDTH) ? INT_MAX : width;
+
+  if (base == BASE_DECIMAL)
+    {
+      while ((left >= 8) &&
+	     ((unsigned int)(current[0] - '0') <= 9) &&
+	     ((unsigned int)(current[1] - '0') <= 9) &&
+	     ((unsigned int)(current[2] - '0') <= 9) &&
+	     ((unsigned int)(current[3] - '0') <= 9) &&
+	     ((unsigned int)(current[4] - '0') <= 9) &&
+	     ((unsigned int)(current[5] - '0') <= 9) &&
+	     ((unsigned int)(current[6] - '0') <= 9) &&
+	     ((unsigned int)(current[7] - '0') <= 9))
+	{
+	  high = (((unsigned long)(current[0] - '0') * 10
+		   + (current[1] - '0')) * 10
+		  + (current[2] - '0')) * 10
+	    + (current[3] - '0');
+	  low = (((unsigned long)(current[4] - '0') * 10
+		  + (current[5] - '0')) * 10
+		 + (current[6] - '0')) * 10
+	    + (current[7] - '0');
+	  low += high * 10000;
+	  if (number > (TRIO_UINTMAX_MAX - low) / 100000000UL)
+	    *overflow = TRUE;
+	  number = number * 100000000UL + low;
+	  current += 8;
+	  left -= 8;
+	}
+    }
+  else if (base == BASE_HEX)
+    {
+      while (left >= 4)
+	{
+	  low = 0;
+	  for (i = 0; i < 4; i++)
+	    {
+	      if (!isascii(current[i]))
+		break;
+	      digit = internalDigitArray[current[i]];
+	      if ((digit == -1) || (digit >= BASE_HEX))
+		break;
+	      low = (low << 4) | (unsigned long)digit;
+	    }
+	  if (i < 4)
+	    break;
+	  if ((number >> (sizeof(trio_uintmax_t) * CHAR_BIT - 16)) != 0)
+	    *overflow = TRUE;
+	  number = (number << 16) | low;
+	  current += 4;
+	  left -= 4;
+	}
+    }
+
+  cutoff = TRIO_UINTMAX_MAX / base;
+  while ((left > 0) && isascii(*current))
+    {
+      digit = internalDigitArray[*current];
+      if ((digit == -1) || (digit >= base))
+	break;
+      if ((number > cutoff) ||
+	  ((number == cutoff) &&
+	   ((trio_uintmax_t)digit > TRIO_UINTMAX_MAX % base)))
+	*overflow = TRUE;
+      number *= base;
+      number += digit;
+      current++;
+      left--;
+    }
+
+  count = (int)(current - start);
+  if (count > 0)
+    {
+      *target = number;
+      TrioStringAdvance(self, current);
+    }
+  return count;
+}
+
 /*************************************************************************
  * TrioReadNumber
  *
  * We implement our own number conversion in preference of strtol and
  * strtoul, because we must handle 'long long' and thousand separators.
+ *
+ * Out-of-range numbers are clamped and errno is set to ERANGE, as with
+ * strtoimax and strtoumax.
  */
 static BOOLEAN_T
 TrioReadNumber
@@ -6184,28 +9315,20 @@ TRIO_ARGS5((self, target, flags, width, base),
 	   int base)
 {
   trio_uintmax_t number = 0;
+  trio_uintmax_t limit;
   int digit;
   int count;
   BOOLEAN_T isNegative = FALSE;
   BOOLEAN_T gotNumber = FALSE;
+  BOOLEAN_T overflow = FALSE;
+#if TRIO_FEATURE_QUOTE
   int j;
+#endif
 
   assert(VALID(self));
   assert(VALID(self->InStream));
   assert((base >= MIN_BASE && base <= MAX_BASE) || (base == NO_BASE));
 
-  if (internalDigitsUnconverted)
-    {
-      /* Lazy evaluation of digits array */
-      memset(internalDigitArray, -1, sizeof(internalDigitArray));
-      for (j = 0; j < (int)sizeof(internalDigitsLower) - 1; j++)
-	{
-	  internalDigitArray[(int)internalDigitsLower[j]] = j;
-	  internalDigitArray[(int)internalDigitsUpper[j]] = j;
-	}
-      internalDigitsUnconverted = FALSE;
-    }
-
   TrioSkipWhitespaces(self);
 
   /* Leading sign */
@@ -6254,6 +9377,22 @@ TRIO_ARGS5((self, target, flags, width, base),
 	}
     }
 
+  if (IS_STRING_STREAM(self) &&
+      (self->current != EOF) &&
+      ((width == NO_WIDTH) || (self->processed - count < width)))
+    {
+      /* Fast path for string sources */
+      if (TrioReadDigitsString(self,
+			       &number,
+			       TrioStringWidth(self,
+					       (width == NO_WIDTH)
+					       ? NO_WIDTH
+					       : width - (self->processed - count)),
+			       base,
+			       &overflow) > 0)
+	gotNumber = TRUE;
+    }
+
   while (((width == NO_WIDTH) || (self->processed - count < width)) &&
 	 (! ((self->current == EOF) || isspace(self->current))))
     {
@@ -6268,14 +9407,14 @@ TRIO_ARGS5((self, target, flags, width, base),
       else if (flags & FLAGS_QUOTE)
 	{
 	  /* Compare with thousands separator */
-	  for (j = 0; internalThousandSeparator[j] && self->current; j++)
+	  for (j = 0; self->locale->thousandSeparator[j] && self->current; j++)
 	    {
-	      if (internalThousandSeparator[j] != self->current)
+	      if (self->locale->thousandSeparator[j] != self->current)
 		break;
 
 	      self->InStream(self, NULL);
 	    }
-	  if (internalThousandSeparator[j])
+	  if (self->locale->thousandSeparator[j])
 	    break; /* Mismatch */
 	  else
 	    continue; /* Match */
@@ -6284,6 +9423,10 @@ TRIO_ARGS5((self, target, flags, width, base),
       else
 	break;
 
+      if ((number > TRIO_UINTMAX_MAX / base) ||
+	  ((number == TRIO_UINTMAX_MAX / base) &&
+	   ((trio_uintmax_t)digit > TRIO_UINTMAX_MAX % base)))
+	overflow = TRUE;
       number *= base;
       number += digit;
       gotNumber = TRUE; /* we need at least one digit */
@@ -6295,8 +9438,30 @@ TRIO_ARGS5((self, target, flags, width, base),
   if (!gotNumber)
     return FALSE;
 
+  if (flags & FLAGS_UNSIGNED)
+    {
+      if (overflow)
+	{
+	  /* Saturated values are not negated, as with strtoumax */
+	  number = TRIO_UINTMAX_MAX;
+	  isNegative = FALSE;
+	}
+    }
+  else
+    {
+      /* The magnitude of the most negative number is one larger */
+      limit = (isNegative) ? TRIO_INTMAX_MAX + 1 : TRIO_INTMAX_MAX;
+      if (overflow || (number > limit))
+	{
+	  number = limit;
+	  overflow = TRUE;
+	}
+    }
+  if (overflow)
+    errno = ERANGE;
+
   if (target)
-    *target = (isNegative) ? (trio_uintmax_t)(-((trio_intmax_t)number)) : number;
+    *target = (isNegative) ? (trio_uintmax_t)0 - number : number;
   return TRUE;
 }
 
@@ -6508,6 +9673,128 @@ TRIO_ARGS4((self, target, flags, width),
 }
 #endif /* TRIO_FEATURE_WIDECHAR */
 
+/*************************************************************************
+ * TrioGetScanlistReject
+ *
+ * Description:
+ *  Collect the characters that are not accepted by the scanlist, apart
+ *  from the terminating zero, into the reject string. Returns FALSE if
+ *  there are more than MAX_SCANLIST_REJECT of them.
+ */
+static BOOLEAN_T
+TrioGetScanlistReject
+TRIO_ARGS2((scanlist, reject),
+	   TRIO_CONST trio_scanlist_t *scanlist,
+	   char *reject)
+{
+  int count = 0;
+  int i;
+
+  for (i = 1; i < MAX_CHARACTER_CLASS; i++)
+    {
+      if (!TRIO_SCANLIST_HAS(scanlist, i))
+	{
+	  if (count == MAX_SCANLIST_REJECT)
+	    return FALSE;
+	  reject[count++] = (char)i;
+	}
+    }
+  reject[count] = NIL;
+  return TRUE;
+}
+
+/*************************************************************************
+ * TrioSpanString
+ *
+ * Description:
+ *  Count the characters at the start of a string that are accepted by
+ *  the scanlist, or that are not whitespaces if there is no scanlist.
+ *  The terminating zero always ends the span, as it is EOF for string
+ *  streams.
+ */
+static int
+TrioSpanString
+TRIO_ARGS3((start, scanlist, width),
+	   TRIO_CONST unsigned char *start,
+	   TRIO_CONST trio_scanlist_t *scanlist,
+	   int width)
+{
+  TRIO_CONST unsigned char *current = start;
+  TRIO_CONST unsigned char *end;
+  char reject[MAX_SCANLIST_REJECT + 1];
+
+  end = (width == NO_WIDTH) ? NULL : start + width;
+  if (scanlist == NULL)
+    {
+      while ((current != end) && (*current != NIL) && !isspace(*current))
+	current++;
+    }
+  else if ((width == NO_WIDTH) && TrioGetScanlistReject(scanlist, reject))
+    {
+      /* Short excluding scanlists, such as [^,] or [^\n] */
+      current += strcspn((TRIO_CONST char *)start, reject);
+    }
+  else
+    {
+      while ((current != end) &&
+	     (*current != NIL) &&
+	     TRIO_SCANLIST_HAS(scanlist, *current))
+	{
+	  current++;
+	}
+    }
+  return (int)(current - start);
+}
+
+/*************************************************************************
+ * TrioReadView
+ *
+ * Description:
+ *  Store the location of the next field of a string stream in the
+ *  view without copying it. The field is either a word, as for the
+ *  s specifier, or the span accepted by the scanlist. Returns FALSE
+ *  for an empty scanlist match.
+ */
+#if TRIO_FEATURE_VIEW
+static BOOLEAN_T
+TrioReadView
+TRIO_ARGS4((self, view, scanlist, width),
+	   trio_class_t *self,
+	   trio_view_t *view,
+	   TRIO_CONST trio_scanlist_t *scanlist,
+	   int width)
+{
+  unsigned char **buffer;
+  TRIO_CONST unsigned char *start;
+  int length = 0;
+
+  assert(VALID(self));
+  assert(IS_STRING_STREAM(self));
+
+  if (scanlist == NULL)
+    TrioSkipWhitespaces(self);
+
+  buffer = (unsigned char **)self->location;
+  start = *buffer;
+  if (self->current != EOF)
+    {
+      start--;
+      length = TrioSpanString(start, scanlist, TrioStringWidth(self, width));
+    }
+  if ((length == 0) && scanlist)
+    return FALSE;
+
+  if (view)
+    {
+      view->pointer = (TRIO_CONST char *)start;
+      view->length = (size_t)length;
+    }
+  if (length > 0)
+    TrioStringAdvance(self, start + length);
+  return TRUE;
+}
+#endif
+
 /*************************************************************************
  * TrioReadGroup
  *
@@ -6517,11 +9804,10 @@ TRIO_ARGS4((self, target, flags, width),
  */
 static BOOLEAN_T
 TrioReadGroup
-TRIO_ARGS5((self, target, characterclass, flags, width),
+TRIO_ARGS4((self, target, scanlist, width),
 	   trio_class_t *self,
 	   char *target,
-	   int *characterclass,
-	   trio_flags_t flags,
+	   TRIO_CONST trio_scanlist_t *scanlist,
 	   int width)
 {
   int ch;
@@ -6531,10 +9817,31 @@ TRIO_ARGS5((self, target, characterclass, flags, width),
   assert(VALID(self->InStream));
 
   ch = self->current;
+
+  if (IS_STRING_STREAM(self) && (ch != EOF))
+    {
+      unsigned char **buffer;
+      TRIO_CONST unsigned char *start;
+
+      buffer = (unsigned char **)self->location;
+      start = *buffer - 1;
+      i = TrioSpanString(start, scanlist, TrioStringWidth(self, width));
+      if (i == 0)
+	return FALSE;
+
+      if (target)
+	{
+	  memcpy(target, start, (size_t)i);
+	  target[i] = NIL;
+	}
+      TrioStringAdvance(self, start + i);
+      return TRUE;
+    }
+
   for (i = 0;
        ((width == NO_WIDTH) || (i < width)) &&
-       (! ((ch == EOF) ||
-	   (((flags & FLAGS_EXCLUDE) != 0) ^ (characterclass[ch] == 0))));
+       (ch != EOF) &&
+       TRIO_SCANLIST_HAS(scanlist, ch);
        i++)
     {
       if (target)
@@ -6551,6 +9858,109 @@ TRIO_ARGS5((self, target, characterclass, flags, width),
   return TRUE;
 }
 
+/*************************************************************************
+ * TrioReadDoubleString
+ *
+ * Description:
+ *  Convert a decimal floating-point number in place from the source of
+ *  a string stream, instead of collecting it character by character.
+ *  Returns FALSE, without consuming anything, for input that needs the
+ *  general path in TrioReadDouble: hex-floats, infinity, not-a-number
+ *  numbers that would be cut short by the width, and numbers that the
+ *  conversion functions would read differently.
+ */
+#if TRIO_FEATURE_FLOAT
+static BOOLEAN_T
+TrioReadDoubleString
+TRIO_ARGS4((self, target, flags, width),
+	   trio_class_t *self,
+	   trio_pointer_t target,
+	   trio_flags_t flags,
+	   int width)
+{
+  unsigned char **buffer;
+  TRIO_CONST char *start;
+  TRIO_CONST char *digits;
+  TRIO_CONST char *end;
+  char *stop;
+  trio_long_double_t longDoubleNumber;
+  double doubleNumber;
+  float floatNumber;
+
+  assert(VALID(self));
+  assert(self->InStream == TrioInStreamString);
+  assert(self->current != EOF);
+
+  /* The current character has already been consumed from the string */
+  buffer = (unsigned char **)self->location;
+  start = (TRIO_CONST char *)*buffer - 1;
+
+  /* Find the extent of the number with the grammar of TrioReadDouble */
+  end = start;
+  if ((*end == '+') || (*end == '-'))
+    {
+      end++;
+      width--;
+    }
+  digits = end;
+  if ((end[0] == '0') && (trio_to_upper(end[1]) == 'X'))
+    return FALSE;
+  while (isdigit((int)(unsigned char)*end))
+    end++;
+  if (*end == '.')
+    {
+      end++;
+      while (isdigit((int)(unsigned char)*end))
+	end++;
+    }
+  if ((end == digits) || (end - digits >= width))
+    return FALSE;
+  if (trio_to_upper(*end) == 'E')
+    {
+      end++;
+      if ((*end == '+') || (*end == '-'))
+	end++;
+      while (isdigit((int)(unsigned char)*end))
+	end++;
+      if (end - digits >= width)
+	return FALSE;
+    }
+
+  /*
+   * The conversion functions accept more than TrioReadDouble does (for
+   * instance 'd' as exponent marker), so only accept a conversion that
+   * ends exactly where the number does.
+   */
+  if (flags & FLAGS_LONGDOUBLE)
+    {
+      longDoubleNumber = trio_to_long_double(start, &stop);
+      if (stop != end)
+	return FALSE;
+      if (target)
+	*((trio_long_double_t *)target) = longDoubleNumber;
+    }
+  else if (flags & FLAGS_LONG)
+    {
+      doubleNumber = trio_to_double(start, &stop);
+      if (stop != end)
+	return FALSE;
+      if (target)
+	*((double *)target) = doubleNumber;
+    }
+  else
+    {
+      floatNumber = trio_to_float(start, &stop);
+      if (stop != end)
+	return FALSE;
+      if (target)
+	*((float *)target) = floatNumber;
+    }
+
+  TrioStringAdvance(self, (TRIO_CONST unsigned char *)end);
+  return TRUE;
+}
+#endif /* TRIO_FEATURE_FLOAT */
+
 /*************************************************************************
  * TrioReadDouble
  *
@@ -6584,6 +9994,15 @@ TRIO_ARGS4((self, target, flags, width),
 
   TrioSkipWhitespaces(self);
 
+  if ((self->InStream == TrioInStreamString) &&
+      (self->current != EOF) &&
+      !(flags & FLAGS_QUOTE))
+    {
+      /* Fast path for string sources */
+      if (TrioReadDoubleString(self, target, flags, width))
+	return TRUE;
+    }
+
   /*
    * Read entire double number from stream. trio_to_double requires
    * a string as input, but InStream can be anything, so we have to
@@ -6623,7 +10042,11 @@ TRIO_ARGS4((self, target, flags, width),
 	  infinity = ((start == 1) && (doubleString[0] == '-'))
 	    ? trio_ninf()
 	    : trio_pinf();
-	  if (flags & FLAGS_LONGDOUBLE)
+	  if (target == NULL)
+	    {
+	      /* Conversion suppressed */
+	    }
+	  else if (flags & FLAGS_LONGDOUBLE)
 	    {
 	      *((trio_long_double_t *)target) = infinity;
 	    }
@@ -6640,7 +10063,11 @@ TRIO_ARGS4((self, target, flags, width),
       if (trio_equal(doubleString, NAN_UPPER))
 	{
 	  /* NaN must not have a preceding + nor - */
-	  if (flags & FLAGS_LONGDOUBLE)
+	  if (target == NULL)
+	    {
+	      /* Conversion suppressed */
+	    }
+	  else if (flags & FLAGS_LONGDOUBLE)
 	    {
 	      *((trio_long_double_t *)target) = trio_nan();
 	    }
@@ -6683,14 +10110,14 @@ TRIO_ARGS4((self, target, flags, width),
       else if (flags & FLAGS_QUOTE)
 	{
 	  /* Compare with thousands separator */
-	  for (j = 0; internalThousandSeparator[j] && self->current; j++)
+	  for (j = 0; self->locale->thousandSeparator[j] && self->current; j++)
 	    {
-	      if (internalThousandSeparator[j] != self->current)
+	      if (self->locale->thousandSeparator[j] != self->current)
 		break;
 
 	      self->InStream(self, &ch);
 	    }
-	  if (internalThousandSeparator[j])
+	  if (self->locale->thousandSeparator[j])
 	    break; /* Mismatch */
 	  else
 	    continue; /* Match */
@@ -6733,7 +10160,11 @@ TRIO_ARGS4((self, target, flags, width),
 
   doubleString[offset] = 0;
 
-  if (flags & FLAGS_LONGDOUBLE)
+  if (target == NULL)
+    {
+      /* Conversion suppressed */
+    }
+  else if (flags & FLAGS_LONGDOUBLE)
     {
       *((trio_long_double_t *)target) = trio_to_long_double(doubleString, NULL);
     }
@@ -6969,6 +10400,24 @@ TRIO_ARGS3((data, format, parameters),
 	  break; /* FORMAT_INT */
 
 	case FORMAT_STRING:
+#if TRIO_FEATURE_VIEW
+	  if (flags & FLAGS_VIEW)
+	    {
+	      /* Views can only refer to string sources */
+	      if (!IS_STRING_STREAM(data))
+		{
+		  status = TRIO_ERROR_RETURN(TRIO_EINVAL, offset);
+		  goto end;
+		}
+	      (void)TrioReadView(data,
+				 (flags & FLAGS_IGNORE)
+				 ? NULL
+				 : (trio_view_t *)parameters[i].data.pointer,
+				 NULL,
+				 width);
+	    }
+	  else
+#endif
 #if TRIO_FEATURE_WIDECHAR
 	  if (flags & FLAGS_WIDECHAR)
 	    {
@@ -7029,7 +10478,7 @@ TRIO_ARGS3((data, format, parameters),
 
 	case FORMAT_GROUP:
 	  {
-	    int characterclass[MAX_CHARACTER_CLASS + 1];
+	    trio_scanlist_t scanlist;
 
 	    /* Skip over modifiers */
 	    while (format[offset] != SPECIFIER_GROUP)
@@ -7039,20 +10488,40 @@ TRIO_ARGS3((data, format, parameters),
 	    /* Skip over group specifier */
 	    offset++;
 
-	    memset(characterclass, 0, sizeof(characterclass));
+	    memset(&scanlist, 0, sizeof(scanlist));
 	    status = TrioGetCharacterClass(format,
 					   &offset,
 					   &flags,
-					   characterclass);
+					   &scanlist);
 	    if (status < 0)
 	      goto end;
 
+#if TRIO_FEATURE_VIEW
+	    if (flags & FLAGS_VIEW)
+	      {
+		if (!IS_STRING_STREAM(data))
+		  {
+		    status = TRIO_ERROR_RETURN(TRIO_EINVAL, offset);
+		    goto end;
+		  }
+		if (!TrioReadView(data,
+				  (flags & FLAGS_IGNORE)
+				  ? NULL
+				  : (trio_view_t *)parameters[i].data.pointer,
+				  &scanlist,
+				  parameters[i].width))
+		  {
+		    status = assignment;
+		    goto end;
+		  }
+	      }
+	    else
+#endif
 	    if (!TrioReadGroup(data,
 			       (flags & FLAGS_IGNORE)
 			       ? NULL
 			       : parameters[i].data.string,
-			       characterclass,
-			       flags,
+			       &scanlist,
 			       parameters[i].width))
 	      {
 		status = assignment;
@@ -7176,7 +10645,7 @@ TRIO_ARGS3((data, format, parameters),
  */
 static int
 TrioScan
-TRIO_ARGS8((source, sourceSize, InStream, UndoStream, format, arglist, argfunc, argarray),
+TRIO_ARGS9((source, sourceSize, InStream, UndoStream, format, arglist, argfunc, argarray, locale),
 	   trio_pointer_t source,
 	   size_t sourceSize,
 	   void (*InStream) TRIO_PROTO((trio_class_t *, int *)),
@@ -7184,7 +10653,8 @@ TRIO_ARGS8((source, sourceSize, InStream, UndoStream, format, arglist, argfunc,
 	   TRIO_CONST char *format,
 	   va_list arglist,
 	   trio_argfunc_t argfunc,
-	   trio_pointer_t *argarray)
+	   trio_pointer_t *argarray,
+	   TRIO_CONST trio_locale_t *locale)
 {
   int status;
   trio_parameter_t parameters[MAX_PARAMETERS];
@@ -7199,478 +10669,1194 @@ TRIO_ARGS8((source, sourceSize, InStream, UndoStream, format, arglist, argfunc,
   data.location = (trio_pointer_t)source;
   data.max = sourceSize;
   data.error = 0;
+  data.locale = TrioGetLocale(locale);
 
-#if defined(USE_LOCALE)
-  if (NULL == internalLocaleValues)
+  status = TrioParse(TYPE_SCAN, format, parameters, arglist, argfunc, argarray);
+  if (status < 0)
+    return status;
+
+  status = TrioScanProcess(&data, format, parameters);
+  if (data.error != 0)
     {
-      TrioSetLocale();
+      status = data.error;
+    }
+  return status;
+}
+
+/*************************************************************************
+ * TrioInStreamFile
+ */
+#if TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO
+static void
+TrioInStreamFile
+TRIO_ARGS2((self, intPointer),
+	   trio_class_t *self,
+	   int *intPointer)
+{
+  FILE *file = (FILE *)self->location;
+
+  assert(VALID(self));
+  assert(VALID(file));
+
+  self->actually.cached = 0;
+
+  /* The initial value of self->current is zero */
+  if (self->current == EOF)
+    {
+      self->error = (ferror(file))
+	? TRIO_ERROR_RETURN(TRIO_ERRNO, 0)
+	: TRIO_ERROR_RETURN(TRIO_EOF, 0);
+    }
+  else
+    {
+      self->processed++;
+      self->actually.cached++;
+    }
+
+  self->current = fgetc(file);
+
+  if (VALID(intPointer))
+    {
+      *intPointer = self->current;
+    }
+}
+#endif /* TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO */
+
+/*************************************************************************
+ * TrioUndoStreamFile
+ */
+#if TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO
+static void
+TrioUndoStreamFile
+TRIO_ARGS1((self),
+	   trio_class_t *self)
+{
+  FILE *file = (FILE *)self->location;
+
+  assert(VALID(self));
+  assert(VALID(file));
+
+  if (self->actually.cached > 0)
+    {
+      assert(self->actually.cached == 1);
+
+      self->current = ungetc(self->current, file);
+      self->actually.cached = 0;
+    }
+}
+#endif /* TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO */
+
+/*************************************************************************
+ * TrioInStreamFileDescriptor
+ */
+#if TRIO_FEATURE_FD
+static void
+TrioInStreamFileDescriptor
+TRIO_ARGS2((self, intPointer),
+	   trio_class_t *self,
+	   int *intPointer)
+{
+  int fd = *((int *)self->location);
+  int size;
+  unsigned char input;
+
+  assert(VALID(self));
+
+  self->actually.cached = 0;
+
+  size = read(fd, &input, sizeof(char));
+  if (size == -1)
+    {
+      self->error = TRIO_ERROR_RETURN(TRIO_ERRNO, 0);
+      self->current = EOF;
+    }
+  else
+    {
+      self->current = (size == 0) ? EOF : input;
+    }
+  if (self->current != EOF)
+    {
+      self->actually.cached++;
+      self->processed++;
+    }
+
+  if (VALID(intPointer))
+    {
+      *intPointer = self->current;
+    }
+}
+#endif /* TRIO_FEATURE_FD */
+
+/*************************************************************************
+ * TrioInStreamFileDescriptorBuffer
+ */
+#if TRIO_FEATURE_FD
+static void
+TrioInStreamFileDescriptorBuffer
+TRIO_ARGS2((self, intPointer),
+	   trio_class_t *self,
+	   int *intPointer)
+{
+  trio_dbuffer_t *buffer;
+  long size;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  self->actually.cached = 0;
+
+  buffer = (trio_dbuffer_t *)self->location;
+  if (buffer->position >= buffer->length)
+    {
+      /* Refill the buffer with a single read */
+      do
+	{
+	  size = (long)read(buffer->fd, buffer->data, buffer->size);
+	}
+# if defined(EINTR)
+      while ((size == -1) && (errno == EINTR));
+# else
+      while (0);
+# endif
+      buffer->position = 0;
+      buffer->length = (size > 0) ? (size_t)size : 0;
+      if (size == -1)
+	{
+	  self->error = TRIO_ERROR_RETURN(TRIO_ERRNO, 0);
+	}
+    }
+
+  if (buffer->position < buffer->length)
+    {
+      self->current = buffer->data[buffer->position++];
+      self->actually.cached++;
+      self->processed++;
+    }
+  else
+    {
+      self->current = EOF;
+    }
+
+  if (VALID(intPointer))
+    {
+      *intPointer = self->current;
+    }
+}
+#endif /* TRIO_FEATURE_FD */
+
+/*************************************************************************
+ * TrioUndoStreamFileDescriptorBuffer
+ */
+#if TRIO_FEATURE_FD
+static void
+TrioUndoStreamFileDescriptorBuffer
+TRIO_ARGS1((self),
+	   trio_class_t *self)
+{
+  trio_dbuffer_t *buffer;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  buffer = (trio_dbuffer_t *)self->location;
+  if (self->actually.cached > 0)
+    {
+      assert(self->actually.cached == 1);
+      assert(buffer->position > 0);
+
+      /* The character is still in the buffer */
+      buffer->position--;
+      self->actually.cached = 0;
+    }
+}
+#endif /* TRIO_FEATURE_FD */
+
+/*************************************************************************
+ * TrioInStreamCustom
+ */
+#if TRIO_FEATURE_CLOSURE
+static void
+TrioInStreamCustom
+TRIO_ARGS2((self, intPointer),
+	   trio_class_t *self,
+	   int *intPointer)
+{
+  trio_custom_t *data;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  self->actually.cached = 0;
+
+  data = (trio_custom_t *)self->location;
+
+  self->current = (data->stream.in == NULL)
+    ? NIL
+    : (data->stream.in)(data->closure);
+
+  if (self->current == NIL)
+    {
+      self->current = EOF;
+    }
+  else
+    {
+      self->processed++;
+      self->actually.cached++;
+    }
+
+  if (VALID(intPointer))
+    {
+      *intPointer = self->current;
+    }
+}
+#endif /* TRIO_FEATURE_CLOSURE */
+
+/*************************************************************************
+ * TrioInStreamString
+ */
+static void
+TrioInStreamString
+TRIO_ARGS2((self, intPointer),
+	   trio_class_t *self,
+	   int *intPointer)
+{
+  unsigned char **buffer;
+
+  assert(VALID(self));
+  assert(VALID(self->location));
+
+  self->actually.cached = 0;
+
+  buffer = (unsigned char **)self->location;
+  self->current = (*buffer)[0];
+  if (self->current == NIL)
+    {
+      self->current = EOF;
+    }
+  else
+    {
+      (*buffer)++;
+      self->processed++;
+      self->actually.cached++;
     }
-#endif
-
-  status = TrioParse(TYPE_SCAN, format, parameters, arglist, argfunc, argarray);
-  if (status < 0)
-    return status;
 
-  status = TrioScanProcess(&data, format, parameters);
-  if (data.error != 0)
+  if (VALID(intPointer))
     {
-      status = data.error;
+      *intPointer = self->current;
     }
-  return status;
 }
 
 /*************************************************************************
- * TrioInStreamFile
+ * TrioInStreamStringMax
+ *
+ * Description:
+ *  Read from a string that ends after max characters, or at the first
+ *  zero character if that comes before.
  */
-#if TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO
 static void
-TrioInStreamFile
+TrioInStreamStringMax
 TRIO_ARGS2((self, intPointer),
 	   trio_class_t *self,
 	   int *intPointer)
 {
-  FILE *file = (FILE *)self->location;
+  unsigned char **buffer;
 
   assert(VALID(self));
-  assert(VALID(file));
+  assert(VALID(self->location));
 
   self->actually.cached = 0;
 
-  /* The initial value of self->current is zero */
-  if (self->current == EOF)
+  buffer = (unsigned char **)self->location;
+  self->current = (self->processed < self->max) ? (*buffer)[0] : NIL;
+  if (self->current == NIL)
     {
-      self->error = (ferror(file))
-	? TRIO_ERROR_RETURN(TRIO_ERRNO, 0)
-	: TRIO_ERROR_RETURN(TRIO_EOF, 0);
+      self->current = EOF;
     }
   else
     {
+      (*buffer)++;
       self->processed++;
       self->actually.cached++;
     }
 
-  self->current = fgetc(file);
-
   if (VALID(intPointer))
     {
       *intPointer = self->current;
     }
 }
-#endif /* TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO */
 
 /*************************************************************************
- * TrioUndoStreamFile
+ * TrioUndoStreamString
+ *
+ * Description:
+ *  Put back the look-ahead character, so the cursor is left right
+ *  after the last character that was consumed.
  */
-#if TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO
+#if TRIO_FEATURE_SCANNER
 static void
-TrioUndoStreamFile
+TrioUndoStreamString
 TRIO_ARGS1((self),
 	   trio_class_t *self)
 {
-  FILE *file = (FILE *)self->location;
+  unsigned char **buffer;
 
   assert(VALID(self));
-  assert(VALID(file));
+  assert(VALID(self->location));
 
+  buffer = (unsigned char **)self->location;
   if (self->actually.cached > 0)
     {
       assert(self->actually.cached == 1);
 
-      self->current = ungetc(self->current, file);
+      (*buffer)--;
       self->actually.cached = 0;
     }
 }
-#endif /* TRIO_FEATURE_FILE || TRIO_FEATURE_STDIO */
+#endif /* TRIO_FEATURE_SCANNER */
+
+/*************************************************************************
+ *
+ * Formatted scanning functions
+ *
+ ************************************************************************/
+
+#if defined(TRIO_DOCUMENTATION)
+# include "doc/doc_scanf.h"
+#endif
+/** @addtogroup Scanf
+    @{
+*/
+
+/*************************************************************************
+ * scanf
+ */
+
+/**
+   Scan characters from standard input stream.
+
+   @param format Formatting string.
+   @param ... Arguments.
+   @return Number of scanned characters.
+ */
+#if TRIO_FEATURE_STDIO
+TRIO_PUBLIC int
+trio_scanf
+TRIO_VARGS2((format, va_alist),
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
+{
+  int status;
+  va_list args;
+
+  assert(VALID(format));
+
+  TRIO_VA_START(args, format);
+  status = TrioScan((trio_pointer_t)stdin, 0,
+		    TrioInStreamFile,
+		    TrioUndoStreamFile,
+		    format, args, NULL, NULL, NULL);
+  TRIO_VA_END(args);
+  return status;
+}
+#endif /* TRIO_FEATURE_STDIO */
+
+/**
+   Scan characters from standard input stream.
+
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of scanned characters.
+ */
+#if TRIO_FEATURE_STDIO
+TRIO_PUBLIC int
+trio_vscanf
+TRIO_ARGS2((format, args),
+	   TRIO_CONST char *format,
+	   va_list args)
+{
+  assert(VALID(format));
+
+  return TrioScan((trio_pointer_t)stdin, 0,
+		  TrioInStreamFile,
+		  TrioUndoStreamFile,
+		  format, args, NULL, NULL, NULL);
+}
+#endif /* TRIO_FEATURE_STDIO */
+
+/**
+   Scan characters from standard input stream.
+
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of scanned characters.
+ */
+#if TRIO_FEATURE_STDIO
+TRIO_PUBLIC int
+trio_scanfv
+TRIO_ARGS2((format, args),
+	   TRIO_CONST char *format,
+	   trio_pointer_t *args)
+{
+  static va_list unused;
+
+  assert(VALID(format));
+
+  return TrioScan((trio_pointer_t)stdin, 0,
+		  TrioInStreamFile,
+		  TrioUndoStreamFile,
+		  format,
+		  unused, TrioArrayGetter, args, NULL);
+}
+#endif /* TRIO_FEATURE_STDIO */
+
+/*************************************************************************
+ * fscanf
+ */
+
+/**
+   Scan characters from file.
+
+   @param file File pointer.
+   @param format Formatting string.
+   @param ... Arguments.
+   @return Number of scanned characters.
+ */
+#if TRIO_FEATURE_FILE
+TRIO_PUBLIC int
+trio_fscanf
+TRIO_VARGS3((file, format, va_alist),
+	    FILE *file,
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
+{
+  int status;
+  va_list args;
+
+  assert(VALID(file));
+  assert(VALID(format));
+
+  TRIO_VA_START(args, format);
+  status = TrioScan((trio_pointer_t)file, 0,
+		    TrioInStreamFile,
+		    TrioUndoStreamFile,
+		    format, args, NULL, NULL, NULL);
+  TRIO_VA_END(args);
+  return status;
+}
+#endif /* TRIO_FEATURE_FILE */
+
+/**
+   Scan characters from file.
+
+   @param file File pointer.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of scanned characters.
+ */
+#if TRIO_FEATURE_FILE
+TRIO_PUBLIC int
+trio_vfscanf
+TRIO_ARGS3((file, format, args),
+	   FILE *file,
+	   TRIO_CONST char *format,
+	   va_list args)
+{
+  assert(VALID(file));
+  assert(VALID(format));
+
+  return TrioScan((trio_pointer_t)file, 0,
+		  TrioInStreamFile,
+		  TrioUndoStreamFile,
+		  format, args, NULL, NULL, NULL);
+}
+#endif /* TRIO_FEATURE_FILE */
+
+/**
+   Scan characters from file.
+
+   @param file File pointer.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of scanned characters.
+ */
+#if TRIO_FEATURE_FILE
+TRIO_PUBLIC int
+trio_fscanfv
+TRIO_ARGS3((file, format, args),
+	   FILE *file,
+	   TRIO_CONST char *format,
+	   trio_pointer_t *args)
+{
+  static va_list unused;
+
+  assert(VALID(file));
+  assert(VALID(format));
+
+  return TrioScan((trio_pointer_t)file, 0,
+		  TrioInStreamFile,
+		  TrioUndoStreamFile,
+		  format,
+		  unused, TrioArrayGetter, args, NULL);
+}
+#endif /* TRIO_FEATURE_FILE */
+
+/*************************************************************************
+ * dscanf
+ */
+
+/**
+   Scan characters from file descriptor.
+
+   @param fd File descriptor.
+   @param format Formatting string.
+   @param ... Arguments.
+   @return Number of scanned characters.
+ */
+#if TRIO_FEATURE_FD
+TRIO_PUBLIC int
+trio_dscanf
+TRIO_VARGS3((fd, format, va_alist),
+	    int fd,
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
+{
+  int status;
+  va_list args;
+
+  assert(VALID(format));
+
+  TRIO_VA_START(args, format);
+  status = TrioScan((trio_pointer_t)&fd, 0,
+		    TrioInStreamFileDescriptor,
+		    NULL,
+		    format, args, NULL, NULL, NULL);
+  TRIO_VA_END(args);
+  return status;
+}
+#endif /* TRIO_FEATURE_FD */
 
-/*************************************************************************
- * TrioInStreamFileDescriptor
+/**
+   Scan characters from file descriptor.
+
+   @param fd File descriptor.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of scanned characters.
  */
 #if TRIO_FEATURE_FD
-static void
-TrioInStreamFileDescriptor
-TRIO_ARGS2((self, intPointer),
-	   trio_class_t *self,
-	   int *intPointer)
+TRIO_PUBLIC int
+trio_vdscanf
+TRIO_ARGS3((fd, format, args),
+	   int fd,
+	   TRIO_CONST char *format,
+	   va_list args)
 {
-  int fd = *((int *)self->location);
-  int size;
-  unsigned char input;
-
-  assert(VALID(self));
-
-  self->actually.cached = 0;
-
-  size = read(fd, &input, sizeof(char));
-  if (size == -1)
-    {
-      self->error = TRIO_ERROR_RETURN(TRIO_ERRNO, 0);
-      self->current = EOF;
-    }
-  else
-    {
-      self->current = (size == 0) ? EOF : input;
-    }
-  if (self->current != EOF)
-    {
-      self->actually.cached++;
-      self->processed++;
-    }
+  assert(VALID(format));
 
-  if (VALID(intPointer))
-    {
-      *intPointer = self->current;
-    }
+  return TrioScan((trio_pointer_t)&fd, 0,
+		  TrioInStreamFileDescriptor,
+		  NULL,
+		  format, args, NULL, NULL, NULL);
 }
 #endif /* TRIO_FEATURE_FD */
 
-/*************************************************************************
- * TrioInStreamCustom
+/**
+   Scan characters from file descriptor.
+
+   @param fd File descriptor.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of scanned characters.
  */
-#if TRIO_FEATURE_CLOSURE
-static void
-TrioInStreamCustom
-TRIO_ARGS2((self, intPointer),
-	   trio_class_t *self,
-	   int *intPointer)
+#if TRIO_FEATURE_FD
+TRIO_PUBLIC int
+trio_dscanfv
+TRIO_ARGS3((fd, format, args),
+	   int fd,
+	   TRIO_CONST char *format,
+	   trio_pointer_t *args)
 {
-  trio_custom_t *data;
-
-  assert(VALID(self));
-  assert(VALID(self->location));
+  static va_list unused;
 
-  self->actually.cached = 0;
+  assert(VALID(format));
 
-  data = (trio_custom_t *)self->location;
+  return TrioScan((trio_pointer_t)&fd, 0,
+		  TrioInStreamFileDescriptor,
+		  NULL,
+		  format,
+		  unused, TrioArrayGetter, args, NULL);
+}
+#endif /* TRIO_FEATURE_FD */
 
-  self->current = (data->stream.in == NULL)
-    ? NIL
-    : (data->stream.in)(data->closure);
+/*************************************************************************
+ * dbscanf
+ */
 
-  if (self->current == NIL)
-    {
-      self->current = EOF;
-    }
-  else
-    {
-      self->processed++;
-      self->actually.cached++;
-    }
+/**
+   Create a buffered file descriptor for scanning.
 
-  if (VALID(intPointer))
-    {
-      *intPointer = self->current;
-    }
-}
-#endif /* TRIO_FEATURE_CLOSURE */
+   Characters are read from the file descriptor in blocks of up to
+   @p size characters. Characters that have been read, but not yet
+   consumed by a scan, are kept in the buffer for the next scan.
 
-/*************************************************************************
- * TrioInStreamString
+   @param fd File descriptor.
+   @param storage Buffer storage, or NULL to let trio allocate it.
+   @param size Size of the buffer storage. If @p storage is NULL and
+   @p size is zero, a default size is used.
+   @return Buffered file descriptor, or NULL if allocation failed.
  */
-static void
-TrioInStreamString
-TRIO_ARGS2((self, intPointer),
-	   trio_class_t *self,
-	   int *intPointer)
+#if TRIO_FEATURE_FD
+TRIO_PUBLIC trio_dbuffer_t *
+trio_dbuffer_create
+TRIO_ARGS3((fd, storage, size),
+	   int fd,
+	   char *storage,
+	   size_t size)
 {
-  unsigned char **buffer;
-
-  assert(VALID(self));
-  assert(VALID(self->location));
+  TRIO_CONST trio_allocator_t *allocator;
+  trio_dbuffer_t *self;
 
-  self->actually.cached = 0;
+  assert((storage == NULL) || (size > 0));
 
-  buffer = (unsigned char **)self->location;
-  self->current = (*buffer)[0];
-  if (self->current == NIL)
-    {
-      self->current = EOF;
-    }
-  else
-    {
-      (*buffer)++;
-      self->processed++;
-      self->actually.cached++;
-    }
+  if ((storage == NULL) && (size == 0))
+    size = BUFSIZ;
 
-  if (VALID(intPointer))
+  /* Trio-owned storage is placed right after the buffer descriptor */
+  allocator = TrioGetAllocator(NULL);
+  self = (trio_dbuffer_t *)TrioAllocate(allocator, sizeof(trio_dbuffer_t)
+					+ ((storage == NULL) ? size : 0));
+  if (self)
     {
-      *intPointer = self->current;
+      self->allocator = allocator;
+      self->fd = fd;
+      self->data = (storage == NULL)
+	? (unsigned char *)&self[1]
+	: (unsigned char *)storage;
+      self->size = size;
+      self->position = 0;
+      self->length = 0;
     }
+  return self;
 }
+#endif /* TRIO_FEATURE_FD */
 
-/*************************************************************************
- *
- * Formatted scanning functions
- *
- ************************************************************************/
+/**
+   Destroy a buffered file descriptor.
 
-#if defined(TRIO_DOCUMENTATION)
-# include "doc/doc_scanf.h"
-#endif
-/** @addtogroup Scanf
-    @{
-*/
+   The file descriptor itself is not closed, and caller-provided
+   storage is not released.
 
-/*************************************************************************
- * scanf
+   @param buffer Buffered file descriptor.
  */
+#if TRIO_FEATURE_FD
+TRIO_PUBLIC void
+trio_dbuffer_destroy
+TRIO_ARGS1((buffer),
+	   trio_dbuffer_t *buffer)
+{
+  if (buffer)
+    {
+      TrioDeallocate(buffer->allocator, buffer);
+    }
+}
+#endif /* TRIO_FEATURE_FD */
 
 /**
-   Scan characters from standard input stream.
+   Scan characters from buffered file descriptor.
 
+   @param buffer Buffered file descriptor.
    @param format Formatting string.
    @param ... Arguments.
    @return Number of scanned characters.
  */
-#if TRIO_FEATURE_STDIO
+#if TRIO_FEATURE_FD
 TRIO_PUBLIC int
-trio_scanf
-TRIO_VARGS2((format, va_alist),
+trio_dbscanf
+TRIO_VARGS3((buffer, format, va_alist),
+	    trio_dbuffer_t *buffer,
 	    TRIO_CONST char *format,
 	    TRIO_VA_DECL)
 {
   int status;
   va_list args;
 
+  assert(VALID(buffer));
   assert(VALID(format));
 
   TRIO_VA_START(args, format);
-  status = TrioScan((trio_pointer_t)stdin, 0,
-		    TrioInStreamFile,
-		    TrioUndoStreamFile,
-		    format, args, NULL, NULL);
+  status = TrioScan((trio_pointer_t)buffer, 0,
+		    TrioInStreamFileDescriptorBuffer,
+		    TrioUndoStreamFileDescriptorBuffer,
+		    format, args, NULL, NULL, NULL);
   TRIO_VA_END(args);
   return status;
 }
-#endif /* TRIO_FEATURE_STDIO */
+#endif /* TRIO_FEATURE_FD */
 
 /**
-   Scan characters from standard input stream.
+   Scan characters from buffered file descriptor.
 
+   @param buffer Buffered file descriptor.
    @param format Formatting string.
    @param args Arguments.
    @return Number of scanned characters.
  */
-#if TRIO_FEATURE_STDIO
+#if TRIO_FEATURE_FD
 TRIO_PUBLIC int
-trio_vscanf
-TRIO_ARGS2((format, args),
+trio_vdbscanf
+TRIO_ARGS3((buffer, format, args),
+	   trio_dbuffer_t *buffer,
 	   TRIO_CONST char *format,
 	   va_list args)
 {
+  assert(VALID(buffer));
   assert(VALID(format));
 
-  return TrioScan((trio_pointer_t)stdin, 0,
-		  TrioInStreamFile,
-		  TrioUndoStreamFile,
-		  format, args, NULL, NULL);
+  return TrioScan((trio_pointer_t)buffer, 0,
+		  TrioInStreamFileDescriptorBuffer,
+		  TrioUndoStreamFileDescriptorBuffer,
+		  format, args, NULL, NULL, NULL);
 }
-#endif /* TRIO_FEATURE_STDIO */
+#endif /* TRIO_FEATURE_FD */
 
 /**
-   Scan characters from standard input stream.
+   Scan characters from buffered file descriptor.
 
+   @param buffer Buffered file descriptor.
    @param format Formatting string.
    @param args Arguments.
    @return Number of scanned characters.
  */
-#if TRIO_FEATURE_STDIO
+#if TRIO_FEATURE_FD
 TRIO_PUBLIC int
-trio_scanfv
-TRIO_ARGS2((format, args),
+trio_dbscanfv
+TRIO_ARGS3((buffer, format, args),
+	   trio_dbuffer_t *buffer,
 	   TRIO_CONST char *format,
 	   trio_pointer_t *args)
 {
   static va_list unused;
 
+  assert(VALID(buffer));
   assert(VALID(format));
 
-  return TrioScan((trio_pointer_t)stdin, 0,
-		  TrioInStreamFile,
-		  TrioUndoStreamFile,
+  return TrioScan((trio_pointer_t)buffer, 0,
+		  TrioInStreamFileDescriptorBuffer,
+		  TrioUndoStreamFileDescriptorBuffer,
 		  format,
-		  unused, TrioArrayGetter, args);
+		  unused, TrioArrayGetter, args, NULL);
 }
-#endif /* TRIO_FEATURE_STDIO */
+#endif /* TRIO_FEATURE_FD */
 
 /*************************************************************************
- * fscanf
+ * scanner
+ */
+
+/*************************************************************************
+ * TrioScannerRead
+ *
+ * Description:
+ *  Read a stream to the end into allocated memory. This is used for
+ *  input that cannot be mapped, such as pipes and device files, so
+ *  the size is only a hint and the buffer grows as needed.
  */
+#if TRIO_FEATURE_SCANNER
+static BOOLEAN_T
+TrioScannerRead
+# if defined(USE_MMAP)
+TRIO_ARGS3((self, fd, hint),
+	   trio_scanner_t *self,
+	   int fd,
+	   size_t hint)
+# else
+TRIO_ARGS3((self, file, hint),
+	   trio_scanner_t *self,
+	   FILE *file,
+	   size_t hint)
+# endif
+{
+  char *data = NULL;
+  char *larger;
+  size_t capacity = 0;
+  size_t size = 0;
+# if defined(USE_MMAP)
+  long count;
+# else
+  size_t count;
+# endif
+
+  for (;;)
+    {
+      if (size == capacity)
+	{
+	  /* One extra character lets a correct hint finish without growing */
+	  if (capacity == 0)
+	    capacity = (hint > 0) ? hint + 1 : (size_t)MAX_SCANNER_CHUNK;
+	  else if (capacity <= ((size_t)-1) / 2)
+	    capacity *= 2;
+	  else
+	    break;
+	  larger = (char *)TrioAllocate(self->allocator, capacity);
+	  if (larger == NULL)
+	    break;
+	  if (data)
+	    {
+	      memcpy(larger, data, size);
+	      TrioDeallocate(self->allocator, data);
+	    }
+	  data = larger;
+	}
+# if defined(USE_MMAP)
+      count = (long)read(fd, &data[size], capacity - size);
+      if ((count == -1) && (errno == EINTR))
+	continue;
+      if (count <= 0)
+	{
+	  if (count == 0)
+	    {
+	      /* End of file */
+	      capacity = size;
+	    }
+	  break;
+	}
+      size += (size_t)count;
+# else
+      count = fread(&data[size], 1, capacity - size, file);
+      size += count;
+      if (count == 0)
+	{
+	  if (!ferror(file))
+	    capacity = size;
+	  break;
+	}
+# endif
+    }
+
+  if (size != capacity)
+    {
+      /* Out of memory or read error */
+      if (data)
+	TrioDeallocate(self->allocator, data);
+      return FALSE;
+    }
+  if (size == 0)
+    {
+      if (data)
+	TrioDeallocate(self->allocator, data);
+    }
+  else
+    {
+      self->data = data;
+      self->size = size;
+      self->storage = SCANNER_STORAGE_ALLOCATED;
+    }
+  return TRUE;
+}
+#endif /* TRIO_FEATURE_SCANNER */
+
+/**
+   Open a file for scanning from start to end.
+
+   Regular files are mapped into memory where possible. Other files,
+   such as pipes and device files, are read into memory up to the end
+   of the input. Each call to @ref trio_scanner_scan continues where
+   the previous one stopped. A zero character ends the input.
+
+   @param path File name.
+   @return Scanner, or NULL if the file could not be opened or read.
+ */
+#if TRIO_FEATURE_SCANNER
+TRIO_PUBLIC trio_scanner_t *
+trio_scanner_open
+TRIO_ARGS1((path),
+	   TRIO_CONST char *path)
+{
+  TRIO_CONST trio_allocator_t *allocator;
+  trio_scanner_t *self;
+  BOOLEAN_T success;
+  size_t hint = 0;
+#if defined(USE_MMAP)
+  struct stat status;
+  void *mapping;
+  int fd;
+#else
+  FILE *file;
+  long length;
+#endif
+
+  assert(VALID(path));
+
+  allocator = TrioGetAllocator(NULL);
+  self = (trio_scanner_t *)TrioAllocate(allocator, sizeof(trio_scanner_t));
+  if (self == NULL)
+    return NULL;
+
+  self->allocator = allocator;
+  self->data = "";
+  self->size = 0;
+  self->position = 0;
+  self->lines = 0;
+  self->lineOffset = 0;
+  self->storage = SCANNER_STORAGE_CALLER;
+
+#if defined(USE_MMAP)
+  fd = open(path, O_RDONLY);
+  if (fd == -1)
+    goto error;
+  if (fstat(fd, &status) == -1)
+    {
+      close(fd);
+      goto error;
+    }
+  /* Files in /proc and similar report a zero size, so they are read */
+  if (S_ISREG(status.st_mode) && (status.st_size > 0) &&
+      ((off_t)(size_t)status.st_size == status.st_size))
+    {
+      hint = (size_t)status.st_size;
+      mapping = mmap(NULL, hint, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping != MAP_FAILED)
+	{
+# if defined(MADV_SEQUENTIAL)
+	  (void)madvise(mapping, hint, MADV_SEQUENTIAL);
+# endif
+	  self->data = (TRIO_CONST char *)mapping;
+	  self->size = hint;
+	  self->storage = SCANNER_STORAGE_MAPPED;
+	  close(fd);
+	  return self;
+	}
+    }
+  success = TrioScannerRead(self, fd, hint);
+  close(fd);
+#else
+  file = fopen(path, "rb");
+  if (file == NULL)
+    goto error;
+  /* Streams that cannot seek are read without a size hint */
+  if ((fseek(file, 0L, SEEK_END) == 0) && ((length = ftell(file)) > 0))
+    hint = (size_t)length;
+  if (fseek(file, 0L, SEEK_SET) != 0)
+    clearerr(file);
+  success = TrioScannerRead(self, file, hint);
+  fclose(file);
+#endif
+  if (success)
+    return self;
+
+ error:
+  TrioDeallocate(allocator, self);
+  return NULL;
+}
+#endif /* TRIO_FEATURE_SCANNER */
 
 /**
-   Scan characters from file.
+   Create a scanner for a memory region.
 
-   @param file File pointer.
-   @param format Formatting string.
-   @param ... Arguments.
-   @return Number of scanned characters.
+   The region is not copied, so it must remain unchanged until the
+   scanner is destroyed. It does not need to be zero terminated.
+
+   @param buffer Start of the region.
+   @param size Size of the region.
+   @return Scanner, or NULL if allocation failed.
  */
-#if TRIO_FEATURE_FILE
-TRIO_PUBLIC int
-trio_fscanf
-TRIO_VARGS3((file, format, va_alist),
-	    FILE *file,
-	    TRIO_CONST char *format,
-	    TRIO_VA_DECL)
+#if TRIO_FEATURE_SCANNER
+TRIO_PUBLIC trio_scanner_t *
+trio_scanner_create
+TRIO_ARGS2((buffer, size),
+	   TRIO_CONST char *buffer,
+	   size_t size)
 {
-  int status;
-  va_list args;
+  TRIO_CONST trio_allocator_t *allocator;
+  trio_scanner_t *self;
 
-  assert(VALID(file));
-  assert(VALID(format));
+  assert(VALID(buffer) || (size == 0));
 
-  TRIO_VA_START(args, format);
-  status = TrioScan((trio_pointer_t)file, 0,
-		    TrioInStreamFile,
-		    TrioUndoStreamFile,
-		    format, args, NULL, NULL);
-  TRIO_VA_END(args);
-  return status;
+  allocator = TrioGetAllocator(NULL);
+  self = (trio_scanner_t *)TrioAllocate(allocator, sizeof(trio_scanner_t));
+  if (self)
+    {
+      self->allocator = allocator;
+      self->data = (size == 0) ? "" : buffer;
+      self->size = size;
+      self->position = 0;
+      self->lines = 0;
+      self->lineOffset = 0;
+      self->storage = SCANNER_STORAGE_CALLER;
+    }
+  return self;
 }
-#endif /* TRIO_FEATURE_FILE */
+#endif /* TRIO_FEATURE_SCANNER */
 
 /**
-   Scan characters from file.
+   Destroy a scanner.
 
-   @param file File pointer.
-   @param format Formatting string.
-   @param args Arguments.
-   @return Number of scanned characters.
+   A mapped or read file is released, but a caller-provided region is
+   not.
+
+   @param scanner Scanner.
  */
-#if TRIO_FEATURE_FILE
-TRIO_PUBLIC int
-trio_vfscanf
-TRIO_ARGS3((file, format, args),
-	   FILE *file,
-	   TRIO_CONST char *format,
-	   va_list args)
+#if TRIO_FEATURE_SCANNER
+TRIO_PUBLIC void
+trio_scanner_destroy
+TRIO_ARGS1((scanner),
+	   trio_scanner_t *scanner)
 {
-  assert(VALID(file));
-  assert(VALID(format));
-
-  return TrioScan((trio_pointer_t)file, 0,
-		  TrioInStreamFile,
-		  TrioUndoStreamFile,
-		  format, args, NULL, NULL);
+  if (scanner)
+    {
+      switch (scanner->storage)
+	{
+#if defined(USE_MMAP)
+	case SCANNER_STORAGE_MAPPED:
+	  (void)munmap((void *)scanner->data, scanner->size);
+	  break;
+#endif
+	case SCANNER_STORAGE_ALLOCATED:
+	  TrioDeallocate(scanner->allocator, (trio_pointer_t)scanner->data);
+	  break;
+	default:
+	  break;
+	}
+      TrioDeallocate(scanner->allocator, scanner);
+    }
 }
-#endif /* TRIO_FEATURE_FILE */
+#endif /* TRIO_FEATURE_SCANNER */
 
-/**
-   Scan characters from file.
-
-   @param file File pointer.
-   @param format Formatting string.
-   @param args Arguments.
-   @return Number of scanned characters.
+/*************************************************************************
+ * TrioScannerScan
+ *
+ * Description:
+ *  Scan from the position where the previous scan stopped, and move
+ *  the position past the consumed characters. The look-ahead character
+ *  is put back, so it is seen again by the next scan.
  */
-#if TRIO_FEATURE_FILE
-TRIO_PUBLIC int
-trio_fscanfv
-TRIO_ARGS3((file, format, args),
-	   FILE *file,
+#if TRIO_FEATURE_SCANNER
+static int
+TrioScannerScan
+TRIO_ARGS3((self, format, args),
+	   trio_scanner_t *self,
 	   TRIO_CONST char *format,
-	   trio_pointer_t *args)
+	   va_list args)
 {
-  static va_list unused;
+  TRIO_CONST char *cursor;
+  size_t left;
+  int status;
 
-  assert(VALID(file));
+  assert(VALID(self));
   assert(VALID(format));
 
-  return TrioScan((trio_pointer_t)file, 0,
-		  TrioInStreamFile,
-		  TrioUndoStreamFile,
-		  format,
-		  unused, TrioArrayGetter, args);
+  cursor = &self->data[self->position];
+  left = self->size - self->position;
+  /* The number of characters read is counted with an int */
+  if (left > INT_MAX)
+    left = INT_MAX;
+
+  status = TrioScan((trio_pointer_t)&cursor, left,
+		    TrioInStreamStringMax,
+		    TrioUndoStreamString,
+		    format, args, NULL, NULL, NULL);
+  self->position = (size_t)(cursor - self->data);
+  return status;
 }
-#endif /* TRIO_FEATURE_FILE */
-
-/*************************************************************************
- * dscanf
- */
+#endif /* TRIO_FEATURE_SCANNER */
 
 /**
-   Scan characters from file descriptor.
+   Scan characters from the position where the previous scan stopped.
 
-   @param fd File descriptor.
+   @param scanner Scanner.
    @param format Formatting string.
    @param ... Arguments.
    @return Number of scanned characters.
  */
-#if TRIO_FEATURE_FD
+#if TRIO_FEATURE_SCANNER
 TRIO_PUBLIC int
-trio_dscanf
-TRIO_VARGS3((fd, format, va_alist),
-	    int fd,
+trio_scanner_scan
+TRIO_VARGS3((scanner, format, va_alist),
+	    trio_scanner_t *scanner,
 	    TRIO_CONST char *format,
 	    TRIO_VA_DECL)
 {
   int status;
   va_list args;
 
-  assert(VALID(format));
-
   TRIO_VA_START(args, format);
-  status = TrioScan((trio_pointer_t)&fd, 0,
-		    TrioInStreamFileDescriptor,
-		    NULL,
-		    format, args, NULL, NULL);
+  status = TrioScannerScan(scanner, format, args);
   TRIO_VA_END(args);
   return status;
 }
-#endif /* TRIO_FEATURE_FD */
+#endif /* TRIO_FEATURE_SCANNER */
 
 /**
-   Scan characters from file descriptor.
+   Scan characters from the position where the previous scan stopped.
 
-   @param fd File descriptor.
+   @param scanner Scanner.
    @param format Formatting string.
    @param args Arguments.
    @return Number of scanned characters.
  */
-#if TRIO_FEATURE_FD
+#if TRIO_FEATURE_SCANNER
 TRIO_PUBLIC int
-trio_vdscanf
-TRIO_ARGS3((fd, format, args),
-	   int fd,
+trio_scanner_vscan
+TRIO_ARGS3((scanner, format, args),
+	   trio_scanner_t *scanner,
 	   TRIO_CONST char *format,
 	   va_list args)
 {
-  assert(VALID(format));
+  return TrioScannerScan(scanner, format, args);
+}
+#endif /* TRIO_FEATURE_SCANNER */
 
-  return TrioScan((trio_pointer_t)&fd, 0,
-		  TrioInStreamFileDescriptor,
-		  NULL,
-		  format, args, NULL, NULL);
+/**
+   Get the position of a scanner.
+
+   @param scanner Scanner.
+   @return Number of bytes consumed from the start of the input.
+ */
+#if TRIO_FEATURE_SCANNER
+TRIO_PUBLIC size_t
+trio_scanner_offset
+TRIO_ARGS1((scanner),
+	   trio_scanner_t *scanner)
+{
+  assert(VALID(scanner));
+
+  return scanner->position;
 }
-#endif /* TRIO_FEATURE_FD */
+#endif /* TRIO_FEATURE_SCANNER */
 
 /**
-   Scan characters from file descriptor.
+   Get the line number of a scanner.
 
-   @param fd File descriptor.
-   @param format Formatting string.
-   @param args Arguments.
-   @return Number of scanned characters.
+   Lines are counted on demand from the previous call, so calling this
+   function after each scan does not rescan the input.
+
+   @param scanner Scanner.
+   @return Line number of the position, starting from 1.
  */
-#if TRIO_FEATURE_FD
-TRIO_PUBLIC int
-trio_dscanfv
-TRIO_ARGS3((fd, format, args),
-	   int fd,
-	   TRIO_CONST char *format,
-	   trio_pointer_t *args)
+#if TRIO_FEATURE_SCANNER
+TRIO_PUBLIC size_t
+trio_scanner_line
+TRIO_ARGS1((scanner),
+	   trio_scanner_t *scanner)
 {
-  static va_list unused;
+  TRIO_CONST char *current;
+  TRIO_CONST char *end;
 
-  assert(VALID(format));
+  assert(VALID(scanner));
 
-  return TrioScan((trio_pointer_t)&fd, 0,
-		  TrioInStreamFileDescriptor,
-		  NULL,
-		  format,
-		  unused, TrioArrayGetter, args);
+  current = &scanner->data[scanner->lineOffset];
+  end = &scanner->data[scanner->position];
+  while (current < end)
+    {
+      current = (TRIO_CONST char *)memchr(current, '\n', (size_t)(end - current));
+      if (current == NULL)
+	break;
+      scanner->lines++;
+      current++;
+    }
+  scanner->lineOffset = scanner->position;
+  return scanner->lines + 1;
 }
-#endif /* TRIO_FEATURE_FD */
+#endif /* TRIO_FEATURE_SCANNER */
 
 /*************************************************************************
  * cscanf
@@ -7694,7 +11880,7 @@ TRIO_VARGS4((stream, closure, format, va_alist),
   TRIO_VA_START(args, format);
   data.stream.in = stream;
   data.closure = closure;
-  status = TrioScan(&data, 0, TrioInStreamCustom, NULL, format, args, NULL, NULL);
+  status = TrioScan(&data, 0, TrioInStreamCustom, NULL, format, args, NULL, NULL, NULL);
   TRIO_VA_END(args);
   return status;
 }
@@ -7716,7 +11902,7 @@ TRIO_ARGS4((stream, closure, format, args),
 
   data.stream.in = stream;
   data.closure = closure;
-  return TrioScan(&data, 0, TrioInStreamCustom, NULL, format, args, NULL, NULL);
+  return TrioScan(&data, 0, TrioInStreamCustom, NULL, format, args, NULL, NULL, NULL);
 }
 #endif /* TRIO_FEATURE_CLOSURE */
 
@@ -7738,7 +11924,7 @@ TRIO_ARGS4((stream, closure, format, args),
   data.stream.in = stream;
   data.closure = closure;
   return TrioScan(&data, 0, TrioInStreamCustom, NULL, format,
-		  unused, TrioArrayGetter, args);
+		  unused, TrioArrayGetter, args, NULL);
 }
 #endif /* TRIO_FEATURE_CLOSURE */
 
@@ -7762,7 +11948,7 @@ TRIO_ARGS5((stream, closure, format, argfunc, context),
   data.stream.in = stream;
   data.closure = closure;
   return TrioScan(&data, 0, TrioInStreamCustom, NULL, format,
-                  unused, argfunc, (trio_pointer_t *)context);
+                  unused, argfunc, (trio_pointer_t *)context, NULL);
 }
 #endif /* TRIO_FEATURE_CLOSURE && TRIO_FEATURE_ARGFUNC */
 
@@ -7795,7 +11981,7 @@ TRIO_VARGS3((buffer, format, va_alist),
   status = TrioScan((trio_pointer_t)&buffer, 0,
 		    TrioInStreamString,
 		    NULL,
-		    format, args, NULL, NULL);
+		    format, args, NULL, NULL, NULL);
   TRIO_VA_END(args);
   return status;
 }
@@ -7821,8 +12007,70 @@ TRIO_ARGS3((buffer, format, args),
   return TrioScan((trio_pointer_t)&buffer, 0,
 		  TrioInStreamString,
 		  NULL,
-		  format, args, NULL, NULL);
+		  format, args, NULL, NULL, NULL);
+}
+
+/**
+   Scan characters from string using a given locale.
+
+   @param buffer Input string.
+   @param locale Locale object, or NULL for the current locale.
+   @param format Formatting string.
+   @param ... Arguments.
+   @return Number of scanned characters.
+ */
+#if TRIO_FEATURE_LOCALE
+TRIO_PUBLIC int
+trio_sscanf_l
+TRIO_VARGS4((buffer, locale, format, va_alist),
+	    TRIO_CONST char *buffer,
+	    TRIO_CONST trio_locale_t *locale,
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
+{
+  int status;
+  va_list args;
+
+  assert(VALID(buffer));
+  assert(VALID(format));
+
+  TRIO_VA_START(args, format);
+  status = TrioScan((trio_pointer_t)&buffer, 0,
+		    TrioInStreamString,
+		    NULL,
+		    format, args, NULL, NULL, locale);
+  TRIO_VA_END(args);
+  return status;
+}
+#endif /* TRIO_FEATURE_LOCALE */
+
+/**
+   Scan characters from string using a given locale.
+
+   @param buffer Input string.
+   @param locale Locale object, or NULL for the current locale.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of scanned characters.
+ */
+#if TRIO_FEATURE_LOCALE
+TRIO_PUBLIC int
+trio_vsscanf_l
+TRIO_ARGS4((buffer, locale, format, args),
+	   TRIO_CONST char *buffer,
+	   TRIO_CONST trio_locale_t *locale,
+	   TRIO_CONST char *format,
+	   va_list args)
+{
+  assert(VALID(buffer));
+  assert(VALID(format));
+
+  return TrioScan((trio_pointer_t)&buffer, 0,
+		  TrioInStreamString,
+		  NULL,
+		  format, args, NULL, NULL, locale);
 }
+#endif /* TRIO_FEATURE_LOCALE */
 
 /**
    Scan characters from string.
@@ -7848,7 +12096,106 @@ TRIO_ARGS3((buffer, format, args),
 		  TrioInStreamString,
 		  NULL,
 		  format,
-		  unused, TrioArrayGetter, args);
+		  unused, TrioArrayGetter, args, NULL);
+}
+
+/*************************************************************************
+ * snscanf
+ */
+
+/**
+   Scan characters from a string of limited length.
+
+   At most @p max characters are read from @p buffer, which does not
+   need to be zero terminated. A zero character within the first
+   @p max characters still ends the input.
+
+   @param buffer Input string.
+   @param max Maximum number of characters to read.
+   @param format Formatting string.
+   @param ... Arguments.
+   @return Number of scanned characters.
+ */
+TRIO_PUBLIC int
+trio_snscanf
+TRIO_VARGS4((buffer, max, format, va_alist),
+	    TRIO_CONST char *buffer,
+	    size_t max,
+	    TRIO_CONST char *format,
+	    TRIO_VA_DECL)
+{
+  int status;
+  va_list args;
+
+  assert(VALID(buffer) || (max == 0));
+  assert(VALID(format));
+
+  /* The number of characters read is counted with an int */
+  if (max > INT_MAX)
+    max = INT_MAX;
+
+  TRIO_VA_START(args, format);
+  status = TrioScan((trio_pointer_t)&buffer, max,
+		    TrioInStreamStringMax,
+		    NULL,
+		    format, args, NULL, NULL, NULL);
+  TRIO_VA_END(args);
+  return status;
+}
+
+/**
+   Scan characters from a string of limited length.
+
+   @param buffer Input string.
+   @param max Maximum number of characters to read.
+   @param format Formatting string.
+   @param args Arguments.
+   @return Number of scanned characters.
+ */
+TRIO_PUBLIC int
+trio_vsnscanf
+TRIO_ARGS4((buffer, max, format, args),
+	   TRIO_CONST char *buffer,
+	   size_t max,
+	   TRIO_CONST char *format,
+	   va_list args)
+{
+  assert(VALID(buffer) || (max == 0));
+  assert(VALID(format));
+
+  if (max > INT_MAX)
+    max = INT_MAX;
+
+  return TrioScan((trio_pointer_t)&buffer, max,
+		  TrioInStreamStringMax,
+		  NULL,
+		  format, args, NULL, NULL, NULL);
+}
+
+/**
+   Prepare the tables used by the scan functions.
+
+   The table of locale equivalence classes, used by @c [[=c=]] in
+   scan groups, is expensive to build and is otherwise built by the
+   first scan that needs it. Calling this function at startup moves
+   that cost out of the first request. The table reflects the
+   @c LC_COLLATE locale at the time it is built.
+
+   The tables are safe to build concurrently, so calling this function
+   is never required for correctness, except on compilers without
+   atomic operations where it must be called before starting threads.
+
+   @return Zero on success, or a negative error code if memory could
+   not be allocated.
+*/
+TRIO_PUBLIC int
+trio_scan_warmup(TRIO_NOARGS)
+{
+#if TRIO_EXTENSION
+  if (TrioGetCollation() == NULL)
+    return TRIO_ERROR_RETURN(TRIO_ENOMEM, 0);
+#endif
+  return 0;
 }
 
 #endif /* TRIO_FEATURE_SCANF */
@@ -84,6 +84,23 @@ typedef trio_pointer_t (*trio_argfunc_t) TRIO_PROTO((trio_pointer_t, int, int));
 typedef int (*trio_outstream_t) TRIO_PROTO((trio_pointer_t, int));
 typedef int (*trio_instream_t) TRIO_PROTO((trio_pointer_t));
 
+/* Compiled format (for printing) */
+typedef struct _trio_format_t trio_format_t;
+
+/* Buffered file descriptor (for scanning) */
+typedef struct _trio_dbuffer_t trio_dbuffer_t;
+
+/* File or memory region scanned from start to end (for scanning) */
+typedef struct _trio_scanner_t trio_scanner_t;
+
+/* Location of a field in the scanned string (for the v qualifier) */
+typedef struct {
+  TRIO_CONST char *pointer;
+  size_t length;
+} trio_view_t;
+
+void trio_set_allocator TRIO_PROTO((TRIO_CONST trio_allocator_t *allocator));
+
 TRIO_CONST char *trio_strerror TRIO_PROTO((int));
 
 /*************************************************************************
@@ -144,6 +161,37 @@ int trio_asprintf TRIO_PROTO_PRINTF((char **ret, TRIO_CONST char *format, ...),
 int trio_vasprintf TRIO_PROTO((char **ret, TRIO_CONST char *format, va_list args));
 int trio_asprintfv TRIO_PROTO((char **result, TRIO_CONST char *format, trio_pointer_t * args));
 
+int trio_bprintf TRIO_PROTO_PRINTF((trio_buffer_t *buffer, TRIO_CONST char *format, ...), 2);
+int trio_vbprintf TRIO_PROTO((trio_buffer_t *buffer, TRIO_CONST char *format, va_list args));
+int trio_bprintfv TRIO_PROTO((trio_buffer_t *buffer, TRIO_CONST char *format,
+			      trio_pointer_t *args));
+
+int trio_asprintf_a TRIO_PROTO_PRINTF((TRIO_CONST trio_allocator_t *allocator, char **ret,
+					TRIO_CONST char *format, ...), 3);
+int trio_vasprintf_a TRIO_PROTO((TRIO_CONST trio_allocator_t *allocator, char **ret,
+				 TRIO_CONST char *format, va_list args));
+
+trio_format_t *trio_format_compile TRIO_PROTO((TRIO_CONST char *format));
+trio_format_t *trio_format_compile_a TRIO_PROTO((TRIO_CONST trio_allocator_t *allocator,
+						 TRIO_CONST char *format));
+void trio_format_destroy TRIO_PROTO((trio_format_t *compiled));
+
+int trio_printf_compiled TRIO_PROTO((TRIO_CONST trio_format_t *compiled, ...));
+int trio_vprintf_compiled TRIO_PROTO((TRIO_CONST trio_format_t *compiled, va_list args));
+
+int trio_fprintf_compiled TRIO_PROTO((FILE *file, TRIO_CONST trio_format_t *compiled, ...));
+int trio_vfprintf_compiled TRIO_PROTO((FILE *file, TRIO_CONST trio_format_t *compiled,
+				       va_list args));
+
+int trio_snprintf_compiled TRIO_PROTO((char *buffer, size_t max,
+				       TRIO_CONST trio_format_t *compiled, ...));
+int trio_vsnprintf_compiled TRIO_PROTO((char *buffer, size_t max,
+					TRIO_CONST trio_format_t *compiled, va_list args));
+
+int trio_format_cache_enable TRIO_PROTO((int enable));
+void trio_format_cache_clear TRIO_PROTO((void));
+void trio_format_cache_statistics TRIO_PROTO((unsigned long *hits, unsigned long *misses));
+
 /*************************************************************************
  * Scan Functions
  */
@@ -159,6 +207,12 @@ int trio_dscanf TRIO_PROTO_SCANF((int fd, TRIO_CONST char *format, ...), 2);
 int trio_vdscanf TRIO_PROTO((int fd, TRIO_CONST char *format, va_list args));
 int trio_dscanfv TRIO_PROTO((int fd, TRIO_CONST char *format, void **args));
 
+trio_dbuffer_t *trio_dbuffer_create TRIO_PROTO((int fd, char *storage, size_t size));
+void trio_dbuffer_destroy TRIO_PROTO((trio_dbuffer_t *buffer));
+int trio_dbscanf TRIO_PROTO_SCANF((trio_dbuffer_t *buffer, TRIO_CONST char *format, ...), 2);
+int trio_vdbscanf TRIO_PROTO((trio_dbuffer_t *buffer, TRIO_CONST char *format, va_list args));
+int trio_dbscanfv TRIO_PROTO((trio_dbuffer_t *buffer, TRIO_CONST char *format, void **args));
+
 int trio_cscanf TRIO_PROTO_SCANF((trio_instream_t stream, trio_pointer_t closure,
                                   TRIO_CONST char *format, ...),
                                  3);
@@ -174,6 +228,19 @@ int trio_sscanf TRIO_PROTO_SCANF((TRIO_CONST char *buffer, TRIO_CONST char *form
 int trio_vsscanf TRIO_PROTO((TRIO_CONST char *buffer, TRIO_CONST char *format, va_list args));
 int trio_sscanfv TRIO_PROTO((TRIO_CONST char *buffer, TRIO_CONST char *format, void **args));
 
+int trio_snscanf TRIO_PROTO_SCANF((TRIO_CONST char *buffer, size_t max, TRIO_CONST char *format, ...), 3);
+int trio_vsnscanf TRIO_PROTO((TRIO_CONST char *buffer, size_t max, TRIO_CONST char *format, va_list args));
+
+trio_scanner_t *trio_scanner_open TRIO_PROTO((TRIO_CONST char *path));
+trio_scanner_t *trio_scanner_create TRIO_PROTO((TRIO_CONST char *buffer, size_t size));
+void trio_scanner_destroy TRIO_PROTO((trio_scanner_t *scanner));
+int trio_scanner_scan TRIO_PROTO_SCANF((trio_scanner_t *scanner, TRIO_CONST char *format, ...), 2);
+int trio_scanner_vscan TRIO_PROTO((trio_scanner_t *scanner, TRIO_CONST char *format, va_list args));
+size_t trio_scanner_offset TRIO_PROTO((trio_scanner_t *scanner));
+size_t trio_scanner_line TRIO_PROTO((trio_scanner_t *scanner));
+
+int trio_scan_warmup TRIO_PROTO((void));
+
 /*************************************************************************
  * Locale Functions
  */
@@ -181,6 +248,21 @@ void trio_locale_set_decimal_point TRIO_PROTO((char *decimalPoint));
 void trio_locale_set_thousand_separator TRIO_PROTO((char *thousandSeparator));
 void trio_locale_set_grouping TRIO_PROTO((char *grouping));
 
+trio_locale_t *trio_locale_create TRIO_PROTO((TRIO_CONST char *decimalPoint,
+					     TRIO_CONST char *thousandSeparator,
+					     TRIO_CONST char *grouping));
+void trio_locale_destroy TRIO_PROTO((trio_locale_t *locale));
+TRIO_CONST trio_locale_t *trio_locale_use TRIO_PROTO((TRIO_CONST trio_locale_t *locale));
+
+int trio_snprintf_l TRIO_PROTO_PRINTF((char *buffer, size_t max, TRIO_CONST trio_locale_t *locale,
+				       TRIO_CONST char *format, ...), 4);
+int trio_vsnprintf_l TRIO_PROTO((char *buffer, size_t max, TRIO_CONST trio_locale_t *locale,
+				 TRIO_CONST char *format, va_list args));
+int trio_sscanf_l TRIO_PROTO_SCANF((TRIO_CONST char *buffer, TRIO_CONST trio_locale_t *locale,
+				    TRIO_CONST char *format, ...), 3);
+int trio_vsscanf_l TRIO_PROTO((TRIO_CONST char *buffer, TRIO_CONST trio_locale_t *locale,
+			       TRIO_CONST char *format, va_list args));
+
 /*************************************************************************
  * Renaming
  */
@@ -150,6 +150,8 @@ extern "C" {
 # define TRIO_FEATURE_STDIO 0
 # define TRIO_FEATURE_FD 0
 # define TRIO_FEATURE_DYNAMICSTRING 0
+# define TRIO_FEATURE_COMPILE 0
+# define TRIO_FEATURE_FORMAT_CACHE 0
 # define TRIO_FEATURE_CLOSURE 0
 # define TRIO_FEATURE_ARGFUNC 0
 # define TRIO_FEATURE_STRERR 0
@@ -222,6 +224,33 @@ extern "C" {
 # define TRIO_FEATURE_DYNAMICSTRING 1
 #endif
 
+/*
+ * TRIO_FEATURE_COMPILE (=0 or =1)
+ *
+ * Define this to 0 to disable compilation of trio_format_compile()
+ * and the family of functions that print with a compiled format, or
+ * define to 1 to enable them.
+ *
+ * A compiled format is allocated with malloc.
+ */
+#if !defined(TRIO_FEATURE_COMPILE)
+# define TRIO_FEATURE_COMPILE 1
+#endif
+
+/*
+ * TRIO_FEATURE_FORMAT_CACHE (=0 or =1)
+ *
+ * Define this to 0 to disable compilation of the cache of parsed
+ * format strings, or define to 1 to enable it.
+ *
+ * The cache is empty and unused until trio_format_cache_enable() is
+ * called. It requires TRIO_FEATURE_COMPILE and compiler support for
+ * atomic operations.
+ */
+#if !defined(TRIO_FEATURE_FORMAT_CACHE)
+# define TRIO_FEATURE_FORMAT_CACHE 1
+#endif
+
 /*
  * TRIO_FEATURE_CLOSURE (=0 or =1)
  *
@@ -404,6 +433,18 @@ extern "C" {
 # define TRIO_FEATURE_ROUNDING TRIO_EXTENSION
 #endif
 
+#if !defined(TRIO_FEATURE_SHORTEST)
+# define TRIO_FEATURE_SHORTEST (TRIO_EXTENSION && TRIO_FEATURE_FLOAT)
+#endif
+
+#if !defined(TRIO_FEATURE_VIEW)
+# define TRIO_FEATURE_VIEW (TRIO_EXTENSION && TRIO_FEATURE_SCANF)
+#endif
+
+#if !defined(TRIO_FEATURE_SCANNER)
+# define TRIO_FEATURE_SCANNER (TRIO_FEATURE_SCANF && TRIO_FEATURE_FILE)
+#endif
+
 /*************************************************************************
  * Memory handling
  */
@@ -417,6 +458,21 @@ extern "C" {
 # define TRIO_FREE(x) free(x)
 #endif
 
+/* Heap allocator (see trio_set_allocator) */
+typedef struct {
+  trio_pointer_t (*allocate) TRIO_PROTO((trio_pointer_t context, size_t size));
+  trio_pointer_t (*reallocate) TRIO_PROTO((trio_pointer_t context, trio_pointer_t pointer,
+					   size_t size));
+  void (*deallocate) TRIO_PROTO((trio_pointer_t context, trio_pointer_t pointer));
+  trio_pointer_t context;
+} trio_allocator_t;
+
+/* Dynamic string with inline storage (see triostr.h) */
+typedef struct _trio_buffer_t trio_buffer_t;
+
+/* Immutable numeric formatting conventions (see trio_locale_create) */
+typedef struct _trio_locale_t trio_locale_t;
+
 /*************************************************************************
  * User-defined specifiers
  */
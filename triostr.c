@@ -33,6 +33,7 @@
 #endif
 #if defined(USE_MATH)
 # include <math.h>
+# include <float.h>
 #endif
 
 /*************************************************************************
@@ -132,6 +133,23 @@
 # define trio_powl(x,y) pow((double)(x),(double)(y))
 #endif
 
+#if defined(TRIO_FUNC_TO_DOUBLE) \
+ || defined(TRIO_FUNC_TO_FLOAT)
+# define TRIO_FUNC_INTERNAL_TO_BINARY
+# define INTERNAL_DECIMAL_DIGITS 800
+# define INTERNAL_DECIMAL_SHIFT 28
+/*
+ * The fast path relies on each operation being rounded once, in the
+ * precision of its type. This is not the case with x87 extended
+ * precision evaluation.
+ */
+# if defined(FLT_EVAL_METHOD)
+#  if FLT_EVAL_METHOD == 0
+#   define USE_FAST_DECIMAL
+#  endif
+# endif
+#endif
+
 #if defined(TRIO_FUNC_TO_UPPER) \
  || (defined(TRIO_FUNC_EQUAL) && !defined(USE_STRCASECMP)) \
  || (defined(TRIO_FUNC_EQUAL_MAX) && !defined(USE_STRNCASECMP)) \
@@ -150,8 +168,38 @@ struct _trio_string_t
   char *content;
   size_t length;
   size_t allocated;
+  TRIO_CONST trio_allocator_t *allocator;
 };
 
+/*************************************************************************
+ * Heap allocation
+ */
+
+#define INTERNAL_ALLOCATE(allocator, size) \
+  ((allocator) \
+   ? (allocator)->allocate((allocator)->context, (size)) \
+   : TRIO_MALLOC(size))
+#define INTERNAL_REALLOCATE(allocator, pointer, size) \
+  ((allocator) \
+   ? (allocator)->reallocate((allocator)->context, (pointer), (size)) \
+   : TRIO_REALLOC((pointer), (size)))
+#define INTERNAL_DEALLOCATE(allocator, pointer) \
+  ((allocator) \
+   ? (allocator)->deallocate((allocator)->context, (pointer)) \
+   : TRIO_FREE(pointer))
+
+#if defined(TRIO_FUNC_CREATE) \
+ || defined(TRIO_FUNC_DESTROY) \
+ || defined(TRIO_FUNC_STRING_CREATE) \
+ || defined(TRIO_FUNC_STRING_DUPLICATE) \
+ || defined(TRIO_FUNC_XSTRING_DUPLICATE) \
+ || defined(TRIO_FUNC_BUFFER_INIT) \
+ || defined(TRIO_FUNC_BUFFER_INIT_STORAGE) \
+ || defined(TRIO_FUNC_STRING_SET_ALLOCATOR)
+/* Installed heap allocator, or NULL for TRIO_MALLOC and friends */
+static TRIO_CONST trio_allocator_t *internal_allocator = NULL;
+#endif
+
 /*************************************************************************
  * Static String Functions
  */
@@ -173,7 +221,8 @@ struct _trio_string_t
 
 static char *
 internal_duplicate_max
-TRIO_ARGS2((source, size),
+TRIO_ARGS3((allocator, source, size),
+	   TRIO_CONST trio_allocator_t *allocator,
 	   TRIO_CONST char *source,
 	   size_t size)
 {
@@ -183,7 +232,7 @@ TRIO_ARGS2((source, size),
 
   /* Make room for string plus a terminating zero */
   size++;
-  target = trio_create(size);
+  target = (char *)INTERNAL_ALLOCATE(allocator, size);
   if (target)
     {
       trio_copy_max(target, size, source);
@@ -205,12 +254,15 @@ internal_string_alloc(TRIO_NOARGS)
 {
   trio_string_t *self;
 
-  self = (trio_string_t *)TRIO_MALLOC(sizeof(trio_string_t));
+  TRIO_CONST trio_allocator_t *allocator = internal_allocator;
+
+  self = (trio_string_t *)INTERNAL_ALLOCATE(allocator, sizeof(trio_string_t));
   if (self)
     {
       self->content = NULL;
       self->length = 0;
       self->allocated = 0;
+      self->allocator = allocator;
     }
   return self;
 }
@@ -242,7 +294,8 @@ TRIO_ARGS2((self, delta),
     ? ( (self->allocated == 0) ? 1 : self->allocated * 2 )
     : self->allocated + delta;
 
-  new_content = (char *)TRIO_REALLOC(self->content, new_size);
+  new_content = (char *)INTERNAL_REALLOCATE(self->allocator, self->content,
+					    new_size);
   if (new_content)
     {
       self->content = new_content;
@@ -302,9 +355,485 @@ TRIO_ARGS1((source),
 
 #endif
 
+#if defined(TRIO_FUNC_INTERNAL_TO_BINARY)
+
+/*
+ * internal_decimal_t
+ *
+ * Decimal significand used for correctly rounded conversion of decimal
+ * strings. The value is 0.d1d2d3... * 10^point with digits stored as
+ * 0-9. Eight hundred digits are enough to decide the rounding of any
+ * double, and 'truncated' records whether non-zero digits were dropped.
+ */
+typedef struct
+{
+  int count;
+  int point;
+  BOOLEAN_T truncated;
+  unsigned char digits[INTERNAL_DECIMAL_DIGITS];
+} internal_decimal_t;
+
+/*
+ * internal_decimal_parse
+ *
+ * Read an unsigned decimal number without hex-float, infinity or
+ * not-a-number support. Returns the end of the number, or NULL if
+ * there were no digits.
+ */
+static TRIO_CONST char *
+internal_decimal_parse
+TRIO_ARGS2((self, source),
+	   internal_decimal_t *self,
+	   TRIO_CONST char *source)
+{
+  BOOLEAN_T gotDigits = FALSE;
+  BOOLEAN_T gotPoint = FALSE;
+  BOOLEAN_T isExponentNegative = FALSE;
+  TRIO_CONST char *marker;
+  int significant = 0;
+  int count = 0;
+  int point = 0;
+  int exponent = 0;
+
+  self->truncated = FALSE;
+
+  /* Kept in locals as the digit stores may alias the structure */
+  for (;; source++)
+    {
+      if ((*source >= '0') && (*source <= '9'))
+	{
+	  gotDigits = TRUE;
+	  if ((*source == '0') && (significant == 0))
+	    {
+	      /* Leading zeros only move the decimal point */
+	      point--;
+	      continue;
+	    }
+	  significant++;
+	  if (count < INTERNAL_DECIMAL_DIGITS)
+	    self->digits[count++] = (unsigned char)(*source - '0');
+	  else if (*source != '0')
+	    self->truncated = TRUE;
+	}
+      else if ((*source == '.') && !gotPoint)
+	{
+	  gotPoint = TRUE;
+	  point = significant;
+	}
+      else
+	break;
+    }
+  if (!gotDigits)
+    return NULL;
+  if (!gotPoint)
+    point = significant;
+  self->count = count;
+  self->point = point;
+
+  if ((*source == 'e')
+      || (*source == 'E')
+#  if TRIO_MICROSOFT
+      || (*source == 'd')
+      || (*source == 'D')
+#  endif
+      )
+    {
+      /* The exponent is only consumed if it has digits */
+      marker = source + 1;
+      if ((*marker == '+') || (*marker == '-'))
+	{
+	  isExponentNegative = (*marker == '-');
+	  marker++;
+	}
+      if ((*marker >= '0') && (*marker <= '9'))
+	{
+	  for (source = marker; (*source >= '0') && (*source <= '9'); source++)
+	    {
+	      if (exponent < 10000)
+		exponent = exponent * 10 + (*source - '0');
+	    }
+	  self->point += isExponentNegative ? -exponent : exponent;
+	}
+    }
+
+  /* Trailing zeros do not contribute to the value */
+  while ((self->count > 0) && (self->digits[self->count - 1] == 0))
+    self->count--;
+
+  return source;
+}
+
+/*
+ * internal_decimal_shift_right
+ *
+ * Divide the decimal by 2^shift, where shift is at most
+ * INTERNAL_DECIMAL_SHIFT.
+ */
+static void
+internal_decimal_shift_right
+TRIO_ARGS2((self, shift),
+	   internal_decimal_t *self,
+	   int shift)
+{
+  unsigned long mask = (1UL << shift) - 1;
+  unsigned long number = 0;
+  unsigned long digit;
+  int reader = 0;
+  int writer = 0;
+
+  /* Find the first digit of the result */
+  while ((number >> shift) == 0)
+    {
+      if (reader >= self->count)
+	{
+	  if (number == 0)
+	    {
+	      self->count = 0;
+	      return;
+	    }
+	  while ((number >> shift) == 0)
+	    {
+	      number *= 10;
+	      reader++;
+	    }
+	  break;
+	}
+      number = number * 10 + self->digits[reader++];
+    }
+  self->point -= reader - 1;
+
+  for (; reader < self->count; reader++)
+    {
+      digit = number >> shift;
+      number &= mask;
+      self->digits[writer++] = (unsigned char)digit;
+      number = number * 10 + self->digits[reader];
+    }
+  while (number > 0)
+    {
+      digit = number >> shift;
+      number &= mask;
+      if (writer < INTERNAL_DECIMAL_DIGITS)
+	self->digits[writer++] = (unsigned char)digit;
+      else if (digit > 0)
+	self->truncated = TRUE;
+      number *= 10;
+    }
+  self->count = writer;
+  while ((self->count > 0) && (self->digits[self->count - 1] == 0))
+    self->count--;
+}
+
+/*
+ * internal_decimal_shift_left
+ *
+ * Multiply the decimal by 2^shift, where shift is at most
+ * INTERNAL_DECIMAL_SHIFT.
+ */
+static void
+internal_decimal_shift_left
+TRIO_ARGS2((self, shift),
+	   internal_decimal_t *self,
+	   int shift)
+{
+  unsigned long number = 0;
+  unsigned long quotient;
+  int reader;
+  int writer;
+  int extra = 0;
+
+  /* Count the new leading digits first so the product can be built in place */
+  for (reader = self->count - 1; reader >= 0; reader--)
+    number = (number + ((unsigned long)self->digits[reader] << shift)) / 10;
+  for (; number > 0; number /= 10)
+    extra++;
+
+  writer = self->count + extra;
+  for (reader = self->count - 1; reader >= 0; reader--)
+    {
+      number += (unsigned long)self->digits[reader] << shift;
+      quotient = number / 10;
+      writer--;
+      if (writer < INTERNAL_DECIMAL_DIGITS)
+	self->digits[writer] = (unsigned char)(number - quotient * 10);
+      else if (number != quotient * 10)
+	self->truncated = TRUE;
+      number = quotient;
+    }
+  while (number > 0)
+    {
+      quotient = number / 10;
+      self->digits[--writer] = (unsigned char)(number - quotient * 10);
+      number = quotient;
+    }
+
+  self->count += extra;
+  if (self->count > INTERNAL_DECIMAL_DIGITS)
+    self->count = INTERNAL_DECIMAL_DIGITS;
+  self->point += extra;
+  while ((self->count > 0) && (self->digits[self->count - 1] == 0))
+    self->count--;
+}
+
+/*
+ * internal_decimal_shift
+ */
+static void
+internal_decimal_shift
+TRIO_ARGS2((self, shift),
+	   internal_decimal_t *self,
+	   int shift)
+{
+  if (self->count == 0)
+    return;
+
+  for (; shift > INTERNAL_DECIMAL_SHIFT; shift -= INTERNAL_DECIMAL_SHIFT)
+    internal_decimal_shift_left(self, INTERNAL_DECIMAL_SHIFT);
+  for (; shift < -INTERNAL_DECIMAL_SHIFT; shift += INTERNAL_DECIMAL_SHIFT)
+    internal_decimal_shift_right(self, INTERNAL_DECIMAL_SHIFT);
+  if (shift > 0)
+    internal_decimal_shift_left(self, shift);
+  else if (shift < 0)
+    internal_decimal_shift_right(self, -shift);
+}
+
+/*
+ * internal_decimal_to_binary
+ *
+ * Convert the decimal to the nearest binary floating-point number
+ * with the given number of explicit mantissa bits and exponent range,
+ * rounding ties to even. This is the simple decimal conversion
+ * algorithm: scale by powers of two until the value is in [0.5, 1),
+ * then extract the mantissa bits and round on the remaining digits.
+ * It is slow but exact, and is only used when the fast path cannot
+ * guarantee a correctly rounded result.
+ *
+ * The decimal is destroyed.
+ */
+static double
+internal_decimal_to_binary
+TRIO_ARGS4((self, mantissaBits, minExponent, maxExponent),
+	   internal_decimal_t *self,
+	   int mantissaBits,
+	   int minExponent,
+	   int maxExponent)
+{
+  /* Number of bits that will scale the leading digits below 10 */
+  static TRIO_CONST int powers[] = { 1, 3, 6, 9, 13, 16, 19, 23, 26 };
+  int exponent = 0;
+  int shift;
+  int i;
+  double mantissa = 0.0;
+  double limit;
+
+  if (self->count == 0)
+    return 0.0;
+  if (self->point > 310)
+    return HUGE_VAL;
+  if (self->point < -330)
+    return 0.0;
+
+  /* Scale into [0.5, 1) */
+  while (self->point > 0)
+    {
+      shift = (self->point >= (int)(sizeof(powers) / sizeof(powers[0])))
+	? INTERNAL_DECIMAL_SHIFT - 1
+	: powers[self->point];
+      internal_decimal_shift(self, -shift);
+      exponent += shift;
+    }
+  while ((self->point < 0) ||
+	 ((self->point == 0) && (self->digits[0] < 5)))
+    {
+      shift = (-self->point >= (int)(sizeof(powers) / sizeof(powers[0])))
+	? INTERNAL_DECIMAL_SHIFT - 1
+	: powers[-self->point];
+      internal_decimal_shift(self, shift);
+      exponent -= shift;
+    }
+  /* The binary range is [1, 2) */
+  exponent--;
+
+  if (exponent < minExponent)
+    {
+      /* Subnormal */
+      internal_decimal_shift(self, exponent - minExponent);
+      exponent = minExponent;
+    }
+  if (exponent > maxExponent)
+    return HUGE_VAL;
+
+  /* Extract the mantissa, which has at most 54 bits and is exact */
+  internal_decimal_shift(self, 1 + mantissaBits);
+  for (i = 0; i < self->point; i++)
+    {
+      mantissa *= 10.0;
+      if (i < self->count)
+	mantissa += self->digits[i];
+    }
+  if ((self->point >= 0) && (self->point < self->count))
+    {
+      /* Round half to even */
+      if (self->digits[self->point] > 5)
+	mantissa += 1.0;
+      else if (self->digits[self->point] == 5)
+	{
+	  if ((self->point + 1 < self->count) ||
+	      self->truncated ||
+	      ((self->point > 0) && (self->digits[self->point - 1] & 1)))
+	    mantissa += 1.0;
+	}
+    }
+
+  limit = ldexp(1.0, mantissaBits + 1);
+  if (mantissa == limit)
+    {
+      /* Rounding carried into a new bit */
+      mantissa /= 2.0;
+      exponent++;
+      if (exponent > maxExponent)
+	return HUGE_VAL;
+    }
+  return ldexp(mantissa, exponent - mantissaBits);
+}
+
+/*
+ * internal_to_binary
+ *
+ * Convert a plain decimal number to double, or to float precision if
+ * 'isFloat' is set. Returns FALSE for anything else (hex-floats,
+ * infinity, not-a-number) which is left to the caller.
+ *
+ * Numbers with few significant digits and a small exponent are
+ * converted with a single exact floating-point operation (Clinger's
+ * fast path). The rest are left to strtod and strtof when available,
+ * and otherwise go through internal_decimal_to_binary.
+ */
+static BOOLEAN_T
+internal_to_binary
+TRIO_ARGS4((source, endp, isFloat, target),
+	   TRIO_CONST char *source,
+	   char **endp,
+	   BOOLEAN_T isFloat,
+	   double *target)
+{
+# if defined(USE_FAST_DECIMAL)
+  static TRIO_CONST double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  double mantissa;
+  int exponent;
+  int i;
+# endif
+  internal_decimal_t decimal;
+  TRIO_CONST char *end;
+  BOOLEAN_T isNegative;
+  double value;
+
+  isNegative = (*source == '-');
+  if ((*source == '+') || (*source == '-'))
+    source++;
+  if ((source[0] == '0') && ((source[1] == 'x') || (source[1] == 'X')))
+    return FALSE;
+
+  end = internal_decimal_parse(&decimal, source);
+  if (end == NULL)
+    return FALSE;
+
+# if defined(USE_FAST_DECIMAL)
+  exponent = decimal.point - decimal.count;
+  if (!decimal.truncated && (decimal.count <= (isFloat ? 7 : 15)))
+    {
+      mantissa = 0.0;
+      for (i = 0; i < decimal.count; i++)
+	mantissa = mantissa * 10.0 + decimal.digits[i];
+
+      if (isFloat && (exponent >= -10) && (exponent <= 10))
+	{
+	  value = (exponent < 0)
+	    ? (float)mantissa / (float)powers[-exponent]
+	    : (float)mantissa * (float)powers[exponent];
+	  goto done;
+	}
+      if (!isFloat && (exponent >= -22) && (exponent <= 22))
+	{
+	  value = (exponent < 0)
+	    ? mantissa / powers[-exponent]
+	    : mantissa * powers[exponent];
+	  goto done;
+	}
+      if (!isFloat && (exponent > 22) && (exponent - 22 <= 15 - decimal.count))
+	{
+	  /* The first product is an exact integer */
+	  value = (mantissa * powers[exponent - 22]) * 1e22;
+	  goto done;
+	}
+    }
+# endif
+
+  /* The C library is exact, and faster, for the remaining numbers */
+# if defined(USE_STRTOF)
+  if (isFloat)
+    return FALSE;
+# endif
+# if defined(USE_STRTOD)
+  if (!isFloat)
+    return FALSE;
+# endif
+
+  if (isFloat)
+    value = internal_decimal_to_binary(&decimal,
+				       FLT_MANT_DIG - 1,
+				       FLT_MIN_EXP - 1,
+				       FLT_MAX_EXP - 1);
+  else
+    value = internal_decimal_to_binary(&decimal,
+				       DBL_MANT_DIG - 1,
+				       DBL_MIN_EXP - 1,
+				       DBL_MAX_EXP - 1);
+
+# if defined(USE_FAST_DECIMAL)
+ done:
+# endif
+  if (endp)
+    *endp = (char *)end;
+  *target = isNegative ? -value : value;
+  return TRUE;
+}
+
+#endif
+
+/**
+   Install a heap allocator for the string functions.
+
+   Strings, dynamic strings, and buffer strings initialized without an
+   allocator obtain their memory from @p allocator after this call.
+   Dynamic strings and buffer strings keep the allocator they were
+   created with, but strings from @ref trio_create and
+   @ref trio_duplicate must be destroyed while the same allocator is
+   installed. trio_set_allocator() also installs its allocator here.
+
+   @param allocator Allocator, or NULL to use malloc.
+*/
+#if defined(TRIO_FUNC_STRING_SET_ALLOCATOR)
+
+TRIO_PUBLIC_STRING void
+trio_string_set_allocator
+TRIO_ARGS1((allocator),
+	   TRIO_CONST trio_allocator_t *allocator)
+{
+  internal_allocator = allocator;
+}
+
+#endif
+
 /**
    Create new string.
 
+   The string is allocated with the installed allocator (see
+   @ref trio_string_set_allocator).
+
    @param size Size of new string.
    @return Pointer to string, or NULL if allocation failed.
 */
@@ -315,7 +844,7 @@ trio_create
 TRIO_ARGS1((size),
 	   size_t size)
 {
-  return (char *)TRIO_MALLOC(size);
+  return (char *)INTERNAL_ALLOCATE(internal_allocator, size);
 }
 
 #endif
@@ -334,7 +863,7 @@ TRIO_ARGS1((string),
 {
   if (string)
     {
-      TRIO_FREE(string);
+      INTERNAL_DEALLOCATE(internal_allocator, string);
     }
 }
 
@@ -564,7 +1093,7 @@ trio_duplicate
 TRIO_ARGS1((source),
 	   TRIO_CONST char *source)
 {
-  return internal_duplicate_max(source, trio_length(source));
+  return internal_duplicate_max(internal_allocator, source, trio_length(source));
 }
 
 #endif
@@ -596,7 +1125,7 @@ TRIO_ARGS2((source, max),
     {
       length = max;
     }
-  return internal_duplicate_max(source, length);
+  return internal_duplicate_max(internal_allocator, source, length);
 }
 
 #endif
@@ -1342,7 +1871,7 @@ TRIO_ARGS2((source, endp),
    @param endp Pointer to end of the converted string.
    @return A floating-point number.
 
-   See @ref trio_to_long_double.
+   See @ref trio_to_long_double. Decimal numbers are correctly rounded.
 */
 #if defined(TRIO_FUNC_TO_DOUBLE)
 
@@ -1352,6 +1881,10 @@ TRIO_ARGS2((source, endp),
 	   TRIO_CONST char *source,
 	   char **endp)
 {
+  double value;
+
+  if (internal_to_binary(source, endp, FALSE, &value))
+    return value;
 #if defined(USE_STRTOD)
   return strtod(source, endp);
 #else
@@ -1368,7 +1901,7 @@ TRIO_ARGS2((source, endp),
    @param endp Pointer to end of the converted string.
    @return A floating-point number.
 
-   See @ref trio_to_long_double.
+   See @ref trio_to_long_double. Decimal numbers are correctly rounded.
 */
 #if defined(TRIO_FUNC_TO_FLOAT)
 
@@ -1378,6 +1911,10 @@ TRIO_ARGS2((source, endp),
 	   TRIO_CONST char *source,
 	   char **endp)
 {
+  double value;
+
+  if (internal_to_binary(source, endp, TRUE, &value))
+    return (float)value;
 #  if defined(USE_STRTOF)
   return strtof(source, endp);
 #  else
@@ -1566,8 +2103,9 @@ TRIO_ARGS1((self),
 
   if (self)
     {
-      trio_destroy(self->content);
-      TRIO_FREE(self);
+      if (self->content)
+	INTERNAL_DEALLOCATE(self->allocator, self->content);
+      INTERNAL_DEALLOCATE(self->allocator, self);
     }
 }
 
@@ -1634,7 +2172,9 @@ TRIO_ARGS2((self, offset),
    @return Content of dynamic string.
 
    The content is removed from the dynamic string. This enables destruction
-   of the dynamic string without deallocation of the content.
+   of the dynamic string without deallocation of the content. The content
+   was obtained from the allocator that was installed when the dynamic
+   string was created.
 */
 #if defined(TRIO_FUNC_STRING_EXTRACT)
 
@@ -1679,8 +2219,10 @@ TRIO_ARGS2((self, buffer),
 {
   assert(self);
 
-  trio_destroy(self->content);
-  self->content = trio_duplicate(buffer);
+  if (self->content)
+    INTERNAL_DEALLOCATE(self->allocator, self->content);
+  self->content = internal_duplicate_max(self->allocator, buffer,
+					 trio_length(buffer));
 }
 
 #endif
@@ -1941,7 +2483,8 @@ TRIO_ARGS1((other),
   self = internal_string_alloc();
   if (self)
     {
-      self->content = internal_duplicate_max(other->content, other->length);
+      self->content = internal_duplicate_max(self->allocator,
+					     other->content, other->length);
       if (self->content)
 	{
 	  self->length = other->length;
@@ -1974,7 +2517,8 @@ TRIO_ARGS1((other),
   self = internal_string_alloc();
   if (self)
     {
-      self->content = internal_duplicate_max(other, trio_length(other));
+      self->content = internal_duplicate_max(self->allocator,
+					     other, trio_length(other));
       if (self->content)
 	{
 	  self->length = trio_length(self->content);
@@ -2370,4 +2914,322 @@ TRIO_ARGS1((self),
 
 #endif
 
+/*************************************************************************
+ * Buffer strings
+ *
+ * A trio_buffer_t is a dynamic string that does not need a heap
+ * allocation until its content outgrows the storage it was initialized
+ * with. There is always room for a terminating zero after the content.
+ */
+
+#if defined(TRIO_FUNC_BUFFER_RESERVE) \
+ || defined(TRIO_FUNC_BUFFER_EXTRACT)
+
+static char *
+internal_buffer_allocate
+TRIO_ARGS2((self, size),
+	   trio_buffer_t *self,
+	   size_t size)
+{
+  return (char *)INTERNAL_ALLOCATE(self->allocator, size);
+}
+
+static char *
+internal_buffer_reallocate
+TRIO_ARGS2((self, size),
+	   trio_buffer_t *self,
+	   size_t size)
+{
+  return (char *)INTERNAL_REALLOCATE(self->allocator, self->content, size);
+}
+
+#endif
+
+/**
+   Initialize a buffer string with its inline storage.
+
+   @param self Buffer string.
+   @param allocator Allocator used when the content outgrows the inline
+   storage, or NULL to use the installed allocator.
+*/
+#if defined(TRIO_FUNC_BUFFER_INIT)
+
+TRIO_PUBLIC_STRING void
+trio_buffer_init
+TRIO_ARGS2((self, allocator),
+	   trio_buffer_t *self,
+	   TRIO_CONST trio_allocator_t *allocator)
+{
+  assert(self);
+
+  self->storage = self->inline_storage;
+  self->storage_size = sizeof(self->inline_storage);
+  self->content = self->storage;
+  self->allocated = self->storage_size;
+  self->length = 0;
+  self->allocator = (allocator) ? allocator : internal_allocator;
+  self->content[0] = (char)0;
+}
+
+#endif
+
+/**
+   Initialize a buffer string with caller-provided storage.
+
+   The storage is used until the content outgrows it, and it is never
+   released by the buffer string.
+
+   @param self Buffer string.
+   @param storage Initial storage, for example on the stack or in an arena.
+   @param size Size of @p storage (at least one).
+   @param allocator Allocator used when the content outgrows the storage,
+   or NULL to use the installed allocator.
+*/
+#if defined(TRIO_FUNC_BUFFER_INIT_STORAGE)
+
+TRIO_PUBLIC_STRING void
+trio_buffer_init_storage
+TRIO_ARGS4((self, storage, size, allocator),
+	   trio_buffer_t *self,
+	   char *storage,
+	   size_t size,
+	   TRIO_CONST trio_allocator_t *allocator)
+{
+  assert(self);
+  assert(storage);
+  assert(size > 0);
+
+  self->storage = storage;
+  self->storage_size = size;
+  self->content = storage;
+  self->allocated = size;
+  self->length = 0;
+  self->allocator = (allocator) ? allocator : internal_allocator;
+  self->content[0] = (char)0;
+}
+
+#endif
+
+/**
+   Release the memory allocated by a buffer string.
+
+   The buffer string is empty afterwards, and it can be used again.
+
+   @param self Buffer string.
+*/
+#if defined(TRIO_FUNC_BUFFER_DESTROY)
+
+TRIO_PUBLIC_STRING void
+trio_buffer_destroy
+TRIO_ARGS1((self),
+	   trio_buffer_t *self)
+{
+  assert(self);
+
+  if (self->content != self->storage)
+    {
+      INTERNAL_DEALLOCATE(self->allocator, self->content);
+      self->content = self->storage;
+      self->allocated = self->storage_size;
+    }
+  self->length = 0;
+  self->content[0] = (char)0;
+}
+
+#endif
+
+/**
+   Make room for more characters.
+
+   The size is at least doubled when the buffer string grows, so
+   appending one character at a time takes amortized constant time.
+
+   @param self Buffer string.
+   @param length Number of characters to make room for.
+   @return Boolean value indicating success or failure.
+*/
+#if defined(TRIO_FUNC_BUFFER_RESERVE)
+
+TRIO_PUBLIC_STRING int
+trio_buffer_reserve
+TRIO_ARGS2((self, length),
+	   trio_buffer_t *self,
+	   size_t length)
+{
+  char *content;
+  size_t size;
+
+  assert(self);
+
+  /* Room for terminating zero */
+  if (self->length + length < self->allocated)
+    return TRUE;
+
+  size = self->allocated * 2;
+  if (size < self->length + length + 1)
+    size = self->length + length + 1;
+
+  if (self->content == self->storage)
+    {
+      content = internal_buffer_allocate(self, size);
+      if (content == NULL)
+	return FALSE;
+      memcpy(content, self->content, self->length + 1);
+    }
+  else
+    {
+      content = internal_buffer_reallocate(self, size);
+      if (content == NULL)
+	return FALSE;
+    }
+  self->content = content;
+  self->allocated = size;
+  return TRUE;
+}
+
+#endif
+
+/**
+   Append characters to a buffer string.
+
+   @param self Buffer string.
+   @param block Characters to append (need not be zero terminated).
+   @param length Number of characters in @p block.
+   @return Boolean value indicating success or failure.
+*/
+#if defined(TRIO_FUNC_BUFFER_APPEND)
+
+TRIO_PUBLIC_STRING int
+trio_buffer_append
+TRIO_ARGS3((self, block, length),
+	   trio_buffer_t *self,
+	   TRIO_CONST char *block,
+	   size_t length)
+{
+  assert(self);
+  assert(block || (length == 0));
+
+  if (!trio_buffer_reserve(self, length))
+    return FALSE;
+  memcpy(&self->content[self->length], block, length);
+  self->length += length;
+  self->content[self->length] = (char)0;
+  return TRUE;
+}
+
+#endif
+
+/**
+   Append a character to a buffer string.
+
+   @param self Buffer string.
+   @param character Character to append.
+   @return Boolean value indicating success or failure.
+*/
+#if defined(TRIO_FUNC_BUFFER_APPEND_CHAR)
+
+TRIO_PUBLIC_STRING int
+trio_buffer_append_char
+TRIO_ARGS2((self, character),
+	   trio_buffer_t *self,
+	   char character)
+{
+  assert(self);
+
+  if (!trio_buffer_reserve(self, 1))
+    return FALSE;
+  self->content[self->length++] = character;
+  self->content[self->length] = (char)0;
+  return TRUE;
+}
+
+#endif
+
+/**
+   Get the zero terminated content of a buffer string.
+
+   The pointer is valid until the buffer string is modified.
+
+   @param self Buffer string.
+   @return Pointer to the content.
+*/
+#if defined(TRIO_FUNC_BUFFER_GET)
+
+TRIO_PUBLIC_STRING char *
+trio_buffer_get
+TRIO_ARGS1((self),
+	   trio_buffer_t *self)
+{
+  assert(self);
+
+  return self->content;
+}
+
+#endif
+
+/**
+   Get the length of a buffer string.
+
+   @param self Buffer string.
+   @return Number of characters in the content.
+*/
+#if defined(TRIO_FUNC_BUFFER_LENGTH)
+
+TRIO_PUBLIC_STRING size_t
+trio_buffer_length
+TRIO_ARGS1((self),
+	   trio_buffer_t *self)
+{
+  assert(self);
+
+  return self->length;
+}
+
+#endif
+
+/**
+   Extract the content of a buffer string.
+
+   The content is returned in memory of the exact size, obtained from
+   the allocator of the buffer string, and the buffer string is empty
+   afterwards.
+
+   @param self Buffer string.
+   @return Newly allocated zero terminated string, or NULL if memory
+   allocation failed.
+*/
+#if defined(TRIO_FUNC_BUFFER_EXTRACT)
+
+TRIO_PUBLIC_STRING char *
+trio_buffer_extract
+TRIO_ARGS1((self),
+	   trio_buffer_t *self)
+{
+  char *result;
+
+  assert(self);
+
+  if (self->content == self->storage)
+    {
+      result = internal_buffer_allocate(self, self->length + 1);
+      if (result == NULL)
+	return NULL;
+      memcpy(result, self->content, self->length + 1);
+    }
+  else
+    {
+      /* Shrink to fit, but keep the larger memory if that fails */
+      result = internal_buffer_reallocate(self, self->length + 1);
+      if (result == NULL)
+	result = self->content;
+      self->content = self->storage;
+      self->allocated = self->storage_size;
+    }
+  self->length = 0;
+  self->content[0] = (char)0;
+  return result;
+}
+
+#endif
+
 /** @} End of DynamicStrings */
@@ -136,6 +136,13 @@ enum {
 #  endif
 # endif
 
+# if defined(TRIO_FUNC_BUFFER_APPEND) \
+  || defined(TRIO_FUNC_BUFFER_APPEND_CHAR)
+#  if !defined(TRIO_FUNC_BUFFER_RESERVE)
+#   define TRIO_FUNC_BUFFER_RESERVE
+#  endif
+# endif
+
 #else
 
 /*
@@ -202,6 +209,7 @@ enum {
 # define TRIO_FUNC_STRING_LOWER
 # define TRIO_FUNC_STRING_MATCH
 # define TRIO_FUNC_STRING_MATCH_CASE
+# define TRIO_FUNC_STRING_SET_ALLOCATOR
 # define TRIO_FUNC_STRING_SIZE
 # define TRIO_FUNC_STRING_SUBSTRING
 # define TRIO_FUNC_STRING_TERMINATE
@@ -222,6 +230,16 @@ enum {
 # define TRIO_FUNC_XSTRING_SET
 # define TRIO_FUNC_XSTRING_SUBSTRING
 
+# define TRIO_FUNC_BUFFER_APPEND
+# define TRIO_FUNC_BUFFER_APPEND_CHAR
+# define TRIO_FUNC_BUFFER_DESTROY
+# define TRIO_FUNC_BUFFER_EXTRACT
+# define TRIO_FUNC_BUFFER_GET
+# define TRIO_FUNC_BUFFER_INIT
+# define TRIO_FUNC_BUFFER_INIT_STORAGE
+# define TRIO_FUNC_BUFFER_LENGTH
+# define TRIO_FUNC_BUFFER_RESERVE
+
 #endif
 
 /*************************************************************************
@@ -568,6 +586,12 @@ trio_string_match_case
 TRIO_PROTO((trio_string_t *self, trio_string_t *other));
 #endif
 
+#if defined(TRIO_FUNC_STRING_SET_ALLOCATOR)
+TRIO_PUBLIC_STRING void
+trio_string_set_allocator
+TRIO_PROTO((TRIO_CONST trio_allocator_t *allocator));
+#endif
+
 #if defined(TRIO_FUNC_STRING_SIZE)
 TRIO_PUBLIC_STRING int
 trio_string_size
@@ -676,6 +700,91 @@ trio_xstring_substring
 TRIO_PROTO((trio_string_t *self, TRIO_CONST char *other));
 #endif
 
+/*************************************************************************
+ * Buffer string functions
+ */
+
+/*
+ * The inline size is part of the layout of trio_buffer_t, so it must be
+ * the same for the library and its callers. Use trio_buffer_init_storage
+ * for initial storage of another size.
+ */
+enum {
+  TRIO_BUFFER_INLINE_SIZE = 64
+};
+
+/*
+ * Dynamic string that can be placed on the stack or inside another
+ * object. The content is kept in the inline storage, or in the storage
+ * given to trio_buffer_init_storage, until it outgrows it. The buffer
+ * refers to itself, so it must not be copied.
+ */
+struct _trio_buffer_t
+{
+  char *content;
+  size_t length;
+  size_t allocated;
+  char *storage;
+  size_t storage_size;
+  TRIO_CONST trio_allocator_t *allocator;
+  char inline_storage[TRIO_BUFFER_INLINE_SIZE];
+};
+
+#if defined(TRIO_FUNC_BUFFER_APPEND)
+TRIO_PUBLIC_STRING int
+trio_buffer_append
+TRIO_PROTO((trio_buffer_t *self, TRIO_CONST char *block, size_t length));
+#endif
+
+#if defined(TRIO_FUNC_BUFFER_APPEND_CHAR)
+TRIO_PUBLIC_STRING int
+trio_buffer_append_char
+TRIO_PROTO((trio_buffer_t *self, char character));
+#endif
+
+#if defined(TRIO_FUNC_BUFFER_DESTROY)
+TRIO_PUBLIC_STRING void
+trio_buffer_destroy
+TRIO_PROTO((trio_buffer_t *self));
+#endif
+
+#if defined(TRIO_FUNC_BUFFER_EXTRACT)
+TRIO_PUBLIC_STRING char *
+trio_buffer_extract
+TRIO_PROTO((trio_buffer_t *self));
+#endif
+
+#if defined(TRIO_FUNC_BUFFER_GET)
+TRIO_PUBLIC_STRING char *
+trio_buffer_get
+TRIO_PROTO((trio_buffer_t *self));
+#endif
+
+#if defined(TRIO_FUNC_BUFFER_INIT)
+TRIO_PUBLIC_STRING void
+trio_buffer_init
+TRIO_PROTO((trio_buffer_t *self, TRIO_CONST trio_allocator_t *allocator));
+#endif
+
+#if defined(TRIO_FUNC_BUFFER_INIT_STORAGE)
+TRIO_PUBLIC_STRING void
+trio_buffer_init_storage
+TRIO_PROTO((trio_buffer_t *self, char *storage, size_t size,
+	    TRIO_CONST trio_allocator_t *allocator));
+#endif
+
+#if defined(TRIO_FUNC_BUFFER_LENGTH)
+TRIO_PUBLIC_STRING size_t
+trio_buffer_length
+TRIO_PROTO((trio_buffer_t *self));
+#endif
+
+#if defined(TRIO_FUNC_BUFFER_RESERVE)
+TRIO_PUBLIC_STRING int
+trio_buffer_reserve
+TRIO_PROTO((trio_buffer_t *self, size_t length));
+#endif
+
 #ifdef __cplusplus
 }
 #endif